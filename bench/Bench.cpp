@@ -0,0 +1,214 @@
+// Bench Micro-benchmarks of the inner kernels, kept out of the simulator
+//    Each one times an old and a new implementation of the same work and
+//    reports the largest difference between their results. Built with
+//    `cmake -DBENCH=ON ..`; run as `Bench RESOURCE_DIR [count]`. Exits with 1
+//    if the revolute closed form does not match the generic path.
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <cmath>
+#include <cstdlib>
+
+#include "MLCommon.h"
+#include "SE3.h"
+#include "RigidTransform.h"
+#include "Node.h"
+#include "Tetrahedron.h"
+#include "World.h"
+#include "JointTree.h"
+#include "JointRevolute.h"
+#include "Body.h"
+#include "Shape.h"
+
+using namespace std;
+using namespace Eigen;
+
+static void benchTransform(int count) {
+	// Times the relative-transform kernel of Body::update and the adjoint
+	// products of the Jacobian recursions: E_ip = inv(E_wi) * E_wp, then
+	// Ad_ip applied to a twist and its transpose applied to a wrench.
+	vector<Matrix4d> Ewi(count), Ewp(count);
+	vector<Vector6d> x(count);
+	for (int k = 0; k < count; k++) {
+		Vector6d phi = Vector6d::Random();
+		Ewi[k] = SE3::exp(phi);
+		phi = Vector6d::Random();
+		Ewp[k] = SE3::exp(phi);
+		x[k] = Vector6d::Random();
+	}
+
+	vector<Vector6d> ySE3(count), yT(count);
+	auto start = chrono::steady_clock::now();
+	for (int k = 0; k < count; k++) {
+		Matrix4d Eip = SE3::inverse(Ewi[k]) * Ewp[k];
+		Matrix6d Ad = SE3::adjoint(Eip);
+		ySE3[k] = Ad * x[k] + Ad.transpose() * x[k];
+	}
+	double timeSE3 = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	// Input conversion is left out of the timing, since RigidTransform is meant to be stored
+	vector<RigidTransform> Twi(count), Twp(count);
+	for (int k = 0; k < count; k++) {
+		Twi[k] = RigidTransform(Ewi[k]);
+		Twp[k] = RigidTransform(Ewp[k]);
+	}
+	start = chrono::steady_clock::now();
+	for (int k = 0; k < count; k++) {
+		Adjoint Ad = Twi[k].inverseTimes(Twp[k]).adjoint();
+		yT[k] = Ad.apply(x[k]) + Ad.applyTranspose(x[k]);
+	}
+	double timeTransform = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	double maxError = 0.0;
+	for (int k = 0; k < count; k++) {
+		maxError = max(maxError, (ySE3[k] - yT[k]).cwiseAbs().maxCoeff());
+	}
+	cout << "transform: " << count << " transforms, SE3 " << timeSE3 << " s, RigidTransform "
+		<< timeTransform << " s, max error " << maxError << endl;
+}
+
+static bool benchRevolute(const string &RESOURCE_DIR, int count) {
+	// Updates the revolute joints of the SERIAL_CHAIN world at the same random
+	// angles with the generic path (Q from SE3::aaToMat, then the Matrix4d
+	// products) and with the closed form, and checks that the joint and body
+	// transforms and adjoints agree to 1e-12. Then times each path on its own.
+	auto world = make_shared<World>(SERIAL_CHAIN);
+	world->load(RESOURCE_DIR);
+	world->init();
+	shared_ptr<JointTree> tree = world->getJointTree();
+	vector<JointRevolute *> joints;
+	for (int k = 0; k < tree->getNumJoints(); k++) {
+		JointRevolute *joint = dynamic_cast<JointRevolute *>(tree->getJoint(k));
+		if (joint != nullptr) {
+			joints.push_back(joint);
+		}
+	}
+	int n = (int)joints.size();
+	VectorXd qs = 3.14159265358979 * VectorXd::Random(count * n);
+
+	// Joint E_pj, E_jp, E_wj, body E_wi, and joint Ad_jp, body Ad_ip
+	vector<Matrix4d> E(4 * n);
+	vector<Matrix6d> Ad(2 * n);
+	double maxError = 0.0;
+	for (int k = 0; k < count; k++) {
+		for (int i = 0; i < n; i++) {
+			JointRevolute *joint = joints[i];
+			joint->m_q(0) = qs(k * n + i);
+			joint->updatePositionGeneric();
+			E[4 * i] = joint->E_pj;
+			E[4 * i + 1] = joint->E_jp;
+			E[4 * i + 2] = joint->E_wj;
+			E[4 * i + 3] = joint->getBody()->E_wi;
+			Ad[2 * i] = joint->Ad_jp;
+			Ad[2 * i + 1] = joint->getBody()->Ad_ip;
+		}
+		for (int i = 0; i < n; i++) {
+			JointRevolute *joint = joints[i];
+			joint->updatePositionClosedForm();
+			Body *body = joint->getBody().get();
+			maxError = max(maxError, (E[4 * i] - joint->E_pj).cwiseAbs().maxCoeff());
+			maxError = max(maxError, (E[4 * i + 1] - joint->E_jp).cwiseAbs().maxCoeff());
+			maxError = max(maxError, (E[4 * i + 2] - joint->E_wj).cwiseAbs().maxCoeff());
+			maxError = max(maxError, (E[4 * i + 3] - body->E_wi).cwiseAbs().maxCoeff());
+			maxError = max(maxError, (Ad[2 * i] - joint->Ad_jp).cwiseAbs().maxCoeff());
+			maxError = max(maxError, (Ad[2 * i + 1] - body->Ad_ip).cwiseAbs().maxCoeff());
+		}
+	}
+
+	auto start = chrono::steady_clock::now();
+	for (int k = 0; k < count; k++) {
+		for (int i = 0; i < n; i++) {
+			joints[i]->m_q(0) = qs(k * n + i);
+			joints[i]->updatePositionGeneric();
+		}
+	}
+	double timeGeneric = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	start = chrono::steady_clock::now();
+	for (int k = 0; k < count; k++) {
+		for (int i = 0; i < n; i++) {
+			joints[i]->m_q(0) = qs(k * n + i);
+			joints[i]->updatePositionClosedForm();
+		}
+	}
+	double timeClosedForm = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	bool isMatching = (maxError <= 1.0e-12);
+	cout << "revolute: " << n << " joints x " << count << ", generic " << timeGeneric
+		<< " s, closed form " << timeClosedForm << " s, speedup " << timeGeneric / timeClosedForm
+		<< ", max error " << maxError << (isMatching ? "" : " FAILED (> 1e-12)") << endl;
+	return isMatching;
+}
+
+static void benchElementForces(int ntets, int count) {
+	// Computes the elastic forces of a strip of tets whose consecutive
+	// elements share three nodes, so the force vector grows with ntets. The
+	// by-value path copies f into and out of every element as SoftBody did,
+	// which is O(ntets^2) per evaluation; the in-place path is O(ntets).
+	int nnodes = ntets + 3;
+	vector<shared_ptr<Node> > nodes(nnodes);
+	for (int k = 0; k < nnodes; k++) {
+		// Points on a helix, so that any four consecutive ones span a tet
+		nodes[k] = make_shared<Node>();
+		nodes[k]->x0 << cos(2.0 * k), sin(2.0 * k), 0.5 * k;
+		nodes[k]->x = nodes[k]->x0 + 0.05 * Vector3d::Random();
+		nodes[k]->idxM = 3 * k;
+	}
+	vector<shared_ptr<Tetrahedron> > tets(ntets);
+	for (int k = 0; k < ntets; k++) {
+		vector<shared_ptr<Node> > tetNodes(nodes.begin() + k, nodes.begin() + k + 4);
+		tets[k] = make_shared<Tetrahedron>(1.0e3, 0.35, 1.0, NEO_HOOKEAN, tetNodes);
+	}
+
+	VectorXd fCopy = VectorXd::Zero(3 * nnodes);
+	auto start = chrono::steady_clock::now();
+	for (int n = 0; n < count; n++) {
+		fCopy.setZero();
+		for (int k = 0; k < ntets; k++) {
+			VectorXd f = fCopy;
+			tets[k]->computeElasticForces(f);
+			fCopy = f;
+		}
+	}
+	double timeCopy = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	VectorXd fInPlace = VectorXd::Zero(3 * nnodes);
+	start = chrono::steady_clock::now();
+	for (int n = 0; n < count; n++) {
+		fInPlace.setZero();
+		for (int k = 0; k < ntets; k++) {
+			tets[k]->computeElasticForces(fInPlace);
+		}
+	}
+	double timeInPlace = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	// Per tet and evaluation, so that the in-place column stays flat as ntets
+	// grows while the by-value one grows with it
+	double maxError = (fCopy - fInPlace).cwiseAbs().maxCoeff();
+	double scale = 1.0e9 / ((double)ntets * count);
+	cout << "element forces: " << ntets << " tets x " << count << ", by value " << timeCopy * scale
+		<< " ns/tet, in place " << timeInPlace * scale << " ns/tet, max error " << maxError << endl;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		cout << "Please specify the resource directory." << endl;
+		return 1;
+	}
+	string RESOURCE_DIR = argv[1] + string("/");
+	int count = (argc > 2) ? atoi(argv[2]) : 200000;
+	Shape::setGPUEnabled(false);
+
+	benchTransform(count);
+	bool isMatching = benchRevolute(RESOURCE_DIR, count);
+	// Same number of evaluations at every size, so the time per tet shows
+	// whether the cost of one evaluation is linear or quadratic in ntets
+	int ntets[] = { 250, 500, 1000, 2000, 4000 };
+	for (int k = 0; k < 5; k++) {
+		benchElementForces(ntets[k], max(count / 4000, 1));
+	}
+	return isMatching ? 0 : 1;
+}
@@ -0,0 +1,67 @@
+// MallocCheck Steps a few worlds with the dense solver and lets Eigen assert
+//    on any heap allocation inside a step after the first one. Built with
+//    `cmake -DMALLOC_CHECK=ON ..`, which defines EIGEN_RUNTIME_NO_MALLOC, and
+//    run by ctest. Needs Eigen's asserts, so use a Debug build.
+
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "World.h"
+#include "Solver.h"
+#include "Joint.h"
+#include "Shape.h"
+#include "QuadProgActiveSet.h"
+
+using namespace std;
+using namespace Eigen;
+
+#ifndef EIGEN_RUNTIME_NO_MALLOC
+#error "MallocCheck needs EIGEN_RUNTIME_NO_MALLOC"
+#endif
+
+static shared_ptr<Solver> stepWorld(const string &RESOURCE_DIR, WorldType type, int nsteps) {
+	auto world = make_shared<World>(type);
+	world->load(RESOURCE_DIR);
+	auto solver = make_shared<Solver>(world, REDMAX_EULER);
+	solver->load(RESOURCE_DIR);
+	solver->setIntegrator(REDMAX_EULER);
+	solver->setSparse(false);
+	solver->setMallocCheck(true);
+	world->init();
+	solver->init();
+
+	VectorXd y(2 * world->nr);
+	y.setZero();
+	y = world->getJoint0()->gatherDofs(y, world->nr);
+	for (int k = 0; k < nsteps; k++) {
+		y = solver->dynamics(y);
+		world->update();
+		world->incrementTime();
+	}
+	return solver;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		cout << "Please specify the resource directory." << endl;
+		return 1;
+	}
+	string RESOURCE_DIR = argv[1] + string("/");
+	Shape::setGPUEnabled(false);
+
+	// Unconstrained, branching, and equality constrained (KKT or range space)
+	stepWorld(RESOURCE_DIR, SERIAL_CHAIN, 20);
+	stepWorld(RESOURCE_DIR, BRANCHING, 20);
+	stepWorld(RESOURCE_DIR, LOOP, 20);
+	// Inequality constrained, through the active-set QP. The chain needs a
+	// while to fall onto the limits, and then the active count changes.
+	auto solver = stepWorld(RESOURCE_DIR, JOINT_LIMITS, 100);
+	if (solver->getQuadProg()->getStats().solves == 0) {
+		cout << "MallocCheck: JOINT_LIMITS never reached a limit" << endl;
+		return 1;
+	}
+	cout << "MallocCheck: no allocation after the first step" << endl;
+	return 0;
+}
@@ -0,0 +1,138 @@
+#include "BatchRunner.h"
+
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <exception>
+
+#include "Solver.h"
+#include "Shape.h"
+#include "MatlabDebug.h"
+
+using namespace std;
+using namespace Eigen;
+
+BatchRunner::BatchRunner(int nthreads) :
+	m_nthreads(nthreads),
+	m_steals(0)
+{
+	if (m_nthreads <= 0) {
+		m_nthreads = max(1, (int)thread::hardware_concurrency());
+	}
+}
+
+int BatchRunner::addJob(const BatchJob &job) {
+	// Queues a job and returns its index in the results
+	m_jobs.push_back(job);
+	return (int)m_jobs.size() - 1;
+}
+
+void BatchRunner::clearJobs() {
+	m_jobs.clear();
+	m_results.clear();
+}
+
+bool BatchRunner::pop(int w, int &job) {
+	// Takes the most recently queued job from this worker's own queue
+	lock_guard<mutex> lock(m_workers[w]->mutex);
+	if (m_workers[w]->queue.empty()) {
+		return false;
+	}
+	job = m_workers[w]->queue.back();
+	m_workers[w]->queue.pop_back();
+	return true;
+}
+
+bool BatchRunner::steal(int w, int &job) {
+	// Takes the oldest job of another worker, starting with the next one over
+	for (int k = 1; k < m_nthreads; k++) {
+		auto &victim = m_workers[(w + k) % m_nthreads];
+		lock_guard<mutex> lock(victim->mutex);
+		if (!victim->queue.empty()) {
+			job = victim->queue.front();
+			victim->queue.pop_front();
+			m_steals++;
+			return true;
+		}
+	}
+	return false;
+}
+
+void BatchRunner::work(int w) {
+	// No jobs are added while running, so empty queues everywhere means done
+	int job;
+	while (pop(w, job) || steal(w, job)) {
+		runJob(w, job);
+	}
+}
+
+void BatchRunner::runJob(int w, int job) {
+	// Builds, integrates and stores one configuration. Everything the step
+	// touches is owned by this job's World and Solver.
+	auto start = chrono::steady_clock::now();
+	BatchResult &result = m_results[job];
+	result.thread = w;
+	try {
+		const BatchJob &config = m_jobs[job];
+		auto world = make_shared<World>(config.worldType);
+		world->load(config.resourceDir);
+		auto solver = make_shared<Solver>(world, config.integrator);
+		solver->load(config.resourceDir);
+		if (config.configure) {
+			config.configure(world, solver);
+		}
+		world->init();
+		solver->init();
+
+		shared_ptr<Solution> solution = solver->solve();
+		result.t = solution->t;
+		result.y = solution->y;
+		result.isDone = true;
+	}
+	catch (const exception &e) {
+		result.error = e.what();
+	}
+	result.wallTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void BatchRunner::run() {
+	// Runs every queued job and blocks until all are finished
+	int njobs = (int)m_jobs.size();
+	m_results.assign(njobs, BatchResult());
+	m_steals = 0;
+	if (njobs == 0) {
+		return;
+	}
+
+	// Round-robin initial distribution, so that similar neighbouring jobs spread out
+	m_workers.clear();
+	for (int w = 0; w < m_nthreads; w++) {
+		m_workers.push_back(unique_ptr<Worker>(new Worker()));
+	}
+	for (int job = 0; job < njobs; job++) {
+		m_workers[job % m_nthreads]->queue.push_back(job);
+	}
+
+	// Worlds are built without a GL context
+	bool isGPUEnabled = Shape::isGPUEnabled();
+	Shape::setGPUEnabled(false);
+	Eigen::initParallel();
+
+	vector<thread> threads;
+	for (int w = 0; w < m_nthreads; w++) {
+		threads.push_back(thread([this, w]() {
+			set_matlab_debug_file("test_" + to_string(w) + ".m");
+			work(w);
+		}));
+	}
+	for (int w = 0; w < m_nthreads; w++) {
+		threads[w].join();
+	}
+
+	Shape::setGPUEnabled(isGPUEnabled);
+	for (int job = 0; job < njobs; job++) {
+		if (!m_results[job].isDone) {
+			cout << "BatchRunner: job " << job << " failed: " << m_results[job].error << endl;
+		}
+	}
+}
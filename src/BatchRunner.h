@@ -0,0 +1,79 @@
+#pragma once
+// BatchRunner Runs many independent World + Solver pairs on a thread pool
+//    Each job loads its own world, applies its parameters, and integrates over
+//    the world's time span. Workers take jobs from their own queue and steal
+//    from the others when it runs dry. Results go to one slot per job, so the
+//    store needs no lock.
+
+#ifndef REDUCEDCOORD_SRC_BATCHRUNNER_H_
+#define REDUCEDCOORD_SRC_BATCHRUNNER_H_
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <functional>
+#define EIGEN_DONT_ALIGN_STATICALLY
+
+#include <Eigen/Dense>
+#include "MLCommon.h"
+#include "World.h"
+
+class Solver;
+
+struct BatchJob {
+	std::string resourceDir;
+	WorldType worldType;
+	Integrator integrator;
+	// Applied after load() and before init(), e.g. to set h or the stiffness
+	std::function<void(std::shared_ptr<World>, std::shared_ptr<Solver>)> configure;
+
+	BatchJob() : worldType(SERIAL_CHAIN), integrator(REDMAX_EULER) {}
+};
+
+struct BatchResult {
+	bool isDone;
+	Eigen::VectorXd t;
+	Eigen::MatrixXd y;		// One row per output time
+	double wallTime;		// Seconds spent in this job
+	int thread;				// Worker that ran the job
+	std::string error;		// Empty unless the job threw
+
+	BatchResult() : isDone(false), wallTime(0.0), thread(-1) {}
+};
+
+class BatchRunner
+{
+public:
+	BatchRunner(int nthreads = 0);	// 0 uses the hardware concurrency
+	virtual ~BatchRunner() {}
+
+	int addJob(const BatchJob &job);
+	void clearJobs();
+	void run();
+
+	int getNumThreads() const { return m_nthreads; }
+	int getSteals() const { return m_steals; }
+	const std::vector<BatchResult> &getResults() const { return m_results; }
+	const BatchResult &getResult(int job) const { return m_results[job]; }
+
+private:
+	struct Worker {
+		std::mutex mutex;
+		std::deque<int> queue;
+	};
+
+	bool pop(int w, int &job);
+	bool steal(int w, int &job);
+	void work(int w);
+	void runJob(int w, int job);
+
+	int m_nthreads;
+	std::vector<BatchJob> m_jobs;
+	std::vector<BatchResult> m_results;
+	std::vector<std::unique_ptr<Worker> > m_workers;
+	std::atomic<int> m_steals;
+};
+
+#endif // REDUCEDCOORD_SRC_BATCHRUNNER_H_
@@ -0,0 +1,111 @@
+#include "BlockJacobian.h"
+
+#include "JointTree.h"
+#include "Joint.h"
+#include "Body.h"
+#include "RigidTransform.h"
+
+using namespace std;
+using namespace Eigen;
+
+void BlockJacobian::init(const JointTree *tree) {
+	// A body's row is its parent's row plus its own joint's columns
+	m_tree = tree;
+	int n = tree->getNumJoints();
+	m_rowStarts.resize(n);
+	m_rowCols.resize(n);
+	int cols = 0;
+	for (int k = 0; k < n; k++) {
+		int p = tree->getParent(k);
+		m_rowStarts[k] = cols;
+		m_rowCols[k] = ((p >= 0) ? m_rowCols[p] : 0) + tree->getNdof(k);
+		cols += m_rowCols[k];
+	}
+	m_J.setZero(6, cols);
+	m_Jdot.setZero(6, cols);
+}
+
+void BlockJacobian::compute() {
+	// Computes every body's row from its parent's, parents before children.
+	// With v = Ad_ij * S * qdot the twist of body i relative to its parent,
+	// d/dt(Ad_ip) = -ad(v) * Ad_ip, so that
+	//    J_i    = [Ad_ip * J_p,  Ad_ij * S]
+	//    Jdot_i = [Ad_ip * Jdot_p - ad(v) * Ad_ip * J_p,  Ad_ij * Sdot]
+	if (m_tree->isParallel()) {
+		m_tree->forEach([this](int k) { compute_(k); }, false, true);
+	}
+	else {
+		int n = m_tree->getNumJoints();
+		for (int k = 0; k < n; k++) {
+			compute_(k);
+		}
+	}
+}
+
+void BlockJacobian::compute_(int k) {
+	// Computes body k's row. Reads only the parent's row.
+	Body *body = m_tree->getBody(k);
+	if (body == nullptr) {
+		return;
+	}
+	Joint *joint = m_tree->getJoint(k);
+	int start = m_rowStarts[k];
+	int p = m_tree->getParent(k);
+	int cp = (p >= 0) ? m_rowCols[p] : 0;
+
+	Vector6d v;
+	joint->computeJacobianBlock(m_J, m_Jdot, start + cp, v);
+	if (cp > 0) {
+		Adjoint Ad_ip = RigidTransform(body->E_ip).adjoint();
+		auto Ji = m_J.middleCols(start, cp);
+		auto Jdoti = m_Jdot.middleCols(start, cp);
+		Ad_ip.apply(m_J.middleCols(m_rowStarts[p], cp), Ji);
+		Ad_ip.apply(m_Jdot.middleCols(m_rowStarts[p], cp), Jdoti);
+		for (int j = 0; j < cp; j++) {
+			Jdoti.col(j) -= Adjoint::ad(v, Ji.col(j));
+		}
+	}
+}
+
+void BlockJacobian::scatter(MatrixXd &J, MatrixXd &Jdot) const {
+	// Copies each block to the rows of its body and the columns of its joint
+	int n = m_tree->getNumJoints();
+	for (int k = 0; k < n; k++) {
+		int row = m_tree->getIdxM(k);
+		if (row < 0) {
+			continue;
+		}
+		const int *path = m_tree->getPath(k);
+		int col = m_rowStarts[k];
+		for (int a = 0; a < m_tree->getPathLength(k); a++) {
+			int ndof = m_tree->getNdof(path[a]);
+			int idxR = m_tree->getIdxR(path[a]);
+			J.block(row, idxR, 6, ndof) = m_J.middleCols(col, ndof);
+			Jdot.block(row, idxR, 6, ndof) = m_Jdot.middleCols(col, ndof);
+			col += ndof;
+		}
+	}
+}
+
+void BlockJacobian::scatter(vector<Tripletd> &J, vector<Tripletd> &Jdot) const {
+	// Same as the dense version, as triplets
+	int n = m_tree->getNumJoints();
+	for (int k = 0; k < n; k++) {
+		int row = m_tree->getIdxM(k);
+		if (row < 0) {
+			continue;
+		}
+		const int *path = m_tree->getPath(k);
+		int col = m_rowStarts[k];
+		for (int a = 0; a < m_tree->getPathLength(k); a++) {
+			int ndof = m_tree->getNdof(path[a]);
+			int idxR = m_tree->getIdxR(path[a]);
+			for (int j = 0; j < ndof; j++, col++) {
+				for (int i = 0; i < 6; i++) {
+					J.push_back(Tripletd(row + i, idxR + j, m_J(i, col)));
+					Jdot.push_back(Tripletd(row + i, idxR + j, m_Jdot(i, col)));
+				}
+			}
+		}
+	}
+}
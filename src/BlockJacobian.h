@@ -0,0 +1,52 @@
+#pragma once
+// BlockJacobian Block-sparse rigid part of the redmax Jacobian
+//    Body i's rows of J are nonzero only in the columns of the joints on its
+//    root path. Those 6 x ndof blocks are stored side by side, root first, so
+//    that a body's row is its parent's row times Ad_ip followed by its own
+//    block Ad_ij * S. Memory and time grow with the total root path length of
+//    the tree rather than with nm x nr.
+
+#ifndef REDUCEDCOORD_SRC_BLOCKJACOBIAN_H_
+#define REDUCEDCOORD_SRC_BLOCKJACOBIAN_H_
+#include <vector>
+#define EIGEN_DONT_ALIGN_STATICALLY
+
+#include <Eigen/Dense>
+#include "MLCommon.h"
+
+class JointTree;
+
+class BlockJacobian
+{
+public:
+	BlockJacobian() : m_tree(nullptr) {}
+	virtual ~BlockJacobian() {}
+
+	// Lays out the blocks of every root path. Called by JointTree::build.
+	void init(const JointTree *tree);
+
+	// Fills the blocks of J and Jdot from the current joint and body state
+	void compute();
+
+	// Writes the blocks into maximal x reduced matrices. Entries outside the
+	// root paths are left untouched.
+	void scatter(Eigen::MatrixXd &J, Eigen::MatrixXd &Jdot) const;
+	void scatter(std::vector<Tripletd> &J, std::vector<Tripletd> &Jdot) const;
+
+	// Rows of body k, one block per joint of getPath(k)
+	int getRowStart(int k) const { return m_rowStarts[k]; }
+	int getRowCols(int k) const { return m_rowCols[k]; }
+	const Eigen::Matrix<double, 6, Eigen::Dynamic> &getJ() const { return m_J; }
+	const Eigen::Matrix<double, 6, Eigen::Dynamic> &getJdot() const { return m_Jdot; }
+
+private:
+	void compute_(int k);
+
+	const JointTree *m_tree;
+	std::vector<int> m_rowStarts;		// First column of body k's row in m_J
+	std::vector<int> m_rowCols;			// Sum of the DOFs along body k's root path
+	Eigen::Matrix<double, 6, Eigen::Dynamic> m_J;
+	Eigen::Matrix<double, 6, Eigen::Dynamic> m_Jdot;
+};
+
+#endif // REDUCEDCOORD_SRC_BLOCKJACOBIAN_H_
@@ -7,6 +7,7 @@
 #include "Wrench.h"
 #include "Joint.h"
 #include "SE3.h"
+#include "RigidTransform.h"
 #include "Shape.h"
 #include "MatrixStack.h"
 #include "Program.h"
@@ -39,8 +40,22 @@ m_density(density)
 	phidot.setZero();
 	wext_i.setZero();
 
-	m_attached_color << (float)(rand() % 255)/255.0f,(float)(rand() % 255)/255.0f,(float)(rand() % 255)/255.0f;
-	m_sliding_color << (float)(rand() % 255) / 255.0f, (float)(rand() % 255) / 255.0f, (float)(rand() % 255) / 255.0f;
+	setColors(0);
+}
+
+void Body::setColors(int index) {
+	// Picks the attachment colors from the body index. Deterministic and free of
+	// global state, unlike rand(), so worlds can be built on several threads.
+	auto hue = [](unsigned int k) {
+		k = (k ^ 61u) ^ (k >> 16);
+		k *= 9u;
+		k ^= k >> 4;
+		k *= 0x27d4eb2du;
+		k ^= k >> 15;
+		return Vector3f((float)(k & 0xff), (float)((k >> 8) & 0xff), (float)((k >> 16) & 0xff)) / 255.0f;
+	};
+	m_attached_color = hue(2u * (unsigned int)index);
+	m_sliding_color = hue(2u * (unsigned int)index + 1u);
 }
 
 void Body::load(const string &RESOURCE_DIR, string box_shape) {
@@ -72,20 +87,31 @@ void Body::setTransform(Eigen::Matrix4d E) {
 
 void Body::update() {
 	// Updates this body's transforms and velocities
-	E_wi = m_joint->E_wj * E_ji;
-	E_iw = SE3::inverse(E_wi);
-	Ad_wi = SE3::adjoint(E_wi);
-	Ad_iw = SE3::adjoint(E_iw);
-	E_ip = Matrix4d::Identity();
+	updatePosition();
+	updateVelocity();
+}
+
+void Body::updatePosition() {
+	// Updates this body's transforms and adjoints from its joint's
+	RigidTransform T_wi = RigidTransform(m_joint->E_wj) * RigidTransform(E_ji);
+	E_wi = T_wi.toMatrix();
+	RigidTransform T_iw = T_wi.inverse();
+	E_iw = T_iw.toMatrix();
+	Ad_wi = T_wi.adjoint().toMatrix();
+	Ad_iw = T_iw.adjoint().toMatrix();
+	RigidTransform T_ip;
 	
 	if (m_joint->getParent() != nullptr) {
 		m_parent = m_joint->getParent()->getBody();
-		E_ip = E_iw * m_parent->E_wi;
+		T_ip = T_wi.inverseTimes(RigidTransform(m_parent->E_wi));
 	}
 
-	Ad_ip = SE3::adjoint(E_ip);
+	E_ip = T_ip.toMatrix();
+	Ad_ip = T_ip.adjoint().toMatrix();
+}
 
-	// Body velocity
+void Body::updateVelocity() {
+	// Updates this body's velocity from its joint's. Needs the current transforms.
 	phi = Ad_ij * m_joint->V;
 	Addot_wi = SE3::dAddt(E_wi, phi);
 	phidot = Ad_ij * m_joint->Vdot;
@@ -97,6 +123,14 @@ void Body::computeEnergies(Eigen::Vector3d grav, Energy &energies) {
 	energies.V = energies.V - I_i(5) * grav.transpose() * E_wi.block<3, 1>(0, 3);
 }
 
+void Body::computeEnergies(const Vector3d &grav, EnergySample &sample) const {
+	// Adds the kinetic and potential energies and the momentum about the world origin
+	Vector6d Iphi = I_i.cwiseProduct(phi);
+	sample.energy.K += 0.5 * phi.dot(Iphi);
+	sample.energy.V -= I_i(5) * grav.dot(E_wi.block<3, 1>(0, 3));
+	sample.momentum += RigidTransform(E_iw).adjoint().applyTranspose(Iphi);
+}
+
 void Body::computeInertia() {
 	// Computes inertia at body and joint
 	computeInertia_();
@@ -115,9 +149,9 @@ int Body::countM(int &nm, int data) {
 
 void Body::draw(shared_ptr<MatrixStack> MV, const shared_ptr<Program> prog, shared_ptr<MatrixStack> P) const
 {
-	draw_(MV, prog, P);
-	if (next != nullptr) {
-		next->draw(MV, prog, P);
+	// Draws this body and the following ones
+	for (const Body *body = this; body != nullptr; body = body->next.get()) {
+		body->draw_(MV, prog, P);
 	}
 }
 
@@ -146,8 +180,15 @@ void Body::draw_(shared_ptr<MatrixStack> MV, const shared_ptr<Program> prog, sha
 
 }
 
-void Body::computeMassGrav(Vector3d grav, MatrixXd &M, VectorXd &f) {
-	// Computes maximal mass matrix and force vector
+void Body::computeMassGrav(Vector3d grav, MatrixXd &M, VectorXd &f, EnergySample *sample) {
+	// Computes maximal mass matrix and force vector, and adds to sample if given
+	for (Body *body = this; body != nullptr; body = body->next.get()) {
+		body->computeMassGrav_(grav, M, f, sample);
+	}
+}
+
+void Body::computeMassGrav_(const Vector3d &grav, MatrixXd &M, VectorXd &f, EnergySample *sample) {
+	// Computes this body's mass block and force
 	Matrix6d M_i = Matrix6d(I_i.asDiagonal());
 	
 	M.block<6, 6>(idxM, idxM) = M_i;
@@ -168,6 +209,9 @@ void Body::computeMassGrav(Vector3d grav, MatrixXd &M, VectorXd &f) {
 	this->wext_i.setZero();
 	this->Kmdiag.setZero();
 	this->Dmdiag.setZero();
+	if (sample != nullptr) {
+		computeEnergies(grav, *sample);
+	}
 	
 	// Joint torque
 	// This is how we would apply a joint torque using maximal coordinates. 
@@ -185,25 +229,63 @@ void Body::computeMassGrav(Vector3d grav, MatrixXd &M, VectorXd &f) {
 	//		f.segment<6>(idxM_P) -= SE3::adjoint(E_jp).transpose() * tau;
 	//	}
 	//}
+}
+
+Vector6d Body::computeForceGrav(Vector3d grav) const {
+	// Computes the Coriolis and gravity wrench in body space
+	Matrix6d M_i = Matrix6d(I_i.asDiagonal());
+	Vector6d fcor = SE3::ad(phi).transpose() * M_i * phi;
+	Matrix3d R_iw = E_wi.block<3, 3>(0, 0).transpose();
 
-	if (next != nullptr) {
-		next->computeMassGrav(grav, M, f);
+	Vector6d fgrav;
+	fgrav.setZero();
+	fgrav.segment<3>(3) = M_i(3, 3) * R_iw * grav;
+	return fcor + fgrav;
+}
+
+void Body::computeMassGrav(Vector3d grav, vector<Tripletd> &M, VectorXd &f, EnergySample *sample) {
+	// Computes maximal mass matrix as triplets and force vector, and adds to sample if given
+	for (Body *body = this; body != nullptr; body = body->next.get()) {
+		body->computeMassGrav_(grav, M, f, sample);
 	}
 }
 
-void Body::computeForceDamping(Eigen::VectorXd &f, Eigen::MatrixXd &D) {
-	// Computes maximal damping force vector and matrix
-	if (m_damping > 0.0) {
-		Vector6d fi = -m_damping * phi;
-		Matrix6d Di = m_damping * Matrix6d::Identity();
-		f.segment<6>(this->idxM) += fi;
-		D.block<6, 6>(this->idxM, this->idxM) += Di;
-		// Used by recursive algorithm
-		this->wext_i += fi;
-		this->Dmdiag += Di;
+void Body::computeMassGrav_(const Vector3d &grav, vector<Tripletd> &M, VectorXd &f, EnergySample *sample) {
+	// Computes this body's mass block as triplets and force
+	Matrix6d M_i = Matrix6d(I_i.asDiagonal());
+
+	for (int i = 0; i < 6; i++) {
+		M.push_back(Tripletd(idxM + i, idxM + i, I_i(i)));
+	}
+
+	Vector6d fcor = SE3::ad(phi).transpose() * M_i * phi;
+	Matrix3d R_wi = E_wi.block<3, 3>(0, 0);
+	Matrix3d R_iw = R_wi.transpose();
+
+	Vector6d fgrav;
+	fgrav.setZero();
+	fgrav.segment<3>(3) = M_i(3, 3) * R_iw * grav; // wrench in body space
+	f.segment<6>(idxM) = fcor + fgrav;
+
+	this->wext_i.setZero();
+	this->Kmdiag.setZero();
+	this->Dmdiag.setZero();
+	if (sample != nullptr) {
+		computeEnergies(grav, *sample);
 	}
+}
 
-	if (next != nullptr) {
-		next->computeForceDamping(f, D);
+void Body::computeForceDamping(Eigen::VectorXd &f, Eigen::MatrixXd &D) {
+	// Computes maximal damping force vector and matrix
+	for (Body *body = this; body != nullptr; body = body->next.get()) {
+		if (body->m_damping > 0.0) {
+			Vector6d fi = -body->m_damping * body->phi;
+			Matrix6d Di = body->m_damping * Matrix6d::Identity();
+			f.segment<6>(body->idxM) += fi;
+			D.block<6, 6>(body->idxM, body->idxM) += Di;
+			// Used by recursive algorithm
+			body->wext_i += fi;
+			body->Dmdiag += Di;
+		}
 	}
 }
\ No newline at end of file
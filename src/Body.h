@@ -28,6 +28,7 @@ public:
 	void setTransform(Matrix4d E);	
 	void setJoint(std::shared_ptr<Joint> joint) { m_joint = joint; };
 	void setAttachedColor(Vector3f color) { m_attached_color = color; }
+	void setColors(int index);
 
 	std::string getName() const { return m_name; };
 	std::shared_ptr<Joint> getJoint() const { return m_joint; };
@@ -35,13 +36,18 @@ public:
 	void computeInertia();
 	void countDofs(int &nm);
 	int countM(int &nm, int data);
-	void computeMassGrav(Vector3d grav, Eigen::MatrixXd &M, Eigen::VectorXd &f);
+	void computeMassGrav(Vector3d grav, Eigen::MatrixXd &M, Eigen::VectorXd &f, EnergySample *sample = nullptr);
+	void computeMassGrav(Vector3d grav, std::vector<Tripletd> &M, Eigen::VectorXd &f, EnergySample *sample = nullptr);
+	Vector6d computeForceGrav(Vector3d grav) const;
 	void computeForceDamping(Eigen::VectorXd &f, Eigen::MatrixXd &D);
 	void computeEnergies(Vector3d grav, Energy &energies);
+	void computeEnergies(const Vector3d &grav, EnergySample &sample) const;
 
 	void load(const std::string &RESOURCE_DIR, std::string box_shape);
 	void init(int &nm);
 	void update();
+	void updatePosition();
+	void updateVelocity();
 	void draw(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, std::shared_ptr<MatrixStack> P)const;
 
 	double m_density;					// Mass/volume
@@ -76,6 +82,10 @@ protected:
 	virtual void draw_(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, std::shared_ptr<MatrixStack> P)const {}
 	virtual void computeInertia_() {}
 	std::string m_name;
+
+private:
+	void computeMassGrav_(const Vector3d &grav, Eigen::MatrixXd &M, Eigen::VectorXd &f, EnergySample *sample);
+	void computeMassGrav_(const Vector3d &grav, std::vector<Tripletd> &M, Eigen::VectorXd &f, EnergySample *sample);
 	
 };
 
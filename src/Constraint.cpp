@@ -80,17 +80,49 @@ void Constraint::computeJacIneqR(MatrixXd &Cr, MatrixXd &Crdot, VectorXd &cr, Ve
 
 }
 
-void Constraint::scatterForceEqM(Eigen::MatrixXd Gmt, Eigen::VectorXd lm) {
+void Constraint::computeJacEqM(vector<Tripletd> &Gm, vector<Tripletd> &Gmdot, VectorXd &gm, VectorXd &gmdot, VectorXd &gmddot) {
+	computeJacEqM_(Gm, Gmdot, gm, gmdot, gmddot);
+	if (next != nullptr) {
+		next->computeJacEqM(Gm, Gmdot, gm, gmdot, gmddot);
+	}
+}
+
+void Constraint::computeJacIneqM(vector<Tripletd> &Cm, vector<Tripletd> &Cmdot, VectorXd &cm, VectorXd &cmdot, VectorXd &cmddot) {
+	computeJacIneqM_(Cm, Cmdot, cm, cmdot, cmddot);
+	if (next != nullptr) {
+		next->computeJacIneqM(Cm, Cmdot, cm, cmdot, cmddot);
+	}
+}
+
+void Constraint::scatterForceEqM(const Eigen::MatrixXd &Gmt, const Eigen::VectorXd &lm) {
+	// Computes fcon block by block, without a temporary copy of Gmt
+	fcon.resize(idxQ.cols() * idxQ.rows());
+	if (nconEM > 0) {
+		for (int i = 0; i < idxQ.cols(); i++) {
+			fcon.segment<6>(6 * i).noalias() = -Gmt.block(idxQ(0, i), idxEM, 6, nconEM) * lm.segment(idxEM, nconEM);
+		}
+		//fcon = -Gmt.block(idxQ, idxEM, nQ, nconEM) * lm.segment(idxEM, nconEM);
+	}
+	else {
+		fcon.setZero();
+	}
+	scatterForceEqM_();
+	if (next != nullptr) {
+		next->scatterForceEqM(Gmt, lm);
+	}
+}
+
+void Constraint::scatterForceEqM(const SparseMatrixd &Gmt, const Eigen::VectorXd &lm) {
+	// Same as the dense version, but only the touched blocks of Gmt are densified
 	if (nconEM > 0) {
 		int rows = idxQ.cols() * idxQ.rows();
 		MatrixXd temp(rows, nconEM);
 		temp.setZero();
 		for (int i = 0; i < idxQ.cols(); i++) {
-			temp.block(6 * i, 0, 6, nconEM) = Gmt.block(idxQ(0, i), idxEM, 6, nconEM);
+			temp.block(6 * i, 0, 6, nconEM) = MatrixXd(Gmt.block(idxQ(0, i), idxEM, 6, nconEM));
 		}
 		fcon.resize(idxQ.cols() * idxQ.rows());
 		fcon = -temp * lm.segment(idxEM, nconEM);
-		//fcon = -Gmt.block(idxQ, idxEM, nQ, nconEM) * lm.segment(idxEM, nconEM);
 	}
 	else {
 		fcon.resize(idxQ.cols() * idxQ.rows());
@@ -102,19 +134,16 @@ void Constraint::scatterForceEqM(Eigen::MatrixXd Gmt, Eigen::VectorXd lm) {
 	}
 }
 
-void Constraint::scatterForceEqR(Eigen::MatrixXd Grt, Eigen::VectorXd lr) {
+void Constraint::scatterForceEqR(const Eigen::MatrixXd &Grt, const Eigen::VectorXd &lr) {
+	// Computes fcon block by block, without a temporary copy of Grt
+	fcon.resize(idxQ.cols() * idxQ.rows());
 	if (nconER > 0) {
-		int rows = idxQ.cols() * idxQ.rows();
-		MatrixXd temp(rows, nconER);
-		temp.setZero();
 		for (int i = 0; i < idxQ.cols(); i++) {
-			temp.block(6 * i, 0, 6, nconER) = Grt.block(idxQ(0, i), idxER, 6, nconER);
+			fcon.segment<6>(6 * i).noalias() = -Grt.block(idxQ(0, i), idxER, 6, nconER) * lr.segment(idxER, nconER);
 		}
-		fcon = -temp * lr.segment(idxER, nconER);
 		//fcon = -Grt.block(idxQ, idxER, nQ, nconER) * lr.segment(idxER, nconER);
 	}
 	else {
-		fcon.resize(idxQ.cols() * idxQ.rows());
 		fcon.setZero();
 	}
 	scatterForceEqR_();
@@ -123,9 +152,10 @@ void Constraint::scatterForceEqR(Eigen::MatrixXd Grt, Eigen::VectorXd lr) {
 	}
 }
 
-void Constraint::scatterForceIneqR(Eigen::MatrixXd Crt, Eigen::VectorXd lr) {
+void Constraint::scatterForceIneqR(const Eigen::MatrixXd &Crt, const Eigen::VectorXd &lr) {
 	if (nconIR > 0) {
-		fcon = -Crt.block(idxQ(0), idxIR, idxQ.rows(), nconIR) * lr.segment(idxIR, nconIR);
+		fcon.resize(idxQ.rows());
+		fcon.noalias() = -Crt.block(idxQ(0), idxIR, idxQ.rows(), nconIR) * lr.segment(idxIR, nconIR);
 	}
 	else {
 		fcon.resize(idxQ.rows());
@@ -137,9 +167,10 @@ void Constraint::scatterForceIneqR(Eigen::MatrixXd Crt, Eigen::VectorXd lr) {
 	}
 }
 
-void Constraint::scatterForceIneqM(Eigen::MatrixXd Cmt, Eigen::VectorXd lm) {
+void Constraint::scatterForceIneqM(const Eigen::MatrixXd &Cmt, const Eigen::VectorXd &lm) {
 	if (nconIM > 0) {
-		fcon = -Cmt.block(idxQ(0), idxIM, idxQ.rows(), nconIM) * lm.segment(idxEM, nconIM);
+		fcon.resize(idxQ.rows());
+		fcon.noalias() = -Cmt.block(idxQ(0), idxIM, idxQ.rows(), nconIM) * lm.segment(idxEM, nconIM);
 	}
 	else {
 		fcon.resize(idxQ.rows());
@@ -29,14 +29,17 @@ public:
 	void computeJacEqR(Eigen::MatrixXd &Gr, Eigen::MatrixXd &Grdot, Eigen::VectorXd &gr, Eigen::VectorXd &grdot, Eigen::VectorXd &grddot);
 	void computeJacIneqM(Eigen::MatrixXd &Cm, Eigen::MatrixXd &Cmdot, Eigen::VectorXd &cm, Eigen::VectorXd &cmdot, Eigen::VectorXd &cmddot);
 	void computeJacIneqR(Eigen::MatrixXd &Cr, Eigen::MatrixXd &Crdot, Eigen::VectorXd &cr, Eigen::VectorXd &crdot, Eigen::VectorXd &crddot);
+	void computeJacEqM(std::vector<Tripletd> &Gm, std::vector<Tripletd> &Gmdot, Eigen::VectorXd &gm, Eigen::VectorXd &gmdot, Eigen::VectorXd &gmddot);
+	void computeJacIneqM(std::vector<Tripletd> &Cm, std::vector<Tripletd> &Cmdot, Eigen::VectorXd &cm, Eigen::VectorXd &cmdot, Eigen::VectorXd &cmddot);
 
 	void countDofs(int &nem, int &ner, int &nim, int &nir);
 	void getActiveList(std::vector<int> &listM, std::vector<int> &listR);
 
-	void scatterForceEqM(Eigen::MatrixXd Gmt, Eigen::VectorXd lm);
-	void scatterForceEqR(Eigen::MatrixXd Grt, Eigen::VectorXd lr);
-	void scatterForceIneqR(Eigen::MatrixXd Crt, Eigen::VectorXd lr);
-	void scatterForceIneqM(Eigen::MatrixXd Cmt, Eigen::VectorXd lm);
+	void scatterForceEqM(const Eigen::MatrixXd &Gmt, const Eigen::VectorXd &lm);
+	void scatterForceEqM(const SparseMatrixd &Gmt, const Eigen::VectorXd &lm);
+	void scatterForceEqR(const Eigen::MatrixXd &Grt, const Eigen::VectorXd &lr);
+	void scatterForceIneqR(const Eigen::MatrixXd &Crt, const Eigen::VectorXd &lr);
+	void scatterForceIneqM(const Eigen::MatrixXd &Cmt, const Eigen::VectorXd &lm);
 	void ineqEventFcn(std::vector<double> &value, std::vector<int> &isterminal, std::vector<int> &direction);
 	void ineqProjPos();
 
@@ -66,6 +69,8 @@ protected:
 	virtual void computeJacEqR_(Eigen::MatrixXd &Gr, Eigen::MatrixXd &Grdot, Eigen::VectorXd &gr, Eigen::VectorXd &grdot, Eigen::VectorXd &grddot) {}
 	virtual	void computeJacIneqM_(Eigen::MatrixXd &Cm, Eigen::MatrixXd &Cmdot, Eigen::VectorXd &cm, Eigen::VectorXd &cmdot, Eigen::VectorXd &cmddot) {}
 	virtual void computeJacIneqR_(Eigen::MatrixXd &Cr, Eigen::MatrixXd &Crdot, Eigen::VectorXd &cr, Eigen::VectorXd &crdot, Eigen::VectorXd &crddot) {}
+	virtual void computeJacEqM_(std::vector<Tripletd> &Gm, std::vector<Tripletd> &Gmdot, Eigen::VectorXd &gm, Eigen::VectorXd &gmdot, Eigen::VectorXd &gmddot) {}
+	virtual	void computeJacIneqM_(std::vector<Tripletd> &Cm, std::vector<Tripletd> &Cmdot, Eigen::VectorXd &cm, Eigen::VectorXd &cmdot, Eigen::VectorXd &cmddot) {}
 
 	virtual void ineqEventFcn_(std::vector<double> &value, std::vector<int> &isterminal, std::vector<int> &direction) {}
 	virtual void ineqProjPos_() {}
@@ -159,3 +159,49 @@ void ConstraintAttachSoftBody::computeJacEqM_(MatrixXd &Gm, MatrixXd &Gmdot, Vec
 	}
 
 }
+
+void ConstraintAttachSoftBody::computeJacEqM_(vector<Tripletd> &Gm, vector<Tripletd> &Gmdot, VectorXd &gm, VectorXd &gmdot, VectorXd &gmddot) {
+	// Same rows as the dense version, written as triplets
+	int rowi = idxEM;
+	Matrix4d E;
+	Matrix3d R, W;
+	Matrix3x6d G;
+
+	if (!m_softbody->m_isInvert) {
+		for (int i = 0; i < n_attachments; i++) {
+			int colSi = m_softbody->m_attach_nodes[i]->idxM;
+			auto body = m_softbody->m_attach_bodies[i];
+			E = Matrix4d::Identity();
+			if (body != nullptr) {
+				E = body->E_wi;
+				R = E.block<3, 3>(0, 0);
+				G = SE3::gamma(m_softbody->m_r[i]);
+				W = SE3::bracket3(body->phi.segment<3>(0));
+				insertBlock(Gm, rowi, body->idxM, R * G);
+				insertBlock(Gmdot, rowi, body->idxM, R * W * G);
+			}
+			insertBlock(Gm, rowi, colSi, -Matrix3d::Identity());
+			gm.segment<3>(rowi) = E.block<3, 3>(0, 0) * m_softbody->m_r[i] + E.block<3, 1>(0, 3) - m_softbody->m_attach_nodes[i]->x;
+			rowi += 3;
+		}
+
+		for (int i = 0; i < n_sliding_nodes; i++) {
+			int colSi = m_softbody->m_sliding_nodes[i]->idxM;
+			auto body = m_softbody->m_sliding_bodies[i];
+			Vector3d nor = m_softbody->m_normals_sliding[i]->dir;
+			E = Matrix4d::Identity();
+			if (body != nullptr) {
+				E = body->E_wi;
+				R = E.block<3, 3>(0, 0);
+				G = SE3::gamma(m_softbody->m_r_sliding[i]);
+				W = SE3::bracket3(body->phi.segment<3>(0));
+				insertBlock(Gm, rowi, body->idxM, nor.transpose() * R * G);
+				insertBlock(Gmdot, rowi, body->idxM, nor.transpose() * R * W * G);
+			}
+			insertBlock(Gm, rowi, colSi, -nor.transpose());
+			Vector3d dx = E.block<3, 3>(0, 0) * m_softbody->m_r_sliding[i] + E.block<3, 1>(0, 3) - m_softbody->m_sliding_nodes[i]->x;
+			gm(rowi) = nor.dot(dx);
+			rowi += 1;
+		}
+	}
+}
@@ -11,6 +11,7 @@ public:
 	ConstraintAttachSoftBody();
 	ConstraintAttachSoftBody(std::shared_ptr<SoftBody> softbody);
 	void computeJacEqM_(Eigen::MatrixXd &Gm, Eigen::MatrixXd &Gmdot, Eigen::VectorXd &gm, Eigen::VectorXd &gmdot, Eigen::VectorXd &gmddot);
+	void computeJacEqM_(std::vector<Tripletd> &Gm, std::vector<Tripletd> &Gmdot, Eigen::VectorXd &gm, Eigen::VectorXd &gmdot, Eigen::VectorXd &gmddot);
 
 
 	std::shared_ptr<SoftBody> m_softbody;
@@ -93,3 +93,41 @@ void ConstraintAttachSpring::computeJacEqM_(MatrixXd &Gm, MatrixXd &Gmdot, Vecto
 	gm.segment<3>(row0) = gm0.segment<3>(0);
 	gm.segment<3>(row1) = gm1.segment<3>(0);
 }
+
+void ConstraintAttachSpring::computeJacEqM_(vector<Tripletd> &Gm, vector<Tripletd> &Gmdot, VectorXd &gm, VectorXd &gmdot, VectorXd &gmddot) {
+	int row0 = idxEM;
+	int row1 = idxEM + 3;
+	int col0S = m_spring->m_nodes[0]->idxM;
+	int col1S = m_spring->m_nodes[m_spring->m_nodes.size() - 1]->idxM;
+	auto body0 = m_spring->m_body0;
+	auto body1 = m_spring->m_body1;
+
+	Matrix4d E0 = Matrix4d::Identity();
+	Matrix4d E1 = Matrix4d::Identity();
+
+	if (body0 != nullptr) {
+		E0 = body0->E_wi;
+		Matrix3d R0 = E0.block<3, 3>(0, 0);
+		Matrix3x6d G0 = SE3::gamma(m_spring->m_r0);
+		Matrix3d W0 = SE3::bracket3(body0->phi.segment<3>(0));
+		insertBlock(Gm, row0, body0->idxM, R0 * G0);
+		insertBlock(Gmdot, row0, body0->idxM, R0 * W0 * G0);
+	}
+
+	if (body1 != nullptr) {
+		E1 = body1->E_wi;
+		Matrix3d R1 = E1.block<3, 3>(0, 0);
+		Matrix3x6d G1 = SE3::gamma(m_spring->m_r1);
+		Matrix3d W1 = SE3::bracket3(body1->phi.segment<3>(0));
+		insertBlock(Gm, row1, body1->idxM, R1 * G1);
+		insertBlock(Gmdot, row1, body1->idxM, R1 * W1 * G1);
+	}
+
+	insertBlock(Gm, row0, col0S, -Matrix3d::Identity());
+	insertBlock(Gm, row1, col1S, -Matrix3d::Identity());
+
+	Vector3d x0 = m_spring->m_nodes[0]->x;
+	Vector3d x1 = m_spring->m_nodes[m_spring->m_nodes.size() - 1]->x;
+	gm.segment<3>(row0) = E0.block<3, 3>(0, 0) * m_spring->m_r0 + E0.block<3, 1>(0, 3) - x0;
+	gm.segment<3>(row1) = E1.block<3, 3>(0, 0) * m_spring->m_r1 + E1.block<3, 1>(0, 3) - x1;
+}
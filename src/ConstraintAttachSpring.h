@@ -15,5 +15,6 @@ public:
 
 protected:
 	void computeJacEqM_(Eigen::MatrixXd &Gm, Eigen::MatrixXd &Gmdot, Eigen::VectorXd &gm, Eigen::VectorXd &gmdot, Eigen::VectorXd &gmddot);
+	void computeJacEqM_(std::vector<Tripletd> &Gm, std::vector<Tripletd> &Gmdot, Eigen::VectorXd &gm, Eigen::VectorXd &gmdot, Eigen::VectorXd &gmddot);
 
 };
\ No newline at end of file
@@ -63,5 +63,6 @@ void ConstraintJointLimit::ineqProjPos_() {
 	else if (m_joint->m_q(0) >= m_qu) {
 		m_joint->m_q(0) = m_qu;
 	}
+	m_joint->setQDirty();
 
 }
\ No newline at end of file
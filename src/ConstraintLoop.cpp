@@ -20,8 +20,9 @@ ConstraintLoop::ConstraintLoop(shared_ptr<Body> bodyA, shared_ptr<Body> bodyB) :
 
 }
 
-void ConstraintLoop::computeJacEqM_(MatrixXd &Gm, MatrixXd &Gmdot, VectorXd &gm, VectorXd &gmdot, VectorXd &gmddot) {
-	int row = idxEM;
+void ConstraintLoop::computeJacBlocks(Matrix2x6d &GA, Matrix2x6d &GB, Matrix2x6d &GAdot, Matrix2x6d &GBdot, Vector2d &g) {
+	// Computes the nonzero blocks of the Jacobian wrt bodies A and B. All of
+	// them are fixed-size, so that a step does not allocate.
 	Matrix4d E_wa = m_bodyA->E_wi;
 	Matrix4d E_wb = m_bodyB->E_wi;
 	Matrix3d R_wa = E_wa.block<3, 3>(0, 0);
@@ -44,7 +45,7 @@ void ConstraintLoop::computeJacEqM_(MatrixXd &Gm, MatrixXd &Gmdot, VectorXd &gm,
 
 	v1 = v2.cross(v0);
 	v1.normalized();
-	MatrixXd v12(3, 2);
+	Matrix3x2d v12;
 	v12 << v1, v2;
 	
 	Matrix3x6d GammaA = SE3::gamma(m_xA);
@@ -60,16 +61,42 @@ void ConstraintLoop::computeJacEqM_(MatrixXd &Gm, MatrixXd &Gmdot, VectorXd &gm,
 	idxQ.col(0) << colA, colA + 1, colA + 2, colA + 3, colA + 4, colA + 5;
 	idxQ.col(1) << colB, colB + 1, colB + 2, colB + 3, colB + 4, colB + 5;
 
-	Gm.block(row, colA, nconEM, 6) = v12.transpose() * R_wa * GammaA;
-	Gm.block(row, colB, nconEM, 6) = -v12.transpose() * R_wb * GammaB;
+	GA = v12.transpose() * R_wa * GammaA;
+	GB = -v12.transpose() * R_wb * GammaB;
 
-	Gmdot.block(row, colA, nconEM, 6) = v12.transpose() * R_wa * waBrac * GammaA;
-	Gmdot.block(row, colB, nconEM, 6) = -v12.transpose() * R_wb * wbBrac * GammaB;
+	GAdot = v12.transpose() * R_wa * waBrac * GammaA;
+	GBdot = -v12.transpose() * R_wb * wbBrac * GammaB;
 
 	Vector4d temp0, temp1;
 	temp0 << m_xA, 1.0;
 	temp1 << m_xB, 1.0;
 
 	Vector4d dx = E_wa * temp0 - E_wb * temp1;
-	gm.segment<2>(row) = v12.transpose() * dx.segment<3>(0);
-}
\ No newline at end of file
+	g = v12.transpose() * dx.segment<3>(0);
+}
+
+void ConstraintLoop::computeJacEqM_(MatrixXd &Gm, MatrixXd &Gmdot, VectorXd &gm, VectorXd &gmdot, VectorXd &gmddot) {
+	int row = idxEM;
+	Matrix2x6d GA, GB, GAdot, GBdot;
+	Vector2d g;
+	computeJacBlocks(GA, GB, GAdot, GBdot, g);
+
+	Gm.block(row, m_bodyA->idxM, nconEM, 6) = GA;
+	Gm.block(row, m_bodyB->idxM, nconEM, 6) = GB;
+	Gmdot.block(row, m_bodyA->idxM, nconEM, 6) = GAdot;
+	Gmdot.block(row, m_bodyB->idxM, nconEM, 6) = GBdot;
+	gm.segment<2>(row) = g;
+}
+
+void ConstraintLoop::computeJacEqM_(vector<Tripletd> &Gm, vector<Tripletd> &Gmdot, VectorXd &gm, VectorXd &gmdot, VectorXd &gmddot) {
+	int row = idxEM;
+	Matrix2x6d GA, GB, GAdot, GBdot;
+	Vector2d g;
+	computeJacBlocks(GA, GB, GAdot, GBdot, g);
+
+	insertBlock(Gm, row, m_bodyA->idxM, GA);
+	insertBlock(Gm, row, m_bodyB->idxM, GB);
+	insertBlock(Gmdot, row, m_bodyA->idxM, GAdot);
+	insertBlock(Gmdot, row, m_bodyB->idxM, GBdot);
+	gm.segment<2>(row) = g;
+}
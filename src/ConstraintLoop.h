@@ -20,6 +20,8 @@ public:
 
 protected:
 	void computeJacEqM_(Eigen::MatrixXd &Gm, Eigen::MatrixXd &Gmdot, Eigen::VectorXd &gm, Eigen::VectorXd &gmdot, Eigen::VectorXd &gmddot);
+	void computeJacEqM_(std::vector<Tripletd> &Gm, std::vector<Tripletd> &Gmdot, Eigen::VectorXd &gm, Eigen::VectorXd &gmdot, Eigen::VectorXd &gmddot);
+	void computeJacBlocks(Matrix2x6d &GA, Matrix2x6d &GB, Matrix2x6d &GAdot, Matrix2x6d &GBdot, Eigen::Vector2d &g);
 
 
 };
\ No newline at end of file
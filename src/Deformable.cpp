@@ -74,10 +74,38 @@ void Deformable::computeJacobian(MatrixXd &J, MatrixXd &Jdot) {
 	}
 }
 
-void Deformable::computeMass(Vector3d grav, MatrixXd &M, VectorXd &f) {
-	computeMass_(grav, M, f);
+void Deformable::computeMass(Vector3d grav, MatrixXd &M, VectorXd &f, EnergySample *sample) {
+	computeMass_(grav, M, f, sample);
 	if (next != nullptr) {
-		next->computeMass(grav, M, f);
+		next->computeMass(grav, M, f, sample);
+	}
+}
+
+void Deformable::computeJacobian(vector<Tripletd> &J, vector<Tripletd> &Jdot) {
+	computeJacobian_(J, Jdot);
+	if (next != nullptr) {
+		next->computeJacobian(J, Jdot);
+	}
+}
+
+void Deformable::computeJacProd(const VectorXd &x, VectorXd &y) {
+	computeJacProd_(x, y);
+	if (next != nullptr) {
+		next->computeJacProd(x, y);
+	}
+}
+
+void Deformable::computeJacTransProd(const VectorXd &y, VectorXd &x) {
+	computeJacTransProd_(y, x);
+	if (next != nullptr) {
+		next->computeJacTransProd(y, x);
+	}
+}
+
+void Deformable::computeMass(Vector3d grav, vector<Tripletd> &M, VectorXd &f, EnergySample *sample) {
+	computeMass_(grav, M, f, sample);
+	if (next != nullptr) {
+		next->computeMass(grav, M, f, sample);
 	}
 }
 
@@ -30,7 +30,11 @@ public:
 	void scatterDDofs(Eigen::VectorXd &ydot, int nr);
 
 	void computeJacobian(Eigen::MatrixXd &J, Eigen::MatrixXd &Jdot);
-	void computeMass(Eigen::Vector3d grav, Eigen::MatrixXd &M, Eigen::VectorXd &f);
+	void computeMass(Eigen::Vector3d grav, Eigen::MatrixXd &M, Eigen::VectorXd &f, EnergySample *sample = nullptr);
+	void computeJacobian(std::vector<Tripletd> &J, std::vector<Tripletd> &Jdot);
+	void computeJacProd(const Eigen::VectorXd &x, Eigen::VectorXd &y);
+	void computeJacTransProd(const Eigen::VectorXd &y, Eigen::VectorXd &x);
+	void computeMass(Eigen::Vector3d grav, std::vector<Tripletd> &M, Eigen::VectorXd &f, EnergySample *sample = nullptr);
 	void computeForceDamping(Eigen::Vector3d grav, Eigen::VectorXd &f, Eigen::MatrixXd D);
 	void computeEnergies(Eigen::Vector3d grav, Energy &ener);
 
@@ -47,10 +51,14 @@ public:
 	virtual void scatterDofs_(Eigen::VectorXd &y, int nr) {}
 	virtual void scatterDDofs_(Eigen::VectorXd &ydot, int nr) {}
 
-	virtual void computeMass_(Eigen::Vector3d grav, Eigen::MatrixXd &M, Eigen::VectorXd &f) {}
+	virtual void computeMass_(Eigen::Vector3d grav, Eigen::MatrixXd &M, Eigen::VectorXd &f, EnergySample *sample) {}
 	virtual void computeForceDamping_(Eigen::Vector3d grav, Eigen::VectorXd &f, Eigen::MatrixXd D) {}
 	virtual void computeEnergies_(Eigen::Vector3d grav, Energy &ener) {}
 	virtual void computeJacobian_(Eigen::MatrixXd &J, Eigen::MatrixXd &Jdot) {}
+	virtual void computeMass_(Eigen::Vector3d grav, std::vector<Tripletd> &M, Eigen::VectorXd &f, EnergySample *sample) {}
+	virtual void computeJacobian_(std::vector<Tripletd> &J, std::vector<Tripletd> &Jdot) {}
+	virtual void computeJacProd_(const Eigen::VectorXd &x, Eigen::VectorXd &y) {}
+	virtual void computeJacTransProd_(const Eigen::VectorXd &y, Eigen::VectorXd &x) {}
 	
 	std::shared_ptr<Deformable> next;
 	std::string m_name;
@@ -182,17 +182,49 @@ void DeformableSpring::scatterDDofs_(VectorXd &ydot, int nr) {
 	}
 }
 
-void DeformableSpring::computeMass_(Vector3d grav, MatrixXd &M, VectorXd &f) {
+void DeformableSpring::computeMass_(Vector3d grav, MatrixXd &M, VectorXd &f, EnergySample *sample) {
 	// Computes maximal mass matrix
 	int n_nodes = (int)m_nodes.size();
 	double m = m_mass / n_nodes;
-	// Computes force vector
 	Matrix3d I3 = Matrix3d::Identity();
 
 	for (int i = 0; i < n_nodes; i++) {
 		int idxM = m_nodes[i]->idxM;
 		M.block<3, 3>(idxM, idxM) = m * I3;
+	}
+	computeSpringForce(grav, f, sample);
+}
+
+void DeformableSpring::computeMass_(Vector3d grav, vector<Tripletd> &M, VectorXd &f, EnergySample *sample) {
+	// Computes maximal mass matrix as triplets
+	int n_nodes = (int)m_nodes.size();
+	double m = m_mass / n_nodes;
+
+	for (int i = 0; i < n_nodes; i++) {
+		int idxM = m_nodes[i]->idxM;
+		for (int k = 0; k < 3; k++) {
+			M.push_back(Tripletd(idxM + k, idxM + k, m));
+		}
+	}
+	computeSpringForce(grav, f, sample);
+}
+
+void DeformableSpring::computeSpringForce(Vector3d grav, VectorXd &f, EnergySample *sample) {
+	// Computes force vector, and adds the energies and momentum to sample if given
+	int n_nodes = (int)m_nodes.size();
+	double m = m_mass / n_nodes;
+
+	for (int i = 0; i < n_nodes; i++) {
+		int idxM = m_nodes[i]->idxM;
 		f.segment<3>(idxM) += m * grav;
+		if (sample != nullptr) {
+			Vector3d x = m_nodes[i]->x;
+			Vector3d mv = m * m_nodes[i]->v;
+			sample->energy.K += 0.5 * mv.dot(m_nodes[i]->v);
+			sample->energy.V -= m * grav.dot(x);
+			sample->momentum.segment<3>(0) += x.cross(mv);
+			sample->momentum.segment<3>(3) += mv;
+		}
 	}
 
 	for (int i = 0; i < n_nodes - 1; i++) {
@@ -210,6 +242,9 @@ void DeformableSpring::computeMass_(Vector3d grav, MatrixXd &M, VectorXd &f) {
 
 		f.segment<3>(row0) += fs;
 		f.segment<3>(row1) -= fs;
+		if (sample != nullptr) {
+			sample->energy.V += 0.5 * m_K * e * e;
+		}
 	}
 }
 
@@ -254,4 +289,25 @@ void DeformableSpring::computeJacobian_(MatrixXd &J, MatrixXd &Jdot) {
 	for (int i = 0; i < (int)m_nodes.size(); i++) {
 		J.block<3, 3>(m_nodes[i]->idxM, m_nodes[i]->idxR) = Matrix3d::Identity();
 	}
-}
\ No newline at end of file
+}
+
+void DeformableSpring::computeJacobian_(vector<Tripletd> &J, vector<Tripletd> &Jdot) {
+	for (int i = 0; i < (int)m_nodes.size(); i++) {
+		for (int k = 0; k < 3; k++) {
+			J.push_back(Tripletd(m_nodes[i]->idxM + k, m_nodes[i]->idxR + k, 1.0));
+		}
+	}
+}
+
+void DeformableSpring::computeJacProd_(const VectorXd &x, VectorXd &y) {
+	// The node rows of J are identity blocks
+	for (int i = 0; i < (int)m_nodes.size(); i++) {
+		y.segment<3>(m_nodes[i]->idxM) = x.segment<3>(m_nodes[i]->idxR);
+	}
+}
+
+void DeformableSpring::computeJacTransProd_(const VectorXd &y, VectorXd &x) {
+	for (int i = 0; i < (int)m_nodes.size(); i++) {
+		x.segment<3>(m_nodes[i]->idxR) = y.segment<3>(m_nodes[i]->idxM);
+	}
+}
@@ -33,10 +33,15 @@ protected:
 	void scatterDofs_(Eigen::VectorXd &y, int nr);
 	void scatterDDofs_(Eigen::VectorXd &ydot, int nr);
 
-	void computeMass_(Eigen::Vector3d grav, Eigen::MatrixXd &M, Eigen::VectorXd &f);
+	void computeMass_(Eigen::Vector3d grav, Eigen::MatrixXd &M, Eigen::VectorXd &f, EnergySample *sample);
 	void computeForceDamping_(Eigen::Vector3d grav, Eigen::VectorXd &f, Eigen::MatrixXd &D);
 	void computeEnergies_(Eigen::Vector3d grav, Energy &ener);
 	void computeJacobian_(Eigen::MatrixXd &J, Eigen::MatrixXd &Jdot);
+	void computeMass_(Eigen::Vector3d grav, std::vector<Tripletd> &M, Eigen::VectorXd &f, EnergySample *sample);
+	void computeJacobian_(std::vector<Tripletd> &J, std::vector<Tripletd> &Jdot);
+	void computeJacProd_(const Eigen::VectorXd &x, Eigen::VectorXd &y);
+	void computeJacTransProd_(const Eigen::VectorXd &y, Eigen::VectorXd &x);
+	void computeSpringForce(Eigen::Vector3d grav, Eigen::VectorXd &f, EnergySample *sample = nullptr);
 
 };
 
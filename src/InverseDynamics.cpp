@@ -0,0 +1,140 @@
+#include "InverseDynamics.h"
+
+#include <algorithm>
+
+#include "JointTree.h"
+#include "Joint.h"
+#include "Body.h"
+#include "TaskPool.h"
+
+using namespace std;
+using namespace Eigen;
+
+void InverseDynamics::init(const JointTree *tree) {
+	// The inertias are constant in the joint frames
+	m_tree = tree;
+	int n = tree->getNumJoints();
+	m_nr = 0;
+	m_M.resize(n);
+	for (int k = 0; k < n; k++) {
+		m_nr = max(m_nr, tree->getIdxR(k) + tree->getNdof(k));
+		Body *body = tree->getBody(k);
+		m_M[k].setZero();
+		if (body != nullptr) {
+			m_M[k].noalias() = body->Ad_ij.transpose() * body->I_i.asDiagonal() * body->Ad_ij;
+		}
+	}
+}
+
+void InverseDynamics::initWorkspace(Workspace &ws) const {
+	// Sizes a workspace for this tree
+	int n = m_tree->getNumJoints();
+	ws.T_jp.resize(n);
+	ws.V.resize(n);
+	ws.A.resize(n);
+	ws.F.resize(n);
+	ws.S.setZero(6, m_nr);
+	ws.Sdot.setZero(6, m_nr);
+	ws.q.setZero(m_nr);
+	ws.qdot.setZero(m_nr);
+	ws.qddot.setZero(m_nr);
+	ws.tau.setZero(m_nr);
+}
+
+VectorXd InverseDynamics::compute(const VectorXd &q, const VectorXd &qdot, const VectorXd &qddot, const Vector3d &grav) const {
+	// Computes the torques for one state
+	Workspace ws;
+	initWorkspace(ws);
+	ws.q = q;
+	ws.qdot = qdot;
+	ws.qddot = qddot;
+	compute_(ws, grav);
+	return ws.tau;
+}
+
+MatrixXd InverseDynamics::compute(const MatrixXd &y, const MatrixXd &qddot, const Vector3d &grav, TaskPool *pool) const {
+	// Computes the torques for every row. Each task takes a contiguous range
+	// of rows with its own workspace.
+	int nsamples = (int)y.rows();
+	MatrixXd tau(nsamples, m_nr);
+	int ntasks = 1;
+	if (pool != nullptr) {
+		ntasks = min(nsamples, 4 * pool->getNumThreads());
+	}
+	auto task = [&](int i) {
+		Workspace ws;
+		initWorkspace(ws);
+		int begin = (int)((long long)nsamples * i / ntasks);
+		int end = (int)((long long)nsamples * (i + 1) / ntasks);
+		for (int s = begin; s < end; s++) {
+			ws.q = y.row(s).head(m_nr).transpose();
+			ws.qdot = y.row(s).segment(m_nr, m_nr).transpose();
+			ws.qddot = qddot.row(s).transpose();
+			compute_(ws, grav);
+			tau.row(s) = ws.tau.transpose();
+		}
+	};
+	if (pool != nullptr && ntasks > 1) {
+		pool->parallelFor(ntasks, task);
+	}
+	else {
+		task(0);
+	}
+	return tau;
+}
+
+void InverseDynamics::compute_(Workspace &ws, const Vector3d &grav) const {
+	// With V and A the twist and acceleration of a joint frame,
+	//    V = S * qdot + Ad_jp * V_p
+	//    A = Ad_jp * A_p + S * qddot + Sdot * qdot + ad(V) * S * qdot
+	//    F = M * A - ad(V)' * M * V + sum of Ad_cj' * F_c over the children c
+	//    tau = S' * F + Kr * q + Dr * qdot
+	// Gravity enters as an upward acceleration of the world.
+	int n = m_tree->getNumJoints();
+	Vector6d Aw;
+	Aw << 0.0, 0.0, 0.0, -grav;
+	for (int k = 0; k < n; k++) {
+		Joint *joint = m_tree->getJoint(k);
+		int row = m_tree->getIdxR(k);
+		int ndof = m_tree->getNdof(k);
+		int p = m_tree->getParent(k);
+		double *S = ws.S.data() + 6 * row;
+		double *Sdot = ws.Sdot.data() + 6 * row;
+		RigidTransform T_pj;
+		joint->computeKinematics(ws.q.data() + row, ws.qdot.data() + row, T_pj, S, Sdot);
+		ws.T_jp[k] = T_pj.inverse();
+		Adjoint Ad_jp = ws.T_jp[k].adjoint();
+
+		Map<const Matrix<double, 6, Dynamic> > Sk(S, 6, ndof);
+		Map<const Matrix<double, 6, Dynamic> > Sdotk(Sdot, 6, ndof);
+		Vector6d Sqdot = Sk * ws.qdot.segment(row, ndof);
+		if (p >= 0) {
+			ws.V[k] = Sqdot + Ad_jp.apply(ws.V[p]);
+			ws.A[k] = Ad_jp.apply(ws.A[p]);
+		}
+		else {
+			ws.V[k] = Sqdot;
+			ws.A[k] = Ad_jp.apply(Aw);
+		}
+		ws.A[k].noalias() += Sk * ws.qddot.segment(row, ndof);
+		ws.A[k].noalias() += Sdotk * ws.qdot.segment(row, ndof);
+		ws.A[k] += Adjoint::ad(ws.V[k], Sqdot);
+		ws.F[k].noalias() = m_M[k] * ws.A[k];
+		ws.F[k] -= Adjoint::adTranspose(ws.V[k], m_M[k] * ws.V[k]);
+	}
+
+	for (int k = n - 1; k >= 0; k--) {
+		Joint *joint = m_tree->getJoint(k);
+		int row = m_tree->getIdxR(k);
+		int ndof = m_tree->getNdof(k);
+		int p = m_tree->getParent(k);
+		Map<const Matrix<double, 6, Dynamic> > Sk(ws.S.data() + 6 * row, 6, ndof);
+		ws.tau.segment(row, ndof).noalias() = Sk.transpose() * ws.F[k];
+		if (joint->presc == false) {
+			ws.tau.segment(row, ndof) += joint->m_Kr * ws.q.segment(row, ndof) + joint->m_Dr * ws.qdot.segment(row, ndof);
+		}
+		if (p >= 0) {
+			ws.F[p] += ws.T_jp[k].adjoint().applyTranspose(ws.F[k]);
+		}
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+// InverseDynamics Recursive Newton-Euler joint torques for given accelerations
+//    Computes the joint torques tau that make the forward dynamics return
+//    qddot at (q, qdot), with the same gravity, Coriolis, joint stiffness and
+//    joint damping terms as the articulated-body pass (at h = 0). Each joint
+//    frame's twist and acceleration are propagated from its parent, then the
+//    wrenches are summed from the leaves back, in O(n) per state. The state is
+//    read from the inputs and every intermediate lives in a workspace, so the
+//    joints and bodies are never changed and many states, e.g. the rows of a
+//    Solution::y trajectory, can be processed at once on a task pool.
+
+#ifndef REDUCEDCOORD_SRC_INVERSEDYNAMICS_H_
+#define REDUCEDCOORD_SRC_INVERSEDYNAMICS_H_
+#include <vector>
+#define EIGEN_DONT_ALIGN_STATICALLY
+
+#include <Eigen/Dense>
+#include "MLCommon.h"
+#include "RigidTransform.h"
+
+class JointTree;
+class TaskPool;
+
+class InverseDynamics
+{
+public:
+	InverseDynamics() : m_tree(nullptr) {}
+	virtual ~InverseDynamics() {}
+
+	// Stores the bodies' inertias in their joint frames. Called by JointTree::build.
+	void init(const JointTree *tree);
+
+	// Torques for one state
+	Eigen::VectorXd compute(const Eigen::VectorXd &q, const Eigen::VectorXd &qdot, const Eigen::VectorXd &qddot, const Eigen::Vector3d &grav) const;
+
+	// Torques for one state per row, where y = [q qdot] as in Solution::y.
+	// The rows are split among the threads of pool if one is given.
+	Eigen::MatrixXd compute(const Eigen::MatrixXd &y, const Eigen::MatrixXd &qddot, const Eigen::Vector3d &grav, TaskPool *pool) const;
+
+private:
+	// Per-thread state of one evaluation, indexed like the tree
+	struct Workspace {
+		std::vector<RigidTransform> T_jp;
+		std::vector<Vector6d> V;			// Joint twists
+		std::vector<Vector6d> A;			// Joint accelerations, gravity included
+		std::vector<Vector6d> F;			// Wrenches from the joint's subtree
+		Eigen::Matrix<double, 6, Eigen::Dynamic> S;		// All joints' S, at their idxR
+		Eigen::Matrix<double, 6, Eigen::Dynamic> Sdot;
+		Eigen::VectorXd q;
+		Eigen::VectorXd qdot;
+		Eigen::VectorXd qddot;
+		Eigen::VectorXd tau;
+	};
+
+	void initWorkspace(Workspace &ws) const;
+	void compute_(Workspace &ws, const Eigen::Vector3d &grav) const;
+
+	const JointTree *m_tree;
+	int m_nr;
+	std::vector<Matrix6d> m_M;		// Body inertia in the joint frame, Ad_ij' * I_i * Ad_ij
+};
+
+#endif // REDUCEDCOORD_SRC_INVERSEDYNAMICS_H_
@@ -3,21 +3,34 @@
 
 #include "Body.h"
 #include "SE3.h"
+#include "RigidTransform.h"
 #include "MatrixStack.h"
 #include "Program.h"
 #include "Shape.h"
+#include "JointTree.h"
 
 using namespace std;
 using namespace Eigen;
 
-Joint::Joint() {
+Joint::Joint() :
+m_ndof(0),
+m_tree(nullptr),
+m_index(-1),
+m_isQDirty(false),
+m_isQdotDirty(false)
+{
+	// A null joint has nothing to update
 	presc = false;
 }
 
 Joint::Joint(shared_ptr<Body> body, int ndof, shared_ptr<Joint> parent) :
 m_body(body),
 m_parent(parent),
-m_ndof(ndof)
+m_ndof(ndof),
+m_tree(nullptr),
+m_index(-1),
+m_isQDirty(true),
+m_isQdotDirty(true)
 {
 	if (parent == nullptr) {
 		m_name = "NULL-" + body->getName();
@@ -80,9 +93,90 @@ void Joint::setJointTransform(Matrix4d E) {
 	E_pj0 = E;
 }
 
+Joint *Joint::forward() const {
+	// Next joint in tree order. Before the tree is built, falls back to next.
+	if (m_tree != nullptr) {
+		return m_tree->getJoint(m_index + 1);
+	}
+	return next.get();
+}
+
+Joint *Joint::backward() const {
+	// Previous joint in tree order
+	if (m_tree != nullptr) {
+		return m_tree->getJoint(m_index - 1);
+	}
+	return prev.get();
+}
+
+template <typename Step>
+void Joint::forEachForward(Step step, bool isLevelSafe) {
+	// Calls step on this joint and the following ones, parents before children.
+	// From the first joint of a tree with a task pool, the tree dispatches the
+	// subtrees, or the depth levels if the step allows it, to the pool.
+	if (m_tree != nullptr && m_tree->isParallel() && m_index == 0) {
+		JointTree *tree = m_tree;
+		tree->forEach([&](int k) { step(tree->getJoint(k)); }, false, isLevelSafe);
+		return;
+	}
+	for (Joint *joint = this; joint != nullptr; joint = joint->forward()) {
+		step(joint);
+	}
+}
+
+template <typename Step>
+void Joint::forEachBackward(Step step) {
+	// Calls step on this joint and the preceding ones, children before parents
+	if (m_tree != nullptr && m_tree->isParallel() && m_index == m_tree->getNumJoints() - 1) {
+		JointTree *tree = m_tree;
+		tree->forEach([&](int k) { step(tree->getJoint(k)); }, true, false);
+		return;
+	}
+	for (Joint *joint = this; joint != nullptr; joint = joint->backward()) {
+		step(joint);
+	}
+}
+
 void Joint::update() {
-	// Updates this joint and the attached body
-	update_();
+	// Updates this joint and the following ones, parents before children
+	forEachForward([](Joint *joint) {
+		joint->update_();
+		joint->updatePosition_();
+		joint->updateVelocity_();
+		joint->m_isQDirty = false;
+		joint->m_isQdotDirty = false;
+	}, true);
+}
+
+void Joint::updateDirty() {
+	// Updates only the joints whose q or qdot changed since the last update,
+	// together with their subtrees. A joint below a moved joint is moved as
+	// well; below a joint whose velocity alone changed, only the velocities
+	// are refreshed and the transforms and adjoints are kept.
+	forEachForward([](Joint *joint) {
+		Joint *parent = joint->m_parent.get();
+		if (parent != nullptr) {
+			joint->m_isQDirty = joint->m_isQDirty || parent->m_isQDirty;
+			joint->m_isQdotDirty = joint->m_isQdotDirty || parent->m_isQdotDirty;
+		}
+		if (joint->m_isQDirty || joint->m_isQdotDirty) {
+			// The joint-specific part may depend on both q and qdot (e.g. Sdot)
+			joint->update_();
+			if (joint->m_isQDirty) {
+				joint->updatePosition_();
+			}
+			joint->updateVelocity_();
+		}
+	}, true);
+	// The flags are kept until the whole pass is done, so that children can read them
+	for (Joint *joint = this; joint != nullptr; joint = joint->forward()) {
+		joint->m_isQDirty = false;
+		joint->m_isQdotDirty = false;
+	}
+}
+
+void Joint::updatePosition_() {
+	// Updates the transforms of this joint and the attached body
 	// Transforms and adjoints
 	E_pj = E_pj0 * m_Q;
 
@@ -98,20 +192,17 @@ void Joint::update() {
 		E_wp = m_parent->E_wj;
 	}
 	E_wj = E_wp * E_pj;
+	m_body->updatePosition();
+}
 
-	// Joint velocity
-	V = m_S * m_qdot;
+void Joint::updateVelocity_() {
+	// Updates the velocities of this joint and the attached body
+	V.noalias() = m_S * m_qdot;
 	if (m_parent != nullptr) {
 		// Add parent velocity
 		V += Ad_jp * m_parent->V;
 	}
-
-	// Update attached body
-	m_body->update();
-	if (next != nullptr) {
-		next->update();
-	}
-
+	m_body->updateVelocity();
 }
 
 void Joint::countDofs(int &nm, int &nr) {
@@ -125,29 +216,36 @@ int Joint::countR(int &nr, int data) {
 	return (nr - data);
 }
 
-void Joint::computeJacobian(MatrixXd &J, MatrixXd &Jdot, int nm, int nr) {
-	// Computes the redmax Jacobian
-	Matrix6d Ad_ij = m_body->Ad_ij;
-	J.block(m_body->idxM, idxR, 6, m_ndof) = Ad_ij * m_S;
-	Jdot.block(m_body->idxM, idxR, 6, m_ndof) = Ad_ij * m_Sdot;
+void Joint::computeJacobian(MatrixXd &J, MatrixXd &Jdot, int, int) {
+	// Computes the redmax Jacobian from the block-sparse rows of the tree,
+	// which World::init has built. Covers the whole tree.
+	BlockJacobian &jacobian = m_tree->getJacobian();
+	jacobian.compute();
+	jacobian.scatter(J, Jdot);
+}
 
-	// Loop through all ancestors
-	auto jointA = m_parent;
-	while (jointA != nullptr) {
-		int idxM_P = m_parent->getBody()->idxM;
-		Matrix6d Ad_ip = m_body->Ad_ip;
-		Matrix6d Ad_iw = m_body->Ad_iw;
-		Matrix6d Ad_wp = m_parent->getBody()->Ad_wi;
-		Matrix6d Addot_wi = m_body->Addot_wi;
-		Matrix6d Addot_wp = m_parent->getBody()->Addot_wi;
-		Matrix6d Addot_ip = -Ad_iw * (Addot_wi * Ad_iw * Ad_wp - Addot_wp);
-		J.block(m_body->idxM, jointA->idxR, 6, jointA->m_ndof) = Ad_ip * J.block(idxM_P, jointA->idxR, 6, jointA->m_ndof);
-		Jdot.block(m_body->idxM, jointA->idxR, 6, jointA->m_ndof) = Ad_ip * Jdot.block(idxM_P, jointA->idxR, 6, jointA->m_ndof) + Addot_ip * J.block(idxM_P, jointA->idxR, 6, jointA->m_ndof);
-		jointA = jointA->getParent();
-	}
-	if (next != nullptr) {
-		next->computeJacobian(J, Jdot, nm, nr);
-	}
+void Joint::computeJacobian(vector<Tripletd> &J, vector<Tripletd> &Jdot, int, int) {
+	// Computes the redmax Jacobian as triplets
+	BlockJacobian &jacobian = m_tree->getJacobian();
+	jacobian.compute();
+	jacobian.scatter(J, Jdot);
+}
+
+void Joint::computeKinematics(const double *, const double *, RigidTransform &T_pj, double *S, double *Sdot) const {
+	// Computes E_pj, S and Sdot from the current state, which q and qdot are
+	// expected to match; joints that can evaluate at any q override this
+	T_pj = RigidTransform(E_pj0) * RigidTransform(m_Q);
+	Map<MatrixXd>(S, 6, m_ndof) = m_S;
+	Map<MatrixXd>(Sdot, 6, m_ndof) = m_Sdot;
+}
+
+void Joint::computeJacobianBlock(Matrix<double, 6, Dynamic> &J, Matrix<double, 6, Dynamic> &Jdot, int col, Vector6d &v) const {
+	// Computes this joint's own block of its body's Jacobian row, Ad_ij * S,
+	// starting at column col, and the body's twist relative to its parent
+	auto Jself = J.middleCols(col, m_ndof);
+	Jself.noalias() = m_body->Ad_ij * m_S;
+	Jdot.middleCols(col, m_ndof).noalias() = m_body->Ad_ij * m_Sdot;
+	v.noalias() = Jself * m_qdot;
 }
 
 void Joint::computeInertia() {
@@ -166,115 +264,302 @@ void Joint::computeInertia() {
 	m_I_j.block<3, 3>(3, 3) = m * Matrix3d::Identity();
 }
 
-void Joint::computeForceStiffness(VectorXd &fr, MatrixXd &Kr) {
-	// Computes joint stiffness force vector and matrix
+void Joint::computeArticulatedBias(Vector3d grav) {
+	// Articulated-body pass 1, parents before children
+	forEachForward([&](Joint *joint) { joint->computeArticulatedBias_(grav); }, true);
+}
+
+void Joint::computeArticulatedBias_(const Vector3d &grav) {
+	// Computes the bias acceleration and the body's own inertia and bias force
+	m_Sb.noalias() = m_body->Ad_ij * m_S;
+	Vector6d vrel = m_Sb * m_qdot;
+	m_c = m_body->Ad_ij * (m_Sdot * m_qdot) + Adjoint::ad(m_body->phi, vrel);
+	m_IA = Matrix6d(m_body->I_i.asDiagonal());
+	m_pA = -m_body->computeForceGrav(grav);
+}
+
+void Joint::computeArticulatedInertia(double h) {
+	// Articulated-body pass 2, children before parents
+	forEachBackward([&](Joint *joint) { joint->computeArticulatedInertia_(h); });
+}
+
+void Joint::computeArticulatedInertia_(double h) {
+	// Projects the articulated inertia and bias force onto the parent. The implicit joint
+	// damping and stiffness of the REDMAX_EULER step act as a joint armature:
+	// (Mr + h Dr + h^2 Kr) qddot = fr - (Dr + h Kr) qdot
+	m_U.noalias() = m_IA * m_Sb;
+	m_u.noalias() = -m_Sb.transpose() * m_pA;
+	MatrixXd D = m_Sb.transpose() * m_U;
 	if (presc == false) {
-		int row = this->idxR;
-		// Add the joint torque here rather than having a separate function
-		fr.segment(row, m_ndof) += m_tau - m_Kr * m_q;
-		MatrixXd I(m_ndof, m_ndof);
-		I.setIdentity();
-		Kr.block(row, row, m_ndof, m_ndof) -= m_Kr * I;
+		m_u += m_tau - m_Kr * m_q - (m_Dr + h * m_Kr) * m_qdot;
+		D.diagonal().array() += h * m_Dr + h * h * m_Kr;
+	}
+
+	Matrix6d Ia = m_IA;
+	if (m_ndof > 0) {
+		m_Dinv = D.inverse();
+		Ia.noalias() -= m_U * m_Dinv * m_U.transpose();
+	}
+	if (m_parent != nullptr) {
+		Vector6d pa = m_pA + Ia * m_c;
+		if (m_ndof > 0) {
+			pa.noalias() += m_U * (m_Dinv * m_u);
+		}
+		addArticulatedToParent_(Ia, pa);
 	}
+}
+
+void Joint::addArticulatedToParent_(const Matrix6d &Ia, const Vector6d &pa) {
+	// Adds this body's articulated inertia and bias force to the parent's
+	Matrix6d Ad_ip = m_body->Ad_ip;
+	m_parent->m_IA += Ad_ip.transpose() * Ia * Ad_ip;
+	m_parent->m_pA += Ad_ip.transpose() * pa;
+}
 
-	if (next != nullptr) {
-		next->computeForceStiffness(fr, Kr);
+void Joint::computeArticulatedAcc(VectorXd &qddot) {
+	// Articulated-body pass 3, parents before children
+	forEachForward([&](Joint *joint) { joint->computeArticulatedAcc_(qddot); }, true);
+}
+
+void Joint::computeArticulatedAcc_(VectorXd &qddot) {
+	// Computes the joint and body accelerations
+	m_a = computeParentAcc_();
+	if (m_ndof > 0) {
+		qddot.segment(idxR, m_ndof).noalias() = m_Dinv * (m_u - m_U.transpose() * m_a);
+		m_a.noalias() += m_Sb * qddot.segment(idxR, m_ndof);
+	}
+}
+
+Vector6d Joint::computeParentAcc_() const {
+	// Computes the body acceleration before this joint's own acceleration is added
+	Vector6d a = m_c;
+	if (m_parent != nullptr) {
+		a += m_body->Ad_ip * m_parent->m_a;
+	}
+	return a;
+}
+
+void Joint::computeForceStiffness(VectorXd &fr, MatrixXd &Kr, EnergySample *sample) {
+	// Computes joint stiffness force vector and matrix, and adds the spring
+	// energy to sample if given
+	for (Joint *joint = this; joint != nullptr; joint = joint->forward()) {
+		if (sample != nullptr) {
+			sample->energy.V += 0.5 * joint->m_Kr * joint->m_q.dot(joint->m_q);
+		}
+		if (joint->presc == false) {
+			int row = joint->idxR;
+			int ndof = joint->m_ndof;
+			// Add the joint torque here rather than having a separate function
+			fr.segment(row, ndof) += joint->m_tau - joint->m_Kr * joint->m_q;
+			Kr.block(row, row, ndof, ndof).diagonal().array() -= joint->m_Kr;
+		}
 	}
 }
 
 void Joint::computeForceDamping(VectorXd &fr, MatrixXd &Dr) {
 	// Computes joint damping force vector and matrix
-	if (presc == false) {
-		int row = this->idxR;
-		fr.segment(row, m_ndof) -= m_Dr * m_qdot;
-		MatrixXd I(m_ndof, m_ndof);
-		I.setIdentity();
-		Dr.block(row, row, m_ndof, m_ndof) += m_Dr * I;
+	for (Joint *joint = this; joint != nullptr; joint = joint->forward()) {
+		if (joint->presc == false) {
+			int row = joint->idxR;
+			int ndof = joint->m_ndof;
+			fr.segment(row, ndof) -= joint->m_Dr * joint->m_qdot;
+			Dr.block(row, row, ndof, ndof).diagonal().array() += joint->m_Dr;
+		}
+	}
+}
+
+void Joint::computeForceStiffness(VectorXd &fr, vector<Tripletd> &Kr, EnergySample *sample) {
+	// Computes joint stiffness force vector and matrix as triplets, and adds
+	// the spring energy to sample if given
+	for (Joint *joint = this; joint != nullptr; joint = joint->forward()) {
+		if (sample != nullptr) {
+			sample->energy.V += 0.5 * joint->m_Kr * joint->m_q.dot(joint->m_q);
+		}
+		if (joint->presc == false) {
+			int row = joint->idxR;
+			fr.segment(row, joint->m_ndof) += joint->m_tau - joint->m_Kr * joint->m_q;
+			for (int i = 0; i < joint->m_ndof; i++) {
+				Kr.push_back(Tripletd(row + i, row + i, -joint->m_Kr));
+			}
+		}
 	}
+}
 
-	if (next != nullptr) {
-		next->computeForceDamping(fr, Dr);
+void Joint::computeForceDamping(VectorXd &fr, vector<Tripletd> &Dr) {
+	// Computes joint damping force vector and matrix as triplets
+	for (Joint *joint = this; joint != nullptr; joint = joint->forward()) {
+		if (joint->presc == false) {
+			int row = joint->idxR;
+			fr.segment(row, joint->m_ndof) -= joint->m_Dr * joint->m_qdot;
+			for (int i = 0; i < joint->m_ndof; i++) {
+				Dr.push_back(Tripletd(row + i, row + i, joint->m_Dr));
+			}
+		}
 	}
 }
 
 VectorXd Joint::computerJacTransProd(VectorXd y, VectorXd x, int nr) {
 	// Computes x = J'*y
 	// x (nr, 1)
-	VectorXd yi = y.segment(m_body->idxM, 6);
-	for (int k = 0; k < (int)m_children.size(); k++) {
-		yi = yi + m_children[k]->getAlpha();
+	computeJacTransProd(y, x);
+	return x;
+}
+
+void Joint::computeJacProd(const VectorXd &x, VectorXd &y) {
+	// Computes the rigid rows of y = J*x without forming J, parents before children
+	forEachForward([&](Joint *joint) { joint->computeJacProd_(x, y); }, true);
+}
+
+void Joint::computeJacProd_(const VectorXd &x, VectorXd &y) {
+	// Computes the rows of this joint's body from the parent body's rows
+	Vector6d Sx;
+	Sx.noalias() = m_S * x.segment(idxR, m_ndof);
+	Vector6d yi = m_body->Ad_ij * Sx;
+	if (m_parent != nullptr) {
+		yi += m_body->Ad_ip * y.segment<6>(m_parent->getBody()->idxM);
 	}
-	m_alpha = m_body->Ad_ip.transpose() * yi;
-	x.segment(idxR, m_ndof) = (m_body->Ad_ij * m_S).transpose() * yi;
+	y.segment<6>(m_body->idxM) = yi;
+}
+
+void Joint::computeJacDotProd(const VectorXd &x, VectorXd &y, VectorXd &ydot) {
+	// Computes the rigid rows of y = J*x and ydot = Jdot*x, parents before children
+	forEachForward([&](Joint *joint) { joint->computeJacDotProd_(x, y, ydot); }, true);
+}
 
-	if (prev != nullptr) {
-		x = prev->computerJacTransProd(y, x, nr);
+void Joint::computeJacDotProd_(const VectorXd &x, VectorXd &y, VectorXd &ydot) {
+	// Computes the rows of this joint's body. The parent term uses d/dt(Ad_ip) = -ad(v) * Ad_ip, where v = Ad_ij * S * qdot
+	// is the twist of this body relative to its parent.
+	Vector6d Sx, Sdotx, Sqdot;
+	Sx.noalias() = m_S * x.segment(idxR, m_ndof);
+	Sdotx.noalias() = m_Sdot * x.segment(idxR, m_ndof);
+	Sqdot.noalias() = m_S * m_qdot;
+	Vector6d yi = m_body->Ad_ij * Sx;
+	Vector6d ydoti = m_body->Ad_ij * Sdotx;
+	if (m_parent != nullptr) {
+		int idxM_P = m_parent->getBody()->idxM;
+		Vector6d yp = m_body->Ad_ip * y.segment<6>(idxM_P);
+		yi += yp;
+		ydoti += m_body->Ad_ip * ydot.segment<6>(idxM_P) - Adjoint::ad(m_body->Ad_ij * Sqdot, yp);
 	}
-	return x;
+	y.segment<6>(m_body->idxM) = yi;
+	ydot.segment<6>(m_body->idxM) = ydoti;
+}
+
+void Joint::computeJacTransProd(const VectorXd &y, VectorXd &x) {
+	// Computes the reduced rows of x = J'*y without forming J, children before parents
+	forEachBackward([&](Joint *joint) { joint->computeJacTransProd_(y, x); });
+}
+
+void Joint::computeJacTransProd_(const VectorXd &y, VectorXd &x) {
+	// Computes this joint's rows from its body's rows and its children's sums
+	x.segment(idxR, m_ndof).noalias() = m_S.transpose() * computeJacTransWrench_(y);
+}
+
+Vector6d Joint::computeJacTransWrench_(const VectorXd &y) {
+	// Sums the body's rows of y and the children's contributions, stores the
+	// contribution to the parent, and returns the sum in joint space
+	Vector6d yi = y.segment<6>(m_body->idxM);
+	for (int k = 0; k < (int)m_children.size(); k++) {
+		yi += m_children[k]->getAlpha();
+	}
+	m_alpha = m_body->Ad_ip.transpose() * yi;
+	return m_body->Ad_ij.transpose() * yi;
 }
 
 void Joint::computeEnergies(Vector3d grav, Energy &ener) {
 	// Computes kinetic and potential energies
-	m_body->computeEnergies(grav, ener);
-	ener.V += 0.5 * m_Kr * m_q.dot(m_q);
-	if (next != nullptr) {
-		next->computeEnergies(grav, ener);
+	for (Joint *joint = this; joint != nullptr; joint = joint->forward()) {
+		joint->m_body->computeEnergies(grav, ener);
+		ener.V += 0.5 * joint->m_Kr * joint->m_q.dot(joint->m_q);
+	}
+}
+
+void Joint::computeEnergies(const Vector3d &grav, EnergySample &sample) {
+	// Adds the energies and momentum of the tree, for the paths without a
+	// force assembly pass
+	for (Joint *joint = this; joint != nullptr; joint = joint->forward()) {
+		joint->m_body->computeEnergies(grav, sample);
+		sample.energy.V += 0.5 * joint->m_Kr * joint->m_q.dot(joint->m_q);
 	}
 }
 
 Eigen::VectorXd Joint::gatherDofs(VectorXd y, int nr) {
 	// Gathers q and qdot into y
-	y.segment(idxR, m_ndof) = m_q;
-	y.segment(nr + idxR, m_ndof) = m_qdot;
-	if (next != nullptr) {
-		y = next->gatherDofs(y, nr);
+	for (Joint *joint = this; joint != nullptr; joint = joint->forward()) {
+		y.segment(joint->idxR, joint->m_ndof) = joint->m_q;
+		y.segment(nr + joint->idxR, joint->m_ndof) = joint->m_qdot;
 	}
 	return y;
 }
 
 Eigen::VectorXd Joint::gatherDDofs(VectorXd ydot, int nr) {
 	// Gathers qdot and qddot into ydot
-	ydot.segment(idxR, m_ndof) = m_qdot;
-	ydot.segment(nr + idxR, m_ndof) = m_qddot;
-	if (next != nullptr) {
-		ydot = next->gatherDDofs(ydot, nr);
+	for (Joint *joint = this; joint != nullptr; joint = joint->forward()) {
+		ydot.segment(joint->idxR, joint->m_ndof) = joint->m_qdot;
+		ydot.segment(nr + joint->idxR, joint->m_ndof) = joint->m_qddot;
 	}
 	return ydot;
 }
 
-void Joint::scatterDofs(VectorXd y, int nr) {
-	// Scatters q and qdot from y
+void Joint::scatterDofs(const VectorXd &y, int nr) {
+	// Scatters q and qdot from y, and updates what they changed
 	scatterDofsNoUpdate(y, nr);
-	update();
+	updateDirty();
+}
+
+void Joint::scatterVelocities(const VectorXd &y, int nr) {
+	// Scatters only qdot from y. The transforms are left as they are.
+	for (Joint *joint = this; joint != nullptr; joint = joint->forward()) {
+		auto qdot = y.segment(nr + joint->idxR, joint->m_ndof);
+		if (joint->m_qdot != qdot) {
+			joint->m_qdot = qdot;
+			joint->m_isQdotDirty = true;
+		}
+	}
+	updateDirty();
 }
 
-void Joint::scatterDDofs(VectorXd ydot, int nr) {
+void Joint::scatterDDofs(const VectorXd &ydot, int nr) {
 	// Scatters qdot and qddot from ydot
-	m_qdot.segment(0, m_ndof) = ydot.segment(idxR, m_ndof);
-	m_qddot.segment(0, m_ndof) = ydot.segment(nr + idxR, m_ndof);
-	if (next != nullptr) {
-		next->scatterDDofs(ydot, nr);
+	for (Joint *joint = this; joint != nullptr; joint = joint->forward()) {
+		joint->m_qdot = ydot.segment(joint->idxR, joint->m_ndof);
+		joint->m_qddot = ydot.segment(nr + joint->idxR, joint->m_ndof);
 	}
 }
 
-void Joint::scatterDofsNoUpdate(VectorXd y, int nr) {
-	// Helper function to scatter without updating
-	m_q.segment(0, m_ndof) = y.segment(idxR, m_ndof);
-	m_qdot.segment(0, m_ndof) = y.segment(nr + idxR, m_ndof);
-	if (next != nullptr) {
-		next->scatterDofsNoUpdate(y, nr);
+void Joint::scatterDofsNoUpdate(const VectorXd &y, int nr) {
+	// Helper function to scatter without updating. Only the joints whose
+	// values actually change are marked for the next update.
+	for (Joint *joint = this; joint != nullptr; joint = joint->forward()) {
+		auto q = y.segment(joint->idxR, joint->m_ndof);
+		auto qdot = y.segment(nr + joint->idxR, joint->m_ndof);
+		if (joint->m_q != q) {
+			joint->m_q = q;
+			joint->m_isQDirty = true;
+		}
+		if (joint->m_qdot != qdot) {
+			joint->m_qdot = qdot;
+			joint->m_isQdotDirty = true;
+		}
 	}
 }
 
-void Joint::scatterTauCon(VectorXd tauc) {
+void Joint::scatterTauCon(const VectorXd &tauc) {
 	// Scatters constraint force
-	m_tauCon = tauc.segment(idxR, m_ndof);
-	if (next != nullptr) {
-		next->scatterTauCon(tauc);
+	for (Joint *joint = this; joint != nullptr; joint = joint->forward()) {
+		joint->m_tauCon = tauc.segment(joint->idxR, joint->m_ndof);
 	}
 }
 
 void Joint::draw(shared_ptr<MatrixStack> MV, const shared_ptr<Program> prog, const shared_ptr<Program> progSimple, shared_ptr<MatrixStack> P) const {
+	// Draws this joint and the following ones
+	for (const Joint *joint = this; joint != nullptr; joint = joint->forward()) {
+		joint->drawAxes_(MV, prog, progSimple, P);
+		joint->drawSelf(MV, prog, progSimple, P);
+	}
+}
+
+void Joint::drawAxes_(shared_ptr<MatrixStack> MV, const shared_ptr<Program> prog, const shared_ptr<Program> progSimple, shared_ptr<MatrixStack> P) const {
 
 	progSimple->bind();
 	glUniformMatrix4fv(prog->getUniform("P"), 1, GL_FALSE, glm::value_ptr(P->topMatrix()));
@@ -302,13 +587,6 @@ void Joint::draw(shared_ptr<MatrixStack> MV, const shared_ptr<Program> prog, con
 	glEnd();
 	MV->popMatrix();
 	progSimple->unbind();
-
-	drawSelf(MV, prog, progSimple, P);
-
-	if (next != nullptr) {
-		next->draw(MV, prog, progSimple, P);
-	}
-
 }
 
 void Joint::drawSelf(shared_ptr<MatrixStack> MV, const shared_ptr<Program> prog, const shared_ptr<Program> progSimple, shared_ptr<MatrixStack> P) const {
@@ -18,6 +18,8 @@ class Body;
 class MatrixStack;
 class Program;
 class Shape;
+class JointTree;
+class RigidTransform;
 
 class Joint : public std::enable_shared_from_this<Joint> {
 public:
@@ -30,6 +32,7 @@ public:
 	virtual void draw(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, const std::shared_ptr<Program> prog2, std::shared_ptr<MatrixStack> P) const;
 	virtual void drawSelf(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, const std::shared_ptr<Program> prog2, std::shared_ptr<MatrixStack> P) const;
 	virtual void update();
+	void updateDirty();
 
 	int m_ndof;						// Number of DOF
 	Eigen::VectorXd m_q;			// Position
@@ -51,8 +54,8 @@ public:
 	Matrix4d E_jp;					// Transform of parent joint wrt this joint
 	Matrix4d E_wj;					// Transform of this joint wrt world
 	Matrix6d Ad_jp;					// Adjoint of E_jp
-	std::shared_ptr<Joint> next;	// Forward recursive ordering
-	std::shared_ptr<Joint> prev;	// Reverse recursive ordering
+	std::shared_ptr<Joint> next;	// Forward ordering, parents before children
+	std::shared_ptr<Joint> prev;	// Reverse ordering, children before parents
 	int idxR;						// Reduced indices
 	Vector3d m_axis;
 
@@ -62,25 +65,48 @@ public:
 	void setStiffness(double K) { m_Kr = K; } // Sets this joint's linear stiffness
 	void setDamping(double D) { m_Dr = D; } // Sets this joint's linear velocity damping
 	void addChild(std::shared_ptr<Joint> joint) { m_children.push_back(joint); }
+	void setTree(JointTree *tree, int index) { m_tree = tree; m_index = index; }
 
 	std::shared_ptr<Body> getBody() const { return m_body; }
 	std::shared_ptr<Joint> getParent() const { return m_parent; }
 	std::shared_ptr<Joint> getJoint() { return shared_from_this(); }
 	Vector6d getAlpha() const { return m_alpha; }
 	std::string getName() const { return m_name; }
+	int getTreeIndex() const { return m_index; }		// Position in the flat tree, -1 before World::init
 
 	void computeJacobian(Eigen::MatrixXd &J, Eigen::MatrixXd &Jdot, int nm, int nr);
+	void computeJacobian(std::vector<Tripletd> &J, std::vector<Tripletd> &Jdot, int nm, int nr);
+	// Computes E_pj, S and Sdot at (q, qdot), this joint's own DOFs, without
+	// changing its state, so that several states can be evaluated at once.
+	// S and Sdot are 6 x ndof, column-major. The default returns the current
+	// Q, S and Sdot, for joints where they do not depend on q.
+	virtual void computeKinematics(const double *q, const double *qdot, RigidTransform &T_pj, double *S, double *Sdot) const;
+	virtual void computeJacobianBlock(Eigen::Matrix<double, 6, Eigen::Dynamic> &J, Eigen::Matrix<double, 6, Eigen::Dynamic> &Jdot, int col, Vector6d &v) const;
 	Eigen::VectorXd computerJacTransProd(Eigen::VectorXd y, Eigen::VectorXd x, int nr);
-	void computeForceStiffness(Eigen::VectorXd &fr, Eigen::MatrixXd &Kr);
+	void computeJacProd(const Eigen::VectorXd &x, Eigen::VectorXd &y);
+	void computeJacDotProd(const Eigen::VectorXd &x, Eigen::VectorXd &y, Eigen::VectorXd &ydot);
+	void computeJacTransProd(const Eigen::VectorXd &y, Eigen::VectorXd &x);
+	void computeForceStiffness(Eigen::VectorXd &fr, Eigen::MatrixXd &Kr, EnergySample *sample = nullptr);
 	void computeForceDamping(Eigen::VectorXd &fr, Eigen::MatrixXd &Dr);
+	void computeForceStiffness(Eigen::VectorXd &fr, std::vector<Tripletd> &Kr, EnergySample *sample = nullptr);
+	void computeForceDamping(Eigen::VectorXd &fr, std::vector<Tripletd> &Dr);
 	void computeInertia();
+	void computeArticulatedBias(Vector3d grav);
+	void computeArticulatedInertia(double h);
+	void computeArticulatedAcc(Eigen::VectorXd &qddot);
 
 	void computeEnergies(Vector3d grav, Energy &ener);
+	void computeEnergies(const Vector3d &grav, EnergySample &sample);
 	Eigen::VectorXd gatherDofs(Eigen::VectorXd y, int nr);
 	Eigen::VectorXd gatherDDofs(Eigen::VectorXd ydot, int nr);
-	void scatterDofs(Eigen::VectorXd y, int nr);
-	void scatterDDofs(Eigen::VectorXd ydot, int nr);
-	void scatterTauCon(Eigen::VectorXd tauc);
+	void scatterDofs(const Eigen::VectorXd &y, int nr);
+	void scatterVelocities(const Eigen::VectorXd &y, int nr);
+	void scatterDDofs(const Eigen::VectorXd &ydot, int nr);
+	void scatterTauCon(const Eigen::VectorXd &tauc);
+
+	// For code that writes m_q or m_qdot directly and then calls updateDirty()
+	void setQDirty() { m_isQDirty = true; }
+	void setQdotDirty() { m_isQdotDirty = true; }
 
 protected:
 	Matrix4d m_Q;										// Transformation matrix applied about the joint
@@ -90,8 +116,44 @@ protected:
 	std::vector<std::shared_ptr<Joint>> m_children;		// Children joints
 	virtual void update_() {}
 
+	// Articulated-body quantities in body space, used by the recursive solver
+	Eigen::MatrixXd m_Sb;								// Jacobian, Ad_ij * S
+	Matrix6d m_IA;										// Articulated inertia
+	Vector6d m_pA;										// Articulated bias force
+	Vector6d m_c;										// Bias acceleration
+	Vector6d m_a;										// Body acceleration
+	Eigen::MatrixXd m_U;								// IA * Sb
+	Eigen::MatrixXd m_Dinv;								// inv(Sb' * IA * Sb + armature)
+	Eigen::VectorXd m_u;								// Joint force minus projected bias
+
+	// The public functions above loop over this joint and the ones after it
+	// (or before it, for the children-first passes); these do one joint each.
+	// JointT overrides the virtual ones with fixed-size versions.
+	virtual void updatePosition_();
+	virtual void updateVelocity_();
+	virtual void computeArticulatedBias_(const Vector3d &grav);
+	virtual void computeArticulatedInertia_(double h);
+	virtual void computeArticulatedAcc_(Eigen::VectorXd &qddot);
+	virtual void computeJacProd_(const Eigen::VectorXd &x, Eigen::VectorXd &y);
+	virtual void computeJacDotProd_(const Eigen::VectorXd &x, Eigen::VectorXd &y, Eigen::VectorXd &ydot);
+	virtual void computeJacTransProd_(const Eigen::VectorXd &y, Eigen::VectorXd &x);
+
+	// Parts of the kernels that touch the parent or the children
+	void addArticulatedToParent_(const Matrix6d &Ia, const Vector6d &pa);
+	Vector6d computeParentAcc_() const;
+	Vector6d computeJacTransWrench_(const Eigen::VectorXd &y);
+
 private:
-	void scatterDofsNoUpdate(Eigen::VectorXd y, int nr);
+	Joint *forward() const;
+	Joint *backward() const;
+	template <typename Step> void forEachForward(Step step, bool isLevelSafe);
+	template <typename Step> void forEachBackward(Step step);
+	void drawAxes_(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, const std::shared_ptr<Program> progSimple, std::shared_ptr<MatrixStack> P) const;
+	void scatterDofsNoUpdate(const Eigen::VectorXd &y, int nr);
+	JointTree *m_tree;									// Flat tree built by World::init, not owned
+	int m_index;										// Position in m_tree
+	bool m_isQDirty;									// q changed since the last update
+	bool m_isQdotDirty;									// qdot changed since the last update
 	std::string m_name;
 	std::vector<std::shared_ptr<Joint> > m_children;	// Children joints
 	Vector6d m_alpha;									// For J'*x product
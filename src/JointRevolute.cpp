@@ -17,9 +17,32 @@ JointRevolute::JointRevolute() {
 
 
 JointRevolute::JointRevolute(std::shared_ptr<Body> body, Eigen::Vector3d axis, std::shared_ptr<Joint> parent):
-Joint(body, 1, parent)
+JointT<1>(body, parent)
 {
 	m_axis = axis;
+	// S is constant
+	m_S.block<3, 1>(0, 0) = m_axis;
+}
+
+void JointRevolute::init(int &nm, int &nr) {
+	Joint::init(nm, nr);
+	// E_pj0 is only valid once the world has set it, after construction
+	precompute();
+}
+
+void JointRevolute::precompute() {
+	// Computes the constant factors of E_pj = E_pj0 * [R(q) 0; 0 1], with
+	// R(q) = I + sin(q) [a] + (1 - cos(q)) [a]^2 as in SE3::aaToMat
+	m_A.setZero();
+	double mag = m_axis.norm();
+	if (mag > THRESH) {
+		m_A = SE3::bracket3(m_axis / mag);
+	}
+	m_AA = m_A * m_A;
+	m_R0 = E_pj0.block<3, 3>(0, 0);
+	m_p0 = E_pj0.block<3, 1>(0, 3);
+	m_R0A = m_R0 * m_A;
+	m_R0AA = m_R0 * m_AA;
 }
 
 void JointRevolute::load(const std::string &RESOURCE_DIR, std::string joint_shape) {
@@ -34,15 +57,40 @@ JointRevolute::~JointRevolute() {
 
 }
 
-void JointRevolute::updateSelf() {
-	Matrix3d R = SE3::aaToMat(m_axis, m_q(0));
-	Matrix4d Q;
-	Q.setIdentity();
-	Q.block<3, 3>(0, 0) = R;
-	m_Q = Q;
-	//E_pj = E_pj0 * Q;
-	
-	m_S.block<3, 1>(0, 0) = m_axis;
+void JointRevolute::updatePosition_() {
+	// Updates the transforms of this joint and the attached body in closed form
+	double s = sin(m_q(0));
+	double c1 = 1.0 - cos(m_q(0));
+	m_Q.block<3, 3>(0, 0) = Matrix3d::Identity() + s * m_A + c1 * m_AA;
+
+	RigidTransform T_pj(m_R0 + s * m_R0A + c1 * m_R0AA, m_p0);
+	RigidTransform T_jp = T_pj.inverse();
+	E_pj = T_pj.toMatrix();
+	E_jp = T_jp.toMatrix();
+	Ad_jp = T_jp.adjoint().toMatrix();
+
+	if (m_parent == nullptr) {
+		E_wj = E_pj;
+	}
+	else {
+		E_wj = (RigidTransform(m_parent->E_wj) * T_pj).toMatrix();
+	}
+	m_body->updatePosition();
+}
+
+void JointRevolute::updatePositionGeneric() {
+	m_Q.setIdentity();
+	m_Q.block<3, 3>(0, 0) = SE3::aaToMat(m_axis, m_q(0));
+	Joint::updatePosition_();
+}
+
+void JointRevolute::computeKinematics(const double *q, const double *, RigidTransform &T_pj, double *S, double *Sdot) const {
+	// Computes E_pj in closed form. S is constant.
+	double s = sin(q[0]);
+	double c1 = 1.0 - cos(q[0]);
+	T_pj = RigidTransform(m_R0 + s * m_R0A + c1 * m_R0AA, m_p0);
+	Vector6d::Map(S) = m_S.col(0);
+	Vector6d::Map(Sdot).setZero();
 }
 
 void JointRevolute::drawSelf(shared_ptr<MatrixStack> MV, const shared_ptr<Program> prog, const shared_ptr<Program> progSimple, shared_ptr<MatrixStack> P) const {
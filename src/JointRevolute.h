@@ -3,16 +3,21 @@
 #ifndef MUSCLEMASS_SRC_JOINTREVOLUTE_H_
 #define MUSCLEMASS_SRC_JOINTREVOLUTE_H_
 
-#include "Joint.h"
+#include "JointT.h"
+#include "RigidTransform.h"
 
 class SE3;
 class Body;
 
-class JointRevolute : public Joint {
+// Revolute joints update their transforms in closed form: E_pj0 is combined
+// with the axis once at init, so that E_pj = E_pj0 * exp(q [a]) only costs a
+// sin/cos pair and two 3x3 scalings, and E_jp and Ad_jp come from transposes.
+class JointRevolute : public JointT<1> {
 
 public:
 	JointRevolute();
 	JointRevolute(std::shared_ptr<Body> body, Eigen::Vector3d axis, std::shared_ptr<Joint> parent = nullptr);
+	void init(int &nm, int &nr);
 	void load(const std::string &RESOURCE_DIR, std::string joint_shape);
 	void drawSelf(std::shared_ptr<MatrixStack> MV, 
 		const std::shared_ptr<Program> prog, 
@@ -21,8 +26,26 @@ public:
 
 	virtual ~JointRevolute();
 
-	virtual void updateSelf();
+	void computeKinematics(const double *q, const double *qdot, RigidTransform &T_pj, double *S, double *Sdot) const;
 
+	// Updates this joint and its body alone, at the current q, with the
+	// generic path (Q from SE3::aaToMat) or with the closed form. Used by
+	// bench/Bench.cpp to check one against the other.
+	void updatePositionGeneric();
+	void updatePositionClosedForm() { updatePosition_(); }
+
+protected:
+	virtual void updatePosition_();
+
+private:
+	void precompute();
+
+	Eigen::Matrix3d m_A;		// [a] for the unit axis a
+	Eigen::Matrix3d m_AA;		// [a]^2
+	Eigen::Matrix3d m_R0;		// Rotation of E_pj0
+	Eigen::Matrix3d m_R0A;		// R0 * [a]
+	Eigen::Matrix3d m_R0AA;		// R0 * [a]^2
+	Eigen::Vector3d m_p0;		// Translation of E_pj0
 
 };
 
@@ -17,15 +17,22 @@ using json = nlohmann::json;
 const Eigen::Matrix4d JointSplineCurve::m_B = getB();
 const Matrix4x3d JointSplineCurve::m_B1 = getB1();
 const Matrix4x2d JointSplineCurve::m_B2 = getB2();
+const Matrix4d JointSplineCurve::m_Bsum = getBsum();
+const Matrix4x3d JointSplineCurve::m_B1sum = getB1sum();
+const Matrix4x2d JointSplineCurve::m_B2sum = getB2sum();
 
 
-JointSplineCurve::JointSplineCurve()
+JointSplineCurve::JointSplineCurve() :
+m_tabTol(0.0),
+m_tabH(0.0)
 {
 
 }
 
 JointSplineCurve::JointSplineCurve(shared_ptr<Body> body, shared_ptr<Joint> parent):
-Joint(body, 1, parent)
+JointT<1>(body, parent),
+m_tabTol(0.0),
+m_tabH(0.0)
 {
 
 
@@ -54,6 +61,75 @@ void JointSplineCurve::init(int &nm, int &nr) {
 	}
 	countDofs(nm, nr);
 
+	precompute();
+	if (m_tabTol > 0.0) {
+		tabulate();
+	}
+}
+
+void JointSplineCurve::precompute() {
+	// Caches the control frame data of each segment. Must be called again
+	// if control frames are added after init.
+	int ncfs = m_Cs.size();
+	m_segments.resize(ncfs);
+	for (int k = 0; k < ncfs; ++k) {
+		Segment &seg = m_segments[k];
+		seg.C = m_Cs[k];
+		for (int i = 1; i < 4; ++i) {
+			int ki = (k + i) % ncfs;
+			seg.dC[i - 1] = m_dCs[ki];
+			seg.expdC[i - 1] = TwistExp(m_dCs[ki]);
+		}
+	}
+	m_tabF.clear();
+	m_tabDF.clear();
+}
+
+void JointSplineCurve::tabulate() {
+	// Samples Q, S and their derivatives at evenly spaced q, doubling the
+	// number of samples per segment until cubic Hermite interpolation is
+	// within m_tabTol of the exact values. The error of the interpolated
+	// values peaks near the midpoints, and that of dS/dq near the quarter points.
+	int ncfs = m_Cs.size();
+	vector<Vector18d> F, DF;
+	double err = 0.0;
+	for (int m = 4; m <= 1024; m *= 2) {
+		int n = m * ncfs;
+		double h = 1.0 / m;
+		F.resize(n + 1);
+		DF.resize(n + 1);
+		for (int j = 0; j <= n; ++j) {
+			RigidTransform Q;
+			Vector6d S, dSdq;
+			evalExact(j * h, Q, S, dSdq);
+			// dQ/dq = Q * [S]
+			Matrix3d dR = Q.R * SE3::bracket3(S.segment<3>(0));
+			F[j] << Map<const Matrix<double, 9, 1>>(Q.R.data()), Q.p, S;
+			DF[j] << Map<const Matrix<double, 9, 1>>(dR.data()), Q.R * S.segment<3>(3), dSdq;
+		}
+		m_tabH = h;
+		m_tabF.swap(F);
+		m_tabDF.swap(DF);
+
+		err = 0.0;
+		for (int j = 0; j < n; ++j) {
+			for (int a = 1; a < 4; ++a) {
+				double q = (j + 0.25 * a) * h;
+				RigidTransform Q0, Q1;
+				Vector6d S0, S1, dSdq0, dSdq1;
+				evalExact(q, Q0, S0, dSdq0);
+				evalTable(q, Q1, S1, dSdq1);
+				err = max(err, (Q0.R - Q1.R).cwiseAbs().maxCoeff());
+				err = max(err, (Q0.p - Q1.p).cwiseAbs().maxCoeff());
+				err = max(err, (S0 - S1).cwiseAbs().maxCoeff());
+				err = max(err, (dSdq0 - dSdq1).cwiseAbs().maxCoeff());
+			}
+		}
+		if (err <= m_tabTol) {
+			return;
+		}
+	}
+	cout << "JointSplineCurve: tabulation error " << err << " is above the tolerance " << m_tabTol << endl;
 }
 
 JointSplineCurve:: ~JointSplineCurve() {
@@ -84,82 +160,48 @@ void JointSplineCurve::addControlFrame(Matrix4d C) {
 }
 
 void JointSplineCurve::updateSelf() {
-	m_Q = evalQ(m_q(0));
+	RigidTransform Q;
 	Vector6d S, dSdq;
-	evalS(m_q(0), S, dSdq);
+	eval(m_q(0), Q, S, dSdq);
+	m_Q = Q.toMatrix();
 	m_S = S;
 	m_Sdot = dSdq * m_qdot(0);
 
 }
 
+void JointSplineCurve::computeKinematics(const double *q, const double *qdot, RigidTransform &T_pj, double *S, double *Sdot) const {
+	// Computes E_pj, S and Sdot at q without changing the joint
+	RigidTransform Q;
+	Vector6d Sq, dSdq;
+	eval(q[0], Q, Sq, dSdq);
+	T_pj = RigidTransform(E_pj0) * Q;
+	Vector6d::Map(S) = Sq;
+	Vector6d::Map(Sdot) = dSdq * qdot[0];
+}
+
 double JointSplineCurve::Bsum(int i, double q) {
 	// Evaluates Btilde
 	Vector4d qvec;
-	Vector4d b;
 	qvec << 1, q, q * q, q * q * q;
-	if (i == 0) {
-		b = m_B.row(0) + m_B.row(1) + m_B.row(2) + m_B.row(3);
-	}
-	else if (i == 1) {
-		b = m_B.row(1) + m_B.row(2) + m_B.row(3);
-	}
-	else if (i == 2) {
-		b = m_B.row(2) + m_B.row(3);
-	}
-	else {
-		b = m_B.row(3);
-	}
-	double f = b.transpose() * qvec;
-	return f;
+	return m_Bsum.row(i) * qvec;
 }
 
 double JointSplineCurve::dBsum(int i, double q) {
 	// Evaluates dBtilde / dq
 	Vector3d qvec;
-	Vector3d b;
 	qvec << 1, 2 * q, 3 * q * q;
-	if (i == 0) {
-		b = m_B1.row(0) + m_B1.row(1) + m_B1.row(2) + m_B1.row(3);
-	}
-	else if (i == 1) {
-		b = m_B1.row(1) + m_B1.row(2) + m_B1.row(3);
-	}
-	else if (i == 2) {
-		b = m_B1.row(2) + m_B1.row(3);
-	}
-	else {
-		b = m_B1.row(3);
-	}
-	double df = b.transpose() * qvec;
-	return df;
+	return m_B1sum.row(i) * qvec;
 }
 
 double JointSplineCurve::d2Bsum(int i, double q) {
 	// Evaluates d ^ 2Btilde / dq ^ 2
 	Vector2d qvec;
 	qvec << 2, 6 * q;
-	Vector2d b;
-	if (i == 0) {
-		b = m_B2.row(0) + m_B2.row(1) + m_B2.row(2) + m_B2.row(3);
-	}
-	else if (i == 1) {
-		b = m_B2.row(1) + m_B2.row(2) + m_B2.row(3);
-	}
-	else if (i == 2) {
-		b = m_B2.row(2) + m_B2.row(3);
-	}
-	else {
-		b = m_B2.row(3);
-	}
-
-	double d2f = b.transpose() * qvec;
-	return d2f;
+	return m_B2sum.row(i) * qvec;
 }
 
-Matrix4d JointSplineCurve::evalQ(double q) const {
-	Matrix4d Q;
-
-	// Evaluate spline frame
+double JointSplineCurve::findSegment(double q, int &k) const {
+	// Finds the segment k of q and returns the local q in [0, 1]
 	int ncfs = m_Cs.size();
 	// Wrap around
 	int qmax = ncfs;
@@ -170,73 +212,88 @@ Matrix4d JointSplineCurve::evalQ(double q) const {
 		q -= qmax;
 	}
 
-	int k = int(floor(q)); // starting control frame (0-index)
+	k = int(floor(q)); // starting control frame (0-index)
 	if (k >= ncfs) {
 		k -= 1; // overflow
 	}
-
-	double q_ = q - k; // local q in [0, 1]
-	
-	Q = m_Cs[k];
-	for (int i = 1; i < 4; ++i) {
-		int ki = k + i;
-		if (ki > ncfs - 1) {
-			ki = ki - ncfs; // Wrap for cyclic
-		}
-		double Bsum = JointSplineCurve::Bsum(i, q_);
-		Matrix4d dC = SE3::bracket6(m_dCs[ki]);
-
-		Matrix4d dCBsum = dC * Bsum;
-		Q = Q * SE3::exp(dCBsum);
-	}
-
-	return Q;
+	return q - k;
 }
 
-void JointSplineCurve::evalS(double q, Vector6d &S, Vector6d &dSdq) {
+Matrix4d JointSplineCurve::evalQ(double q) const {
+	// Evaluates spline frame
+	RigidTransform Q;
+	Vector6d S, dSdq;
+	eval(q, Q, S, dSdq);
+	return Q.toMatrix();
+}
 
-	// Evaluates spline frame derivatives
-	int ncfs = m_Cs.size();
-	// Wrap around
-	int qmax = ncfs;
-	if (q < 0) {
-		q += qmax;
-	}
-	else if (q >= qmax) {
-		q -= qmax;
+void JointSplineCurve::eval(double q, RigidTransform &Q, Vector6d &S, Vector6d &dSdq) const {
+	// Evaluates spline frame and its derivatives, from the table if there is one
+	if (m_tabF.empty()) {
+		evalExact(q, Q, S, dSdq);
 	}
-
-	int k = int(floor(q)); // starting control frame 
-	if (k >= ncfs) {
-		k -= 1; // overflow
+	else {
+		evalTable(q, Q, S, dSdq);
 	}
+}
 
-	double q_ = q - k; // local q in [0, 1]
-	for (int i = 1; i < 4; ++i) {
-		int ki = k + i;
-		if (ki > ncfs - 1) {
-			ki = ki - ncfs; // Wrap for cyclic
-		}
-		Vector6d dC = m_dCs[ki];
-		double dBsum = JointSplineCurve::dBsum(i, q_);
-		double d2Bsum = JointSplineCurve::d2Bsum(i, q_);
-		if (i == 1) {
-			S = dC *dBsum;
-			dSdq = dC * d2Bsum;
-		}
-		else {
-			double Bsum = JointSplineCurve::Bsum(i, q_);
-			Vector6d dCBsum = dC * Bsum;
-			Matrix6d Ad = SE3::adjoint(SE3::inverse(SE3::exp(dCBsum)));
-			Matrix6d ad = SE3::ad(S);
-			Vector6d AdS = Ad * S;
-			S = dC * dBsum + AdS;
-			Vector6d addCdBsum = ad * dC * dBsum;
-			Vector6d AdSum = Ad *(dSdq + addCdBsum);
-			dSdq = dC * d2Bsum + AdSum;
-		}
+void JointSplineCurve::evalExact(double q, RigidTransform &Q, Vector6d &S, Vector6d &dSdq) const {
+	// Evaluates spline frame and derivatives from the cached segment
+	int k;
+	double q_ = findSegment(q, k);
+	const Segment &seg = m_segments[k];
+
+	// All four Btilde and their derivatives at once
+	Vector4d qvec, b;
+	Vector3d dqvec;
+	Vector2d d2qvec;
+	qvec << 1, q_, q_ * q_, q_ * q_ * q_;
+	dqvec << 1, 2 * q_, 3 * q_ * q_;
+	d2qvec << 2, 6 * q_;
+	b.noalias() = m_Bsum * qvec;
+	Vector4d db = m_B1sum * dqvec;
+	Vector4d d2b = m_B2sum * d2qvec;
+
+	Q = RigidTransform(seg.C);
+	S = seg.dC[0] * db(1);
+	dSdq = seg.dC[0] * d2b(1);
+	Q = Q * seg.expdC[0](b(1));
+	for (int i = 2; i < 4; ++i) {
+		const Vector6d &dC = seg.dC[i - 1];
+		RigidTransform E = seg.expdC[i - 1](b(i));
+		Adjoint Ad = E.adjoint();
+		Vector6d dCdBsum = dC * db(i);
+		Vector6d addCdBsum = Adjoint::ad(S, dCdBsum);
+		S = dCdBsum + Ad.applyInverse(S);
+		dSdq = dC * d2b(i) + Ad.applyInverse(dSdq + addCdBsum);
+		Q = Q * E;
 	}
+}
 
+void JointSplineCurve::evalTable(double q, RigidTransform &Q, Vector6d &S, Vector6d &dSdq) const {
+	// Cubic Hermite interpolation between the two table nodes around q. The
+	// interpolated rotation is orthonormal only to within the tolerance.
+	int ncfs = m_Cs.size();
+	if (q < 0) {
+		q += ncfs;
+	}
+	else if (q >= ncfs) {
+		q -= ncfs;
+	}
+	int n = (int)m_tabF.size() - 1;
+	int j = min(max(int(floor(q / m_tabH)), 0), n - 1);
+	double t = q / m_tabH - j;
+	double t2 = t * t;
+	double t3 = t2 * t;
+	double h = m_tabH;
+	Vector18d f = (2 * t3 - 3 * t2 + 1) * m_tabF[j] + (-2 * t3 + 3 * t2) * m_tabF[j + 1]
+		+ ((t3 - 2 * t2 + t) * h) * m_tabDF[j] + ((t3 - t2) * h) * m_tabDF[j + 1];
+	Vector6d dS = ((6 * t2 - 6 * t) / h) * (m_tabF[j].segment<6>(12) - m_tabF[j + 1].segment<6>(12))
+		+ (3 * t2 - 4 * t + 1) * m_tabDF[j].segment<6>(12) + (3 * t2 - 2 * t) * m_tabDF[j + 1].segment<6>(12);
+	Q.R = Map<const Matrix3d>(f.data());
+	Q.p = f.segment<3>(9);
+	S = f.segment<6>(12);
+	dSdq = dS;
 }
 
 void JointSplineCurve::drawSelf(shared_ptr<MatrixStack> MV, const shared_ptr<Program> prog, const shared_ptr<Program> progSimple, shared_ptr<MatrixStack> P) const {
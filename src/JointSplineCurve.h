@@ -6,12 +6,13 @@
 #ifndef MUSCLEMASS_SRC_JOINTSPLINECURVE_H_
 #define MUSCLEMASS_SRC_JOINTSPLINECURVE_H_
 
-#include "Joint.h"
+#include "JointT.h"
+#include "RigidTransform.h"
 
 class Body;
 class Shape;
 
-class JointSplineCurve : public Joint {
+class JointSplineCurve : public JointT<1> {
 
 public:
 	JointSplineCurve();
@@ -20,7 +21,10 @@ public:
 	void load(const std::string &RESOURCE_DIR, std::string joint_shape);
 	void init(int &nm, int &nr);
 	void addControlFrame(Eigen::Matrix4d C);
+	void setTabulationTolerance(double tol) { m_tabTol = tol; } // Tabulates Q and S at init when positive
+	int getTabulationSize() const { return (int)m_tabF.size(); }
 	void updateSelf();
+	void computeKinematics(const double *q, const double *qdot, RigidTransform &T_pj, double *S, double *Sdot) const;
 	void drawSelf(std::shared_ptr<MatrixStack> MV, const std::shared_ptr<Program> prog, const std::shared_ptr<Program> progSimple, std::shared_ptr<MatrixStack> P) const;
 
 	static double Bsum(int i, double q);
@@ -54,15 +58,63 @@ public:
 		return _B2;
 	}
 
+	// Row i is the sum of rows i to 3 of B, B1 or B2, so that the i-th Btilde
+	// and its derivatives are a single dot product with the monomials
+	static const Eigen::Matrix4d& getBsum() {
+		static Eigen::Matrix4d _Bsum(suffixSum(getB()));
+		return _Bsum;
+	}
+
+	static const Matrix4x3d& getB1sum() {
+		static Matrix4x3d _B1sum(suffixSum(getB1()));
+		return _B1sum;
+	}
+
+	static const Matrix4x2d& getB2sum() {
+		static Matrix4x2d _B2sum(suffixSum(getB2()));
+		return _B2sum;
+	}
+
+	template <typename Derived>
+	static typename Derived::PlainObject suffixSum(const Eigen::MatrixBase<Derived> &B) {
+		typename Derived::PlainObject S = B;
+		for (int i = (int)B.rows() - 2; i >= 0; --i) {
+			S.row(i) += S.row(i + 1);
+		}
+		return S;
+	}
+
 	static const Eigen::Matrix4d m_B; // Bspline coeffs
 	static const Matrix4x3d m_B1;	 // Bspline coeffs, 1st column removed
 	static const Matrix4x2d m_B2;	 // Bspline coeffs, 1,2rd colums removed
+	static const Eigen::Matrix4d m_Bsum;	// Suffix sums of the rows of m_B
+	static const Matrix4x3d m_B1sum;		// Suffix sums of the rows of m_B1
+	static const Matrix4x2d m_B2sum;		// Suffix sums of the rows of m_B2
 
 private:
+	// What a segment needs from the control frames: its first frame, and the
+	// twists of the next three frames with their exponentials
+	struct Segment {
+		Eigen::Matrix4d C;
+		Vector6d dC[3];
+		TwistExp expdC[3];
+	};
+	typedef Eigen::Matrix<double, 18, 1> Vector18d;	// R (column-major), p, S
+
 	std::vector<Eigen::Matrix4d> m_Cs;
 	std::vector<Vector6d> m_dCs;
+	std::vector<Segment> m_segments;		// Built by precompute()
+	double m_tabTol;						// Interpolation tolerance, 0 for exact evaluation
+	double m_tabH;							// Table spacing in q
+	std::vector<Vector18d> m_tabF;			// Q and S at the table nodes
+	std::vector<Vector18d> m_tabDF;			// Their derivatives wrt q
 	Eigen::Matrix4d evalQ(double q)const;
-	void evalS(double q, Vector6d &S, Vector6d &dSdq);
+	void eval(double q, RigidTransform &Q, Vector6d &S, Vector6d &dSdq) const;
+	void evalExact(double q, RigidTransform &Q, Vector6d &S, Vector6d &dSdq) const;
+	void evalTable(double q, RigidTransform &Q, Vector6d &S, Vector6d &dSdq) const;
+	double findSegment(double q, int &k) const;
+	void precompute();
+	void tabulate();
 	std::shared_ptr<Shape> m_jointSphereShape;
 
 };
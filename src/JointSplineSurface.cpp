@@ -22,132 +22,116 @@ JointSplineSurface::JointSplineSurface()
 }
 
 JointSplineSurface::JointSplineSurface(shared_ptr<Body> body, shared_ptr<Joint> parent) :
-	Joint(body, 2, parent)
+	JointT<2>(body, parent)
 {
+	for (int k = 0; k < 6; k++) {
+		m_cs[k].setZero();
+	}
+	precompute();
+}
 
-	//m_cs.resize(4, 4, 6);
-	m_cs.setZero();
+void JointSplineSurface::init(int &nm, int &nr) {
+	Joint::init(nm, nr);
+	precompute();
 }
 
 void JointSplineSurface::addControlFrame(int i, int j, Vector6d C) {
 	for (int k = 0; k < 6; k++) {
-		m_cs(i, j, k) = C(k);
+		m_cs[k](i, j) = C(k);
+	}
+}
+
+void JointSplineSurface::precompute() {
+	// Folds the B-spline basis into the control points. Must be called again
+	// if control frames are added after init.
+	for (int k = 0; k < 6; k++) {
+		m_Ps[k] = m_B.transpose() * m_cs[k] * m_B;
+		m_expE[k] = TwistExp(m_E.col(k));
+	}
+}
+
+void JointSplineSurface::evalPhi(const Vector2d &q, Vector6d &phi, Matrix6x2d &dphi, Matrix6x2d &d2phi0, Matrix6x2d &d2phi1) const {
+	// Evaluates the six coordinates phi_k and their first and second
+	// derivatives. Row k of dphi is dphi_k/dq, and row k of d2phij is d(dphi_k/dq)/dqj.
+	double q0 = q(0);
+	double q1 = q(1);
+	Vector4d m0, dm0, d2m0, m1, dm1, d2m1;
+	m0 << 1, q0, q0 * q0, q0 * q0 * q0;
+	dm0 << 0, 1, 2 * q0, 3 * q0 * q0;
+	d2m0 << 0, 0, 2, 6 * q0;
+	m1 << 1, q1, q1 * q1, q1 * q1 * q1;
+	dm1 << 0, 1, 2 * q1, 3 * q1 * q1;
+	d2m1 << 0, 0, 2, 6 * q1;
+	for (int k = 0; k < 6; k++) {
+		Vector4d Pm0 = m_Ps[k] * m0;
+		Vector4d Pdm0 = m_Ps[k] * dm0;
+		phi(k) = m1.dot(Pm0);
+		dphi(k, 0) = m1.dot(Pdm0);
+		dphi(k, 1) = dm1.dot(Pm0);
+		d2phi0(k, 0) = m1.dot(m_Ps[k] * d2m0);
+		d2phi0(k, 1) = dm1.dot(Pdm0);
+		d2phi1(k, 0) = d2phi0(k, 1);
+		d2phi1(k, 1) = d2m1.dot(Pm0);
 	}
 }
 
 Eigen::Matrix4d JointSplineSurface::evalQ(Eigen::Vector2d q)const {
 	// Evaluates spline frame
-	Matrix4d Q;
-	Q.setIdentity();
+	Vector6d phi;
+	Matrix6x2d dphi, d2phi0, d2phi1;
+	evalPhi(q, phi, dphi, d2phi0, d2phi1);
+	RigidTransform Q;
 	for (int i = 0; i < 6; ++i) {
-		Matrix4d Ci;	// 4 x 4 control point values
-		for (int ii = 0; ii < 4; ++ii) {
-			for (int jj = 0; jj < 4; ++jj) {
-				Ci(ii, jj) = m_cs(ii, jj, i); 
-			}
-		}
-
-		Vector6d ei = m_E.col(i);
-		double phi = JointSplineSurface::Cfun(Ci, q);
-		Vector6d eiphi = ei * phi;
-		Q = Q * SE3::exp(eiphi);
+		Q = Q * m_expE[i](phi(i));
 	}
-	return Q;
+	return Q.toMatrix();
 }
 
+void JointSplineSurface::evalS(const Vector2d &q, Matrix6x2d &S, Matrix6x2d &dSdq0, Matrix6x2d &dSdq1) const {
+	// Evaluates spline frame derivatives. Column i of dSdqj is dS_i/dqj.
+	Vector6d phi;
+	Matrix6x2d dphi, d2phi0, d2phi1;
+	evalPhi(q, phi, dphi, d2phi0, d2phi1);
 
-void JointSplineSurface::evalS(Eigen::Vector2d q, MatrixXd &S, Tensor6x2x2d &dSdq) {
-	// Evaluates spline frame derivatives
-
-	S.setZero();
-	//dSdq.resize(6, 2, 2);
-	dSdq.setZero();
 	Vector6d e1 = m_E.col(0);
-	//Eigen::array<int, 3> offsets = { 0, 0, 0 };
-	//Eigen::array<int, 3> extents = { 4, 4, 1 };
-	//Eigen::Tensor<double, 2> C1 = m_cs.slice(offsets, extents);
-	Matrix4d C0;	
-	for (int ii = 0; ii < 4; ++ii) {
-		for (int jj = 0; jj < 4; ++jj) {
-			C0(ii, jj) = m_cs(ii, jj, 0);
-		}
-	}
-
-
-	//Eigen::Matrix4d C1_mat = Tensor_to_Matrix(C1, 4, 4);
 	for (int i = 0; i < 2; i++) {
-		double dphi1i = JointSplineSurface::dCfun(C0, i, q);
-		S.col(i) = e1 * dphi1i;
-		for (int j = 0; j < 2; j++) {
-			double d2phiqij = JointSplineSurface::d2Cfun(C0, i, j, q);
-			Vector6d res = e1 * d2phiqij;
-			for (int t = 0; t < 6; t++) {
-				dSdq(t, i, j) = res(t);
-			}
-		}
+		S.col(i) = e1 * dphi(0, i);
+		dSdq0.col(i) = e1 * d2phi0(0, i);
+		dSdq1.col(i) = e1 * d2phi1(0, i);
 	}
 
 	for (int k = 1; k < 6; k++) {
 		Vector6d ek = m_E.col(k);
-	//	Eigen::array<int, 3> offsets = { 0, 0, k }; // 4x4 control point values
-	//	Eigen::array<int, 3> extents = { 4, 4, 1 };
-	//	Eigen::Tensor<double, 2> Ck = m_cs.slice(offsets, extents);
-	//	Eigen::Matrix4d Ck_mat = Tensor_to_Matrix(Ck, 4, 4);
-		Matrix4d Ck;
-		for (int ii = 0; ii < 4; ++ii) {
-			for (int jj = 0; jj < 4; ++jj) {
-				Ck(ii, jj) = m_cs(ii, jj, k);
-			}
-		}
-
-		double phik = JointSplineSurface::Cfun(Ck, q);
-		Vector6d ekphik = ek * phik;
-		Matrix6d Ad = SE3::adjoint(SE3::inverse(SE3::exp(ekphik)));
+		Adjoint Ad = m_expE[k](phi(k)).adjoint();
 		for (int i = 0; i < 2; ++i) {
-			double dphiki = JointSplineSurface::dCfun(Ck, i, q);
-			Matrix6d ad = SE3::ad(S.col(i));
-			S.col(i) = ek * dphiki + Ad * S.col(i);
-			for (int j = 0; j < 2; ++j) {
-				double d2phikij = JointSplineSurface::d2Cfun(Ck, i, j, q);
-				double dphikj = JointSplineSurface::dCfun(Ck, j, q);
-				Vector6d temp;
-				for (int t = 0; t < 6; t++) {
-					temp(t) = dSdq(t, i, j);
-				}
-
-				Vector6d res = ek * d2phikij + Ad * (temp + ad * ek * dphikj);
-
-				for (int t = 0; t < 6; t++) {
-					dSdq(t, i, j) = res(t);
-				}
-			}
+			Vector6d Si = S.col(i);
+			S.col(i) = ek * dphi(k, i) + Ad.applyInverse(Si);
+			Vector6d adek = Adjoint::ad(Si, ek);
+			dSdq0.col(i) = ek * d2phi0(k, i) + Ad.applyInverse(dSdq0.col(i) + adek * dphi(k, 0));
+			dSdq1.col(i) = ek * d2phi1(k, i) + Ad.applyInverse(dSdq1.col(i) + adek * dphi(k, 1));
 		}
 	}
 }
 
 void JointSplineSurface::updateSelf() {
 	m_Q = evalQ(m_q);
-	Tensor6x2x2d dSdq;
-	evalS(m_q, m_S, dSdq);
-
-	Matrix6x2d dSdq0;	
-	for (int ii = 0; ii < 6; ++ii) {
-		for (int jj = 0; jj < 2; ++jj) {
-			dSdq0(ii, jj) = dSdq(ii, jj, 0);
-		}
-	}
-
-	Matrix6x2d dSdq1;
-	for (int ii = 0; ii < 6; ++ii) {
-		for (int jj = 0; jj < 2; ++jj) {
-			dSdq1(ii, jj) = dSdq(ii, jj, 1);
-		}
-	}
-
+	Matrix6x2d S, dSdq0, dSdq1;
+	evalS(m_q, S, dSdq0, dSdq1);
+	m_S = S;
 	m_Sdot = dSdq0 * m_qdot(0) + dSdq1 * m_qdot(1);
 
 }
 
+void JointSplineSurface::computeKinematics(const double *q, const double *qdot, RigidTransform &T_pj, double *S, double *Sdot) const {
+	// Computes E_pj, S and Sdot at q without changing the joint
+	Vector2d qv(q[0], q[1]);
+	Matrix6x2d Sq, dSdq0, dSdq1;
+	evalS(qv, Sq, dSdq0, dSdq1);
+	T_pj = RigidTransform(E_pj0) * RigidTransform(evalQ(qv));
+	Matrix6x2d::Map(S) = Sq;
+	Matrix6x2d::Map(Sdot) = dSdq0 * qdot[0] + dSdq1 * qdot[1];
+}
+
 double JointSplineSurface::Cfun(Eigen::Matrix4d C, Eigen::Vector2d q) {
 	double q0 = q(0);
 	double q1 = q(1);
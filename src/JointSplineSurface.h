@@ -6,19 +6,22 @@
 #ifndef MUSCLEMASS_SRC_JOINTSPLINESURFACE_H_
 #define MUSCLEMASS_SRC_JOINTSPLINESURFACE_H_
 
-#include "Joint.h"
+#include "JointT.h"
+#include "RigidTransform.h"
 
 class Body;
 
-class JointSplineSurface : public Joint {
+class JointSplineSurface : public JointT<2> {
 
 public:
 	JointSplineSurface();
 	JointSplineSurface(std::shared_ptr<Body> body, std::shared_ptr<Joint> parent = nullptr);
 	virtual ~JointSplineSurface();
 
+	void init(int &nm, int &nr);
 	void addControlFrame(int i, int j, Vector6d C);
 	void updateSelf();
+	void computeKinematics(const double *q, const double *qdot, RigidTransform &T_pj, double *S, double *Sdot) const;
 	void drawSelf(std::shared_ptr<MatrixStack> MV, 
 		const std::shared_ptr<Program> prog, 
 		const std::shared_ptr<Program> progSimple, 
@@ -52,10 +55,14 @@ public:
 	static const Matrix6d m_E;		  // 6 basis twists in Eq.(25)
 
 private:
-	Tensor4x4x6d m_cs;
+	Eigen::Matrix4d m_cs[6];		// Control point values of each basis twist
+	Eigen::Matrix4d m_Ps[6];		// B' * m_cs[k] * B, so that phi_k(q) = q1vec' * m_Ps[k] * q0vec
+	TwistExp m_expE[6];				// exp(t * E.col(k))
 
+	void precompute();
+	void evalPhi(const Eigen::Vector2d &q, Vector6d &phi, Matrix6x2d &dphi, Matrix6x2d &d2phi0, Matrix6x2d &d2phi1) const;
 	Eigen::Matrix4d evalQ(Eigen::Vector2d q)const;
-	void evalS(Eigen::Vector2d q, Eigen::MatrixXd &S, Tensor6x2x2d &dSdq);
+	void evalS(const Eigen::Vector2d &q, Matrix6x2d &S, Matrix6x2d &dSdq0, Matrix6x2d &dSdq1) const;
 
 };
 
@@ -0,0 +1,157 @@
+#pragma once
+// JointT A joint with a compile-time number of DOFs
+//    World and the solvers only see Joint. Joint types with a fixed number of
+//    DOFs derive from JointT<NDOF>, which views S, Sdot and the articulated-body
+//    quantities as 6 x NDOF matrices, so that the per-joint kernels of the
+//    recursive passes and of the Jacobian are fixed-size and allocation free.
+//    The inverse of the NDOF x NDOF joint-space inertia is then in closed form.
+
+#ifndef REDUCEDCOORD_SRC_JOINTT_H_
+#define REDUCEDCOORD_SRC_JOINTT_H_
+#include <memory>
+#define EIGEN_DONT_ALIGN_STATICALLY
+
+#include <Eigen/Dense>
+#include "MLCommon.h"
+#include "Joint.h"
+#include "Body.h"
+#include "RigidTransform.h"
+
+template <int NDOF>
+class JointT : public Joint {
+public:
+	typedef Eigen::Matrix<double, 6, NDOF> Matrix6xN;
+	typedef Eigen::Matrix<double, NDOF, NDOF> MatrixN;
+	typedef Eigen::Matrix<double, NDOF, 1> VectorN;
+
+	JointT() {}
+	JointT(std::shared_ptr<Body> body, std::shared_ptr<Joint> parent = nullptr) :
+		Joint(body, NDOF, parent)
+	{
+		// The kernels map these without resizing them
+		m_Sb.setZero(6, NDOF);
+		m_U.setZero(6, NDOF);
+		m_Dinv.setZero(NDOF, NDOF);
+		m_u.setZero(NDOF);
+	}
+	virtual ~JointT() {}
+
+	virtual void computeJacobianBlock(Eigen::Matrix<double, 6, Eigen::Dynamic> &J, Eigen::Matrix<double, 6, Eigen::Dynamic> &Jdot, int col, Vector6d &v) const
+	{
+		// Computes Ad_ij * S and Ad_ij * Sdot into the NDOF columns at col
+		Eigen::Map<Matrix6xN> Jself(J.col(col).data());
+		Eigen::Map<Matrix6xN> Jdotself(Jdot.col(col).data());
+		Jself.noalias() = m_body->Ad_ij * S();
+		Jdotself.noalias() = m_body->Ad_ij * Sdot();
+		v.noalias() = Jself * qdot();
+	}
+
+protected:
+	// Fixed-size views of the members that Joint sizes at run time
+	Eigen::Map<const Matrix6xN> S() const { return Eigen::Map<const Matrix6xN>(m_S.data()); }
+	Eigen::Map<const Matrix6xN> Sdot() const { return Eigen::Map<const Matrix6xN>(m_Sdot.data()); }
+	Eigen::Map<const VectorN> q() const { return Eigen::Map<const VectorN>(m_q.data()); }
+	Eigen::Map<const VectorN> qdot() const { return Eigen::Map<const VectorN>(m_qdot.data()); }
+
+	virtual void updateVelocity_()
+	{
+		// Updates the velocities of this joint and the attached body
+		V.noalias() = S() * qdot();
+		if (m_parent != nullptr) {
+			V += Ad_jp * m_parent->V;
+		}
+		m_body->updateVelocity();
+	}
+
+	virtual void computeArticulatedBias_(const Vector3d &grav)
+	{
+		// Computes the bias acceleration and the body's own inertia and bias force
+		Eigen::Map<Matrix6xN> Sb(m_Sb.data());
+		Sb.noalias() = m_body->Ad_ij * S();
+		VectorN qd = qdot();
+		Vector6d vrel = Sb * qd;
+		Vector6d Sdotqdot = Sdot() * qd;
+		m_c = m_body->Ad_ij * Sdotqdot + Adjoint::ad(m_body->phi, vrel);
+		m_IA = Matrix6d(m_body->I_i.asDiagonal());
+		m_pA = -m_body->computeForceGrav(grav);
+	}
+
+	virtual void computeArticulatedInertia_(double h)
+	{
+		// Projects the articulated inertia and bias force onto the parent, with
+		// the joint damping and stiffness as an armature. See Joint.
+		Eigen::Map<const Matrix6xN> Sb(m_Sb.data());
+		Eigen::Map<Matrix6xN> U(m_U.data());
+		Eigen::Map<MatrixN> Dinv(m_Dinv.data());
+		Eigen::Map<VectorN> u(m_u.data());
+		U.noalias() = m_IA * Sb;
+		u.noalias() = -Sb.transpose() * m_pA;
+		MatrixN D = Sb.transpose() * U;
+		if (presc == false) {
+			u += Eigen::Map<const VectorN>(m_tau.data()) - m_Kr * q() - (m_Dr + h * m_Kr) * qdot();
+			D.diagonal().array() += h * m_Dr + h * h * m_Kr;
+		}
+		Dinv = D.inverse();
+
+		if (m_parent != nullptr) {
+			Matrix6xN UDinv = U * Dinv;
+			Matrix6d Ia = m_IA;
+			Ia.noalias() -= UDinv * U.transpose();
+			Vector6d pa = m_pA + Ia * m_c;
+			pa.noalias() += UDinv * u;
+			addArticulatedToParent_(Ia, pa);
+		}
+	}
+
+	virtual void computeArticulatedAcc_(Eigen::VectorXd &qddot)
+	{
+		// Computes the joint and body accelerations
+		Eigen::Map<const Matrix6xN> Sb(m_Sb.data());
+		Eigen::Map<const Matrix6xN> U(m_U.data());
+		Eigen::Map<const MatrixN> Dinv(m_Dinv.data());
+		Eigen::Map<const VectorN> u(m_u.data());
+		m_a = computeParentAcc_();
+		VectorN qdd = Dinv * (u - U.transpose() * m_a);
+		qddot.segment<NDOF>(idxR) = qdd;
+		m_a.noalias() += Sb * qdd;
+	}
+
+	virtual void computeJacProd_(const Eigen::VectorXd &x, Eigen::VectorXd &y)
+	{
+		// Computes the rows of this joint's body from the parent body's rows
+		Vector6d Sx = S() * x.segment<NDOF>(idxR);
+		Vector6d yi = m_body->Ad_ij * Sx;
+		if (m_parent != nullptr) {
+			yi += m_body->Ad_ip * y.segment<6>(m_parent->getBody()->idxM);
+		}
+		y.segment<6>(m_body->idxM) = yi;
+	}
+
+	virtual void computeJacDotProd_(const Eigen::VectorXd &x, Eigen::VectorXd &y, Eigen::VectorXd &ydot)
+	{
+		// Computes the rows of this joint's body. See Joint.
+		VectorN xi = x.segment<NDOF>(idxR);
+		Vector6d Sx = S() * xi;
+		Vector6d Sdotx = Sdot() * xi;
+		Vector6d Sqdot = S() * qdot();
+		Vector6d yi = m_body->Ad_ij * Sx;
+		Vector6d ydoti = m_body->Ad_ij * Sdotx;
+		if (m_parent != nullptr) {
+			int idxM_P = m_parent->getBody()->idxM;
+			Vector6d yp = m_body->Ad_ip * y.segment<6>(idxM_P);
+			yi += yp;
+			ydoti += m_body->Ad_ip * ydot.segment<6>(idxM_P) - Adjoint::ad(m_body->Ad_ij * Sqdot, yp);
+		}
+		y.segment<6>(m_body->idxM) = yi;
+		ydot.segment<6>(m_body->idxM) = ydoti;
+	}
+
+	virtual void computeJacTransProd_(const Eigen::VectorXd &y, Eigen::VectorXd &x)
+	{
+		// Computes this joint's rows from its body's rows and its children's sums
+		Vector6d wrench = computeJacTransWrench_(y);
+		x.segment<NDOF>(idxR).noalias() = S().transpose() * wrench;
+	}
+};
+
+#endif // REDUCEDCOORD_SRC_JOINTT_H_
@@ -0,0 +1,182 @@
+#include "JointTree.h"
+
+#include <iostream>
+#include <unordered_map>
+#include <algorithm>
+
+#include "Joint.h"
+#include "Body.h"
+#include "TaskPool.h"
+
+using namespace std;
+
+void JointTree::build(vector<shared_ptr<Joint> > &joints) {
+	// Emits each joint right after its not yet emitted ancestors. The ancestors
+	// are found by walking up the parent pointers, so deep chains need no stack.
+	int n = (int)joints.size();
+	unordered_map<const Joint *, int> input;
+	for (int k = 0; k < n; k++) {
+		input[joints[k].get()] = k;
+	}
+
+	vector<bool> isEmitted(n, false);
+	vector<shared_ptr<Joint> > sorted;
+	sorted.reserve(n);
+	vector<int> path;
+	for (int k = 0; k < n; k++) {
+		path.clear();
+		int a = k;
+		while (a >= 0 && !isEmitted[a]) {
+			path.push_back(a);
+			auto parent = joints[a]->getParent();
+			auto it = (parent != nullptr) ? input.find(parent.get()) : input.end();
+			a = (it != input.end()) ? it->second : -1;
+		}
+		for (int p = (int)path.size() - 1; p >= 0; p--) {
+			isEmitted[path[p]] = true;
+			sorted.push_back(joints[path[p]]);
+		}
+	}
+
+	// Groups the joints by root. The sort is stable, so parents still come
+	// before their children.
+	unordered_map<const Joint *, int> root;
+	vector<int> rootOrder;
+	for (int k = 0; k < n; k++) {
+		const Joint *joint = sorted[k].get();
+		auto parent = joint->getParent();
+		auto it = (parent != nullptr) ? root.find(parent.get()) : root.end();
+		if (it != root.end()) {
+			root[joint] = it->second;
+		}
+		else {
+			root[joint] = (int)rootOrder.size();
+			rootOrder.push_back(k);
+		}
+	}
+	stable_sort(sorted.begin(), sorted.end(), [&](const shared_ptr<Joint> &a, const shared_ptr<Joint> &b) {
+		return root[a.get()] < root[b.get()];
+	});
+	joints = sorted;
+
+	// Index the sorted joints
+	m_joints.resize(n);
+	m_bodies.resize(n);
+	m_parents.resize(n);
+	m_depths.resize(n);
+	m_idxR.resize(n);
+	m_ndof.resize(n);
+	m_idxM.resize(n);
+	m_pathStarts.resize(n);
+	m_paths.clear();
+	m_maxDepth = 0;
+	unordered_map<const Joint *, int> index;
+	for (int k = 0; k < n; k++) {
+		Joint *joint = joints[k].get();
+		index[joint] = k;
+		m_joints[k] = joint;
+
+		m_parents[k] = -1;
+		auto parent = joint->getParent();
+		if (parent != nullptr) {
+			auto it = index.find(parent.get());
+			if (it != index.end()) {
+				m_parents[k] = it->second;
+			}
+			else {
+				cout << "JointTree: parent of " << joint->getName() << " is not in the world" << endl;
+			}
+		}
+		m_depths[k] = (m_parents[k] < 0) ? 0 : m_depths[m_parents[k]] + 1;
+		m_maxDepth = max(m_maxDepth, m_depths[k]);
+
+		// The root path extends the parent's
+		m_pathStarts[k] = (int)m_paths.size();
+		if (m_parents[k] >= 0) {
+			int p = m_parents[k];
+			for (int a = 0; a <= m_depths[p]; a++) {
+				m_paths.push_back(m_paths[m_pathStarts[p] + a]);
+			}
+		}
+		m_paths.push_back(k);
+
+		// A null joint has neither a body nor DOFs
+		Body *body = joint->getBody().get();
+		m_bodies[k] = body;
+		m_idxR[k] = (body != nullptr) ? joint->idxR : 0;
+		m_ndof[k] = (body != nullptr) ? joint->m_ndof : 0;
+		m_idxM[k] = (body != nullptr) ? body->idxM : -1;
+		joint->setTree(this, k);
+	}
+
+	// Subtree ranges
+	m_rootStarts.clear();
+	for (int k = 0; k < n; k++) {
+		if (m_parents[k] < 0) {
+			m_rootStarts.push_back(k);
+		}
+	}
+	m_rootStarts.push_back(n);
+
+	// Depth levels, by counting sort
+	m_levelStarts.assign(m_maxDepth + 2, 0);
+	for (int k = 0; k < n; k++) {
+		m_levelStarts[m_depths[k] + 1]++;
+	}
+	m_maxWidth = 0;
+	for (int d = 0; d <= m_maxDepth; d++) {
+		m_maxWidth = max(m_maxWidth, m_levelStarts[d + 1]);
+		m_levelStarts[d + 1] += m_levelStarts[d];
+	}
+	m_levels.resize(n);
+	vector<int> fill(m_levelStarts.begin(), m_levelStarts.end() - 1);
+	for (int k = 0; k < n; k++) {
+		m_levels[fill[m_depths[k]]++] = k;
+	}
+	m_jacobian.init(this);
+	m_inverseDynamics.init(this);
+}
+
+void JointTree::forEach(const function<void(int)> &step, bool isReverse, bool isLevelSafe) const {
+	// Picks the widest parallelism the step allows
+	int n = getNumJoints();
+	int nroots = getNumRoots();
+	if (m_pool != nullptr && nroots > 1) {
+		m_pool->parallelFor(nroots, [&](int r) {
+			if (isReverse) {
+				for (int k = m_rootStarts[r + 1] - 1; k >= m_rootStarts[r]; k--) {
+					step(k);
+				}
+			}
+			else {
+				for (int k = m_rootStarts[r]; k < m_rootStarts[r + 1]; k++) {
+					step(k);
+				}
+			}
+		});
+	}
+	else if (m_pool != nullptr && isLevelSafe && !isReverse && m_maxWidth >= m_minLevelWidth) {
+		for (int d = 0; d <= m_maxDepth; d++) {
+			int begin = m_levelStarts[d];
+			int width = m_levelStarts[d + 1] - begin;
+			if (width >= m_minLevelWidth) {
+				m_pool->parallelFor(width, [&](int i) { step(m_levels[begin + i]); });
+			}
+			else {
+				for (int i = 0; i < width; i++) {
+					step(m_levels[begin + i]);
+				}
+			}
+		}
+	}
+	else if (isReverse) {
+		for (int k = n - 1; k >= 0; k--) {
+			step(k);
+		}
+	}
+	else {
+		for (int k = 0; k < n; k++) {
+			step(k);
+		}
+	}
+}
@@ -0,0 +1,98 @@
+#pragma once
+// JointTree Flat, parent-before-child view of the kinematic tree
+//    Built once by World::init. The joints are stored contiguously in
+//    topological order together with their parent index and DOF layout, so
+//    that every traversal is a plain loop over an array instead of a recursion
+//    through the next/prev pointers. The joints stay owned by the World; the
+//    tree only holds raw pointers to them. The root path of every joint is
+//    precomputed as well, and drives the block-sparse Jacobian. The tree also
+//    holds the inverse dynamics, which walks it with its own state.
+//    A world may hold several trees. Each root's subtree is kept contiguous,
+//    so that with a task pool the subtrees can be processed in parallel, and
+//    within one tree the joints of a depth level can be.
+
+#ifndef REDUCEDCOORD_SRC_JOINTTREE_H_
+#define REDUCEDCOORD_SRC_JOINTTREE_H_
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "BlockJacobian.h"
+#include "InverseDynamics.h"
+
+class Joint;
+class Body;
+class TaskPool;
+
+class JointTree
+{
+public:
+	JointTree() : m_maxDepth(0), m_maxWidth(0), m_pool(nullptr), m_minLevelWidth(8) {}
+	virtual ~JointTree() {}
+
+	// Reorders joints parent-before-child and subtree by subtree, keeping the
+	// given order wherever it is already valid, and indexes them. Must be
+	// called after the DOFs are counted.
+	void build(std::vector<std::shared_ptr<Joint> > &joints);
+
+	// Not owned. Levels narrower than minLevelWidth are processed serially.
+	void setTaskPool(TaskPool *pool, int minLevelWidth = 8) { m_pool = pool; m_minLevelWidth = minLevelWidth; }
+	bool isParallel() const { return m_pool != nullptr; }
+
+	// Calls step(k) for every joint, parents before children, or children
+	// before parents if isReverse. With a task pool, the subtrees of different
+	// roots run in parallel. A single tree is processed one depth level at a
+	// time, in parallel within a level, if isLevelSafe: the step may then only
+	// read from the parent, and write to the joint itself.
+	void forEach(const std::function<void(int)> &step, bool isReverse = false, bool isLevelSafe = false) const;
+
+	int getNumJoints() const { return (int)m_joints.size(); }
+	int getMaxDepth() const { return m_maxDepth; }
+
+	// Returns nullptr outside of [0, getNumJoints())
+	Joint *getJoint(int k) const { return (k >= 0 && k < (int)m_joints.size()) ? m_joints[k] : nullptr; }
+	Body *getBody(int k) const { return m_bodies[k]; }
+	int getParent(int k) const { return m_parents[k]; }		// -1 for a root
+	int getDepth(int k) const { return m_depths[k]; }
+	int getIdxR(int k) const { return m_idxR[k]; }
+	int getNdof(int k) const { return m_ndof[k]; }
+	int getIdxM(int k) const { return m_idxM[k]; }				// -1 if there is no body
+
+	const std::vector<int> &getParents() const { return m_parents; }
+
+	// Root r's subtree is [getRootBegin(r), getRootEnd(r))
+	int getNumRoots() const { return (int)m_rootStarts.size() - 1; }
+	int getRootBegin(int r) const { return m_rootStarts[r]; }
+	int getRootEnd(int r) const { return m_rootStarts[r + 1]; }
+	int getMaxWidth() const { return m_maxWidth; }		// Most joints at one depth
+
+	// Root path of joint k: getDepth(k) + 1 joint indices, root first and k last
+	const int *getPath(int k) const { return &m_paths[m_pathStarts[k]]; }
+	int getPathLength(int k) const { return m_depths[k] + 1; }
+	int getTotalPathLength() const { return (int)m_paths.size(); }
+
+	BlockJacobian &getJacobian() { return m_jacobian; }
+	const InverseDynamics &getInverseDynamics() const { return m_inverseDynamics; }
+
+private:
+	std::vector<Joint *> m_joints;
+	std::vector<Body *> m_bodies;
+	std::vector<int> m_parents;
+	std::vector<int> m_depths;
+	std::vector<int> m_idxR;
+	std::vector<int> m_ndof;
+	std::vector<int> m_idxM;
+	std::vector<int> m_paths;			// Root paths of all joints, back to back
+	std::vector<int> m_pathStarts;
+	std::vector<int> m_rootStarts;		// First joint of each root's subtree, and n
+	std::vector<int> m_levels;			// Joint indices by depth
+	std::vector<int> m_levelStarts;		// First entry of each depth in m_levels, and n
+	int m_maxDepth;
+	int m_maxWidth;
+	TaskPool *m_pool;
+	int m_minLevelWidth;
+	BlockJacobian m_jacobian;
+	InverseDynamics m_inverseDynamics;
+};
+
+#endif // REDUCEDCOORD_SRC_JOINTTREE_H_
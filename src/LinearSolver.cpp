@@ -0,0 +1,89 @@
+#include "LinearSolver.h"
+
+using namespace std;
+using namespace Eigen;
+
+static void hashCombine(size_t &seed, size_t v) {
+	seed ^= v + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+LinearSolver::LinearSolver(bool isSymmetric) :
+	m_isSymmetric(isSymmetric),
+	m_maxCached(16)
+{
+
+}
+
+size_t LinearSolver::hashPattern(const SparseMatrixd &A, size_t seed) {
+	// Hashes the sparsity pattern of a compressed matrix
+	hashCombine(seed, (size_t)A.rows());
+	hashCombine(seed, (size_t)A.cols());
+	hashCombine(seed, (size_t)A.nonZeros());
+	const int *outer = A.outerIndexPtr();
+	const int *inner = A.innerIndexPtr();
+	for (int k = 0; k <= A.outerSize(); k++) {
+		hashCombine(seed, (size_t)outer[k]);
+	}
+	for (int k = 0; k < (int)A.nonZeros(); k++) {
+		hashCombine(seed, (size_t)inner[k]);
+	}
+	return seed;
+}
+
+bool LinearSolver::compute(const SparseMatrixd &A, size_t key) {
+	// Factors A, reusing the symbolic analysis cached for its topology, and
+	// returns false if the numeric factorization failed (see getStats()).
+	// The key identifies the topology (e.g. the number of constraints), and the
+	// pattern of A is folded in so that a stale analysis is never reused.
+	key = hashPattern(A, key);
+	auto it = m_cache.find(key);
+	if (it == m_cache.end()) {
+		m_stats.misses++;
+		if ((int)m_cache.size() >= m_maxCached) {
+			// Simple eviction: topologies are revisited often but rarely many at once
+			m_cache.clear();
+		}
+		auto factorization = make_shared<Factorization>();
+		if (m_isSymmetric) {
+			factorization->ldlt.analyzePattern(A);
+		}
+		else {
+			factorization->lu.analyzePattern(A);
+		}
+		it = m_cache.insert(make_pair(key, factorization)).first;
+	}
+	else {
+		m_stats.hits++;
+	}
+	m_current = it->second;
+
+	bool success;
+	if (m_isSymmetric) {
+		m_current->ldlt.factorize(A);
+		success = m_current->ldlt.info() == Success;
+	}
+	else {
+		m_current->lu.factorize(A);
+		success = m_current->lu.info() == Success;
+	}
+	if (!success) {
+		m_stats.failures++;
+	}
+	return success;
+}
+
+void LinearSolver::solve(const VectorXd &b, VectorXd &x) const {
+	// Solves with the most recent factorization
+	if (m_isSymmetric) {
+		x = m_current->ldlt.solve(b);
+	}
+	else {
+		x = m_current->lu.solve(b);
+	}
+}
+
+void LinearSolver::clear() {
+	// Drops all cached analyses, e.g. after the world is rebuilt
+	m_cache.clear();
+	m_current = nullptr;
+}
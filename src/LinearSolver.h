@@ -0,0 +1,55 @@
+#pragma once
+// LinearSolver Sparse direct solver that caches the symbolic factorization
+//    The ordering and symbolic analysis are computed once per topology and
+//    reused, so that each step only performs the numeric factorization.
+
+#ifndef REDUCEDCOORD_SRC_LINEARSOLVER_H_
+#define REDUCEDCOORD_SRC_LINEARSOLVER_H_
+#include <vector>
+#include <memory>
+#include <map>
+#define EIGEN_DONT_ALIGN_STATICALLY
+
+#include <Eigen/Dense>
+#include <Eigen/SparseCholesky>
+#include <Eigen/SparseLU>
+#include "MLCommon.h"
+
+struct LinearSolverStats {
+	int hits;			// Numeric factorizations that reused a cached analysis
+	int misses;			// Symbolic analyses computed
+	int failures;		// Numeric factorizations that failed
+
+	LinearSolverStats() : hits(0), misses(0), failures(0) {}
+};
+
+class LinearSolver
+{
+public:
+	LinearSolver(bool isSymmetric = true);
+	virtual ~LinearSolver() {}
+
+	bool compute(const SparseMatrixd &A, size_t key = 0);
+	void solve(const Eigen::VectorXd &b, Eigen::VectorXd &x) const;
+	void clear();
+
+	void setMaxCached(int maxCached) { m_maxCached = maxCached; }
+	const LinearSolverStats &getStats() const { return m_stats; }
+	void resetStats() { m_stats = LinearSolverStats(); }
+
+	static size_t hashPattern(const SparseMatrixd &A, size_t seed = 0);
+
+private:
+	struct Factorization {
+		Eigen::SimplicialLDLT<SparseMatrixd> ldlt;		// Symmetric positive definite systems
+		Eigen::SparseLU<SparseMatrixd> lu;				// Indefinite systems such as the KKT matrix
+	};
+
+	bool m_isSymmetric;
+	int m_maxCached;
+	std::map<size_t, std::shared_ptr<Factorization> > m_cache;
+	std::shared_ptr<Factorization> m_current;
+	LinearSolverStats m_stats;
+};
+
+#endif // REDUCEDCOORD_SRC_LINEARSOLVER_H_
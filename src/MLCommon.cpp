@@ -69,6 +69,14 @@ bool rayTriangleIntersects(Eigen::Vector3d v1, Eigen::Vector3d v2, Eigen::Vector
 	return false;
 }
 
+void insertBlock(std::vector<Tripletd> &triplets, int row, int col, const Eigen::MatrixXd &block) {
+	for (int j = 0; j < block.cols(); j++) {
+		for (int i = 0; i < block.rows(); i++) {
+			triplets.push_back(Tripletd(row + i, col + j, block(i, j)));
+		}
+	}
+}
+
 void eigen_sym(Eigen::Matrix3d &a, Eigen::Vector3d &eig_val, Eigen::Matrix3d &eig_vec) {
 	Eigen::EigenSolver<Eigen::Matrix3d> es(a);
 
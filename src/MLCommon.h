@@ -7,6 +7,7 @@
 #define EIGEN_DONT_ALIGN_STATICALLY
 #include <Eigen/Dense>
 #include <Eigen/Eigenvalues> 
+#include <Eigen/Sparse>
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
@@ -32,6 +33,9 @@ typedef Eigen::Matrix<double, 6, 6> Matrix6d;
 typedef Eigen::Matrix<double, 9, 9> Matrix9d;
 typedef Eigen::Matrix<double, 12, 12> Matrix12d;
 
+typedef Eigen::Matrix<double, 2, 6> Matrix2x6d;
+
+typedef Eigen::Matrix<double, 3, 2> Matrix3x2d;
 typedef Eigen::Matrix<double, 3, 4> Matrix3x4d;
 typedef Eigen::Matrix<double, 3, 6> Matrix3x6d;
 typedef Eigen::Matrix<double, 3, 12> Matrix3x12d;
@@ -44,18 +48,34 @@ typedef Eigen::Matrix<double, 5, 6> Matrix5x6d;
 typedef Eigen::Matrix<double, 6, 2> Matrix6x2d;
 typedef Eigen::Matrix<double, 6, 3> Matrix6x3d;
 
+typedef Eigen::SparseMatrix<double> SparseMatrixd;
+typedef Eigen::Triplet<double> Tripletd;
+
 typedef Eigen::TensorFixedSize<double, Eigen::Sizes<4, 4, 6>> Tensor4x4x6d;
 typedef Eigen::TensorFixedSize<double, Eigen::Sizes<6, 2, 2>> Tensor6x2x2d;
 
-enum Integrator { REDMAX_EULER, REDUCED_ODE45, REDMAX_ODE45 };
+enum Integrator { REDMAX_EULER, REDUCED_ODE45, REDMAX_ODE45, REDUCED_EULER };
+enum EqualitySolver { EQ_AUTO, EQ_KKT, EQ_RANGE_SPACE, EQ_NULL_SPACE };
+enum QPSolver { QP_ACTIVE_SET, QP_MOSEK };
 enum Material {LINEAR, CO_ROTATED, STVK, NEO_HOOKEAN, MOONEY_RIVLIN};
 enum Axis {X_AXIS, Y_AXIS, Z_AXIS};
+enum FEMAssembly { FEM_COLORED, FEM_BUFFERED };	// How parallel tet loops avoid write conflicts, see SoftBody::setAssembly
 
 struct Energy {
 	double K;
 	double V;
 };
 
+// Energy and momentum of the whole world at time t, filled by the solver's
+// force passes on the steps picked by Solver::setEnergyMonitor
+struct EnergySample {
+	double t;
+	Energy energy;
+	Vector6d momentum;	// Angular then linear, about the world origin
+
+	EnergySample() : t(0.0), momentum(Vector6d::Zero()) { energy.K = 0.0; energy.V = 0.0; }
+};
+
 
 // Eigen types to/from GLM types
 glm::mat3 eigen_to_glm(const Eigen::Matrix3d &m);
@@ -91,6 +111,10 @@ int SVD(Eigen::Matrix3d &F,
 	double sv_eps,
 	int modifiedSVD);
 
+// Appends a dense block to a triplet list at (row, col). Zeros are kept so that
+// the sparsity pattern does not depend on the values.
+void insertBlock(std::vector<Tripletd> &triplets, int row, int col, const Eigen::MatrixXd &block);
+
 void eigen_sym(Eigen::Matrix3d &a, Eigen::Vector3d &eig_val, Eigen::Matrix3d &eig_vec);
 Eigen::Vector3d findOrthonormalVector(Eigen::Vector3d input);
 #endif // MUSCLEMASS_SRC_MLCOMMON_H_
\ No newline at end of file
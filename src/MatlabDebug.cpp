@@ -2,10 +2,21 @@
 
 #include <fstream>
 #include <iomanip>
+#include <mutex>
 
 using namespace std;
 using namespace Eigen;
 
+// Each thread appends to its own file, so that batch runs do not interleave
+// their output. The lock keeps appends whole when threads share a file name.
+static thread_local string s_fileName = "test.m";
+static mutex s_fileMutex;
+
+void set_matlab_debug_file(const string &file_name)
+{
+	s_fileName = file_name;
+}
+
 //template <typename Derived>
 //
 //void sparse_to_file_as_dense(const Eigen::EigenBase<Derived>& mat, string var_name)
@@ -30,8 +41,9 @@ void sparse_to_file_as_sparse_m(const SparseMatrix<double>& mat, string var_name
 	MatrixXd dMat;
 	dMat = MatrixXd(mat);
 
+	lock_guard<mutex> lock(s_fileMutex);
 	ofstream ofs;
-	ofs.open("test.m", ofstream::out | ofstream::app);
+	ofs.open(s_fileName, ofstream::out | ofstream::app);
 
 	ofs << "i = [";
 
@@ -81,8 +93,9 @@ void sparse_to_file_as_dense(const SparseMatrix<double>& mat, string var_name)
 	MatrixXd dMat;
 	dMat = MatrixXd(mat);
 
+	lock_guard<mutex> lock(s_fileMutex);
 	ofstream ofs;
-	ofs.open("test.m", ofstream::out | ofstream::app);
+	ofs.open(s_fileName, ofstream::out | ofstream::app);
 
 	ofs << var_name;
 	ofs << " = [";
@@ -94,8 +107,9 @@ void sparse_to_file_as_dense(const SparseMatrix<double>& mat, string var_name)
 
 void mat_to_file(const Eigen::MatrixXd& mat, string var_name)
 {
+	lock_guard<mutex> lock(s_fileMutex);
 	ofstream ofs;
-	ofs.open("test.m", ofstream::out | ofstream::app);
+	ofs.open(s_fileName, ofstream::out | ofstream::app);
 
 	ofs << setprecision(20);
 
@@ -109,8 +123,9 @@ void mat_to_file(const Eigen::MatrixXd& mat, string var_name)
 
 void mat_to_file(const Eigen::Matrix4d& mat, string var_name)
 {
+	lock_guard<mutex> lock(s_fileMutex);
 	ofstream ofs;
-	ofs.open("test.m", ofstream::out | ofstream::app);
+	ofs.open(s_fileName, ofstream::out | ofstream::app);
 
 	ofs << setprecision(20);
 
@@ -124,8 +139,9 @@ void mat_to_file(const Eigen::Matrix4d& mat, string var_name)
 
 void mat_to_file(const Eigen::MatrixXi& mat, string var_name)
 {
+	lock_guard<mutex> lock(s_fileMutex);
 	ofstream ofs;
-	ofs.open("test.m", ofstream::out | ofstream::app);
+	ofs.open(s_fileName, ofstream::out | ofstream::app);
 
 	ofs << setprecision(20);
 
@@ -139,8 +155,9 @@ void mat_to_file(const Eigen::MatrixXi& mat, string var_name)
 
 void vec_to_file(const Eigen::VectorXd& vec, std::string var_name)
 {
+	lock_guard<mutex> lock(s_fileMutex);
 	ofstream ofs;
-	ofs.open("test.m", ofstream::out | ofstream::app);
+	ofs.open(s_fileName, ofstream::out | ofstream::app);
 
 	ofs << setprecision(20);
 
@@ -154,8 +171,9 @@ void vec_to_file(const Eigen::VectorXd& vec, std::string var_name)
 
 void vec_to_file(const Eigen::VectorXi& vec, std::string var_name)
 {
+	lock_guard<mutex> lock(s_fileMutex);
 	ofstream ofs;
-	ofs.open("test.m", ofstream::out | ofstream::app);
+	ofs.open(s_fileName, ofstream::out | ofstream::app);
 
 	ofs << setprecision(20);
 
@@ -169,8 +187,9 @@ void vec_to_file(const Eigen::VectorXi& vec, std::string var_name)
 
 void vec_to_file(const Eigen::Vector3d& vec, std::string var_name)
 {
+	lock_guard<mutex> lock(s_fileMutex);
 	ofstream ofs;
-	ofs.open("test.m", ofstream::out | ofstream::app);
+	ofs.open(s_fileName, ofstream::out | ofstream::app);
 
 	ofs << setprecision(20);
 
@@ -184,8 +203,9 @@ void vec_to_file(const Eigen::Vector3d& vec, std::string var_name)
 
 void double_to_file(double d, string var_name)
 {
+	lock_guard<mutex> lock(s_fileMutex);
 	ofstream ofs;
-	ofs.open("test.m", ofstream::out | ofstream::app);
+	ofs.open(s_fileName, ofstream::out | ofstream::app);
 
 	ofs << setprecision(20);
 
@@ -199,6 +219,7 @@ void double_to_file(double d, string var_name)
 
 void EOL_outputter(int EOLE, int EOLV, int verts, int faces)
 {
+	lock_guard<mutex> lock(s_fileMutex);
 	ofstream ofs;
 	ofs.open("timings.csv", ofstream::out | ofstream::app);
 
@@ -5,6 +5,7 @@
 
 #include <vector>
 #include <memory>
+#include <string>
 
 #define EIGEN_DONT_ALIGN_STATICALLY
 #include <Eigen/Sparse>
@@ -14,6 +15,9 @@
 
 //void sparse_to_file_as_dense(const Eigen::EigenBase<Derived>& mat, std::string var_name);
 
+// Sets the file that this thread appends to (default "test.m")
+void set_matlab_debug_file(const std::string &file_name);
+
 void sparse_to_file_as_sparse_m(const Eigen::SparseMatrix<double>& mat, std::string var_name);
 
 void sparse_to_file_as_dense(const Eigen::SparseMatrix<double>& mat, std::string var_name);
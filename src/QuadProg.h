@@ -7,6 +7,8 @@
 
 // Calling convention:
 // https://www.mathworks.com/help/optim/ug/quadprog.html
+// Vectors are taken by Ref, so that a segment of a larger workspace is
+// passed without a copy.
 class QuadProg
 {
 public:
@@ -18,17 +20,17 @@ public:
 	virtual void setNumberOfEqualities(int numEq) = 0;
 
 	virtual void setObjectiveMatrix(const Eigen::SparseMatrix<double> & mat) = 0;
-	virtual void setObjectiveVector(const Eigen::VectorXd & vector) = 0;
+	virtual void setObjectiveVector(const Eigen::Ref<const Eigen::VectorXd> & vector) = 0;
 	virtual void setObjectiveConstant(double constant) = 0;
 
-	virtual void setLowerVariableBound(const Eigen::VectorXd & bounds) = 0;
-	virtual void setUpperVariableBound(const Eigen::VectorXd & bounds) = 0;
+	virtual void setLowerVariableBound(const Eigen::Ref<const Eigen::VectorXd> & bounds) = 0;
+	virtual void setUpperVariableBound(const Eigen::Ref<const Eigen::VectorXd> & bounds) = 0;
 
 	virtual void setInequalityMatrix(const Eigen::SparseMatrix<double> & mat) = 0;
-	virtual void setInequalityVector(const Eigen::VectorXd & vector) = 0;
+	virtual void setInequalityVector(const Eigen::Ref<const Eigen::VectorXd> & vector) = 0;
 
 	virtual void setEqualityMatrix(const Eigen::SparseMatrix<double> & mat) = 0;
-	virtual void setEqualityVector(const Eigen::VectorXd & vector) = 0;
+	virtual void setEqualityVector(const Eigen::Ref<const Eigen::VectorXd> & vector) = 0;
 
 	virtual bool solve() = 0;
 
@@ -0,0 +1,354 @@
+#include "QuadProgActiveSet.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+using namespace Eigen;
+
+static void grow(MatrixXd &A, int rows, int cols) {
+	// Grows A to at least rows x cols and never shrinks it, so that it stops
+	// allocating once it has held the largest problem. The contents are lost
+	// when it grows.
+	if (A.rows() < rows || A.cols() < cols) {
+		A.resize(max(rows, (int)A.rows()), max(cols, (int)A.cols()));
+	}
+}
+
+static void grow(VectorXd &v, int rows) {
+	if (v.size() < rows) {
+		v.resize(rows);
+	}
+}
+
+QuadProgActiveSet::QuadProgActiveSet() :
+	m_nvars(0),
+	m_nineqs(0),
+	m_neqs(0),
+	m_nrows(0),
+	m_maxIters(50),
+	m_tol(1e-10)
+{
+
+}
+
+void QuadProgActiveSet::reserve(int numVars, int numIneq, int numEq) {
+	m_H.resize(numVars, numVars);
+	m_f.resize(numVars);
+	m_xu.resize(numVars);
+	m_x.resize(numVars);
+	m_dualLower.resize(numVars);
+	m_dualUpper.resize(numVars);
+	m_ldltH = LDLT<MatrixXd>(numVars);
+	grow(m_A, numIneq, numVars);
+	grow(m_b, numIneq);
+	grow(m_dualIneq, numIneq);
+	grow(m_Aeq, numEq, numVars);
+	grow(m_beq, numEq);
+	grow(m_dualEq, numEq);
+	int m = numIneq + numEq;
+	growRows(m, numVars);
+	m_rows.reserve(m);
+	m_active.reserve(m);
+	m_keys.reserve(numIneq);
+	m_rowKeys.reserve(numIneq);
+	m_prevDual.reserve(numIneq);
+}
+
+void QuadProgActiveSet::growRows(int m, int n) {
+	// Sizes the buffers indexed by the stacked rows for m of them
+	grow(m_B, m, n);
+	grow(m_d, m);
+	grow(m_Y, n, m);
+	grow(m_S, m, m);
+	grow(m_r, m);
+	grow(m_nu, m);
+	grow(m_nuGS, m);
+	grow(m_Saa, m, m);
+	grow(m_ra, m);
+	grow(m_viol, m);
+}
+
+void QuadProgActiveSet::setNumberOfVariables(int numVars) {
+	m_nvars = numVars;
+	m_f.setZero(numVars);
+	m_lb.resize(0);
+	m_ub.resize(0);
+}
+
+void QuadProgActiveSet::setNumberOfInequalities(int numIneq) {
+	if (numIneq != m_nineqs) {
+		m_keys.clear();
+	}
+	m_nineqs = numIneq;
+	grow(m_A, numIneq, m_nvars);
+	grow(m_b, numIneq);
+	grow(m_dualIneq, numIneq);
+	m_b.head(numIneq).setZero();
+}
+
+void QuadProgActiveSet::setNumberOfEqualities(int numEq) {
+	m_neqs = numEq;
+	grow(m_Aeq, numEq, m_nvars);
+	grow(m_beq, numEq);
+	grow(m_dualEq, numEq);
+	m_beq.head(numEq).setZero();
+}
+
+void QuadProgActiveSet::setObjectiveMatrix(const SparseMatrix<double> & mat) {
+	m_H = mat;
+}
+
+void QuadProgActiveSet::setObjectiveVector(const Ref<const VectorXd> & vector) {
+	m_f = vector;
+}
+
+void QuadProgActiveSet::setObjectiveConstant(double) {
+	// Does not change the minimizer
+}
+
+void QuadProgActiveSet::setLowerVariableBound(const Ref<const VectorXd> & bounds) {
+	m_lb = bounds;
+}
+
+void QuadProgActiveSet::setUpperVariableBound(const Ref<const VectorXd> & bounds) {
+	m_ub = bounds;
+}
+
+void QuadProgActiveSet::setInequalityMatrix(const SparseMatrix<double> & mat) {
+	m_A.topLeftCorner(m_nineqs, m_nvars) = mat;
+}
+
+void QuadProgActiveSet::setInequalityVector(const Ref<const VectorXd> & vector) {
+	m_b.head(m_nineqs) = vector;
+}
+
+void QuadProgActiveSet::setEqualityMatrix(const SparseMatrix<double> & mat) {
+	m_Aeq.topLeftCorner(m_neqs, m_nvars) = mat;
+}
+
+void QuadProgActiveSet::setEqualityVector(const Ref<const VectorXd> & vector) {
+	m_beq.head(m_neqs) = vector;
+}
+
+void QuadProgActiveSet::stackConstraints() {
+	// Stacks equalities, inequalities and finite variable bounds into B x <= d
+	m_lowerRows.clear();
+	m_upperRows.clear();
+	for (int i = 0; i < (int)m_lb.size(); i++) {
+		if (m_lb(i) > -numeric_limits<double>::max()) {
+			m_lowerRows.push_back(i);
+		}
+	}
+	for (int i = 0; i < (int)m_ub.size(); i++) {
+		if (m_ub(i) < numeric_limits<double>::max()) {
+			m_upperRows.push_back(i);
+		}
+	}
+	int n = m_nvars;
+	int nl = (int)m_lowerRows.size();
+	int nu = (int)m_upperRows.size();
+	int m = m_neqs + m_nineqs + nl + nu;
+	m_nrows = m;
+	growRows(m, n);
+
+	m_B.topLeftCorner(m, n).setZero();
+	m_d.head(m).setZero();
+	m_B.topLeftCorner(m_neqs, n) = m_Aeq.topLeftCorner(m_neqs, n);
+	m_d.head(m_neqs) = m_beq.head(m_neqs);
+	m_B.block(m_neqs, 0, m_nineqs, n) = m_A.topLeftCorner(m_nineqs, n);
+	m_d.segment(m_neqs, m_nineqs) = m_b.head(m_nineqs);
+
+	// Bound rows get keys past any inequality key
+	m_rowKeys.resize(m_nineqs + nl + nu);
+	int keyMax = m_nineqs;
+	for (int k = 0; k < m_nineqs; k++) {
+		m_rowKeys[k] = ((int)m_keys.size() == m_nineqs) ? m_keys[k] : k;
+		keyMax = max(keyMax, m_rowKeys[k] + 1);
+	}
+	int row = m_neqs + m_nineqs;
+	for (int k = 0; k < nl; k++, row++) {
+		m_B(row, m_lowerRows[k]) = -1.0;
+		m_d(row) = -m_lb(m_lowerRows[k]);
+		m_rowKeys[row - m_neqs] = keyMax + m_lowerRows[k];
+	}
+	for (int k = 0; k < nu; k++, row++) {
+		m_B(row, m_upperRows[k]) = 1.0;
+		m_d(row) = m_ub(m_upperRows[k]);
+		m_rowKeys[row - m_neqs] = keyMax + n + m_upperRows[k];
+	}
+}
+
+bool QuadProgActiveSet::solve() {
+	// Solves the QP, warm-starting from the previous solve when possible.
+	// Returns false only if H is not positive definite, in which case the
+	// primal solution is left unchanged.
+	m_stats.solves++;
+	stackConstraints();
+	int n = m_nvars;
+	int m = m_nrows;
+
+	m_ldltH.compute(m_H);
+	if (m_ldltH.info() != Success || !m_ldltH.isPositive()) {
+		return false;
+	}
+	m_xu = m_ldltH.solve(m_f);
+	m_xu = -m_xu;
+	Block<MatrixXd> B = m_B.topLeftCorner(m, n);
+	Block<MatrixXd> Y = m_Y.topLeftCorner(n, m);
+	Y = B.transpose();
+	m_ldltH.solveInPlace(Y);
+	m_S.topLeftCorner(m, m).noalias() = B * Y;
+	m_r.head(m).noalias() = B * m_xu;
+	m_r.head(m) -= m_d.head(m);
+
+	// Initial active set: the previous multipliers, or else the rows violated
+	// by the unconstrained minimizer
+	m_nu.head(m).setZero();
+	m_active.assign(m, false);
+	bool isWarm = false;
+	for (int i = m_neqs; i < m; i++) {
+		pair<int, double> key(m_rowKeys[i - m_neqs], -numeric_limits<double>::max());
+		auto it = lower_bound(m_prevDual.begin(), m_prevDual.end(), key);
+		if (it != m_prevDual.end() && it->first == key.first) {
+			isWarm = true;
+			m_nu(i) = it->second;
+			m_active[i] = it->second > 0.0;
+		}
+	}
+	if (isWarm) {
+		m_stats.warmStarts++;
+	}
+	else {
+		for (int i = m_neqs; i < m; i++) {
+			m_active[i] = m_r(i) > m_tol;
+		}
+	}
+
+	if (!solveActiveSet()) {
+		// Gauss-Seidel always converges, but slowly, so its active set is handed
+		// back to the active-set iteration to polish the multipliers
+		m_stats.fallbacks++;
+		solveGaussSeidel();
+		m_nuGS.head(m) = m_nu.head(m);
+		for (int i = m_neqs; i < m; i++) {
+			m_active[i] = m_nu(i) > 0.0;
+		}
+		if (!solveActiveSet()) {
+			m_nu.head(m) = m_nuGS.head(m);
+		}
+	}
+
+	m_x = m_xu;
+	m_x.noalias() -= Y * m_nu.head(m);
+	int nl = (int)m_lowerRows.size();
+	int nu = (int)m_upperRows.size();
+	m_dualEq.head(m_neqs) = m_nu.head(m_neqs);
+	m_dualIneq.head(m_nineqs) = m_nu.segment(m_neqs, m_nineqs);
+	m_dualLower.setZero(n);
+	m_dualUpper.setZero(n);
+	for (int k = 0; k < nl; k++) {
+		m_dualLower(m_lowerRows[k]) = m_nu(m_neqs + m_nineqs + k);
+	}
+	for (int k = 0; k < nu; k++) {
+		m_dualUpper(m_upperRows[k]) = m_nu(m_neqs + m_nineqs + nl + k);
+	}
+
+	m_prevDual.clear();
+	for (int i = m_neqs; i < m; i++) {
+		m_prevDual.push_back(make_pair(m_rowKeys[i - m_neqs], m_nu(i)));
+	}
+	sort(m_prevDual.begin(), m_prevDual.end());
+	return true;
+}
+
+bool QuadProgActiveSet::solveActiveSet() {
+	// Primal-dual active-set iteration. Each iteration solves the equality
+	// constrained problem on the working set through its Schur complement,
+	// then adds violated rows and drops rows with negative multipliers.
+	int m = m_nrows;
+	for (int iter = 0; iter < m_maxIters; iter++) {
+		m_stats.iterations++;
+		m_rows.clear();
+		for (int i = 0; i < m; i++) {
+			if (i < m_neqs || m_active[i]) {
+				m_rows.push_back(i);
+			}
+		}
+		int na = (int)m_rows.size();
+		m_nu.head(m).setZero();
+		if (na > 0) {
+			for (int a = 0; a < na; a++) {
+				m_ra(a) = m_r(m_rows[a]);
+				for (int b = 0; b < na; b++) {
+					m_Saa(a, b) = m_S(m_rows[a], m_rows[b]);
+				}
+			}
+			// Cholesky in place on the leading block, which unlike a
+			// decomposition object does not reallocate as na changes.
+			// A dependent working set has no unique multipliers.
+			Block<MatrixXd> Saa = m_Saa.topLeftCorner(na, na);
+			LLT<Ref<MatrixXd> > llt(Saa);
+			if (llt.info() != Success) {
+				return false;
+			}
+			double dmin = Saa.diagonal().minCoeff();
+			double dmax = Saa.diagonal().maxCoeff();
+			if (dmin * dmin <= 1e-12 * max(dmax * dmax, 1.0)) {
+				return false;
+			}
+			llt.solveInPlace(m_ra.head(na));
+			for (int a = 0; a < na; a++) {
+				m_nu(m_rows[a]) = m_ra(a);
+			}
+		}
+
+		// Constraint values B x - d at x = xu - Y nu
+		m_viol.head(m) = m_r.head(m);
+		m_viol.head(m).noalias() -= m_S.topLeftCorner(m, m) * m_nu.head(m);
+
+		bool isChanged = false;
+		for (int i = m_neqs; i < m; i++) {
+			bool isActive = m_active[i] ? (m_nu(i) > -m_tol) : (m_viol(i) > m_tol);
+			if (isActive != m_active[i]) {
+				m_active[i] = isActive;
+				isChanged = true;
+			}
+		}
+		if (!isChanged) {
+			for (int i = m_neqs; i < m; i++) {
+				m_nu(i) = max(m_nu(i), 0.0);
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+void QuadProgActiveSet::solveGaussSeidel() {
+	// Projected Gauss-Seidel on the dual: S nu - r >= 0 complementary to nu >= 0
+	// on the inequality rows, and S nu - r = 0 on the equality rows.
+	// Starts from the last active-set multipliers.
+	int m = m_nrows;
+	for (int i = m_neqs; i < m; i++) {
+		m_nu(i) = max(m_nu(i), 0.0);
+	}
+	int maxIters = 100 * max(m, 1);
+	for (int iter = 0; iter < maxIters; iter++) {
+		double change = 0.0;
+		for (int i = 0; i < m; i++) {
+			if (m_S(i, i) <= 0.0) {
+				continue;
+			}
+			double nui = m_nu(i) - (m_S.row(i).head(m).dot(m_nu.head(m)) - m_r(i)) / m_S(i, i);
+			if (i >= m_neqs) {
+				nui = max(nui, 0.0);
+			}
+			change = max(change, abs(nui - m_nu(i)));
+			m_nu(i) = nui;
+		}
+		if (change < m_tol) {
+			break;
+		}
+	}
+}
@@ -0,0 +1,137 @@
+#pragma once
+// QuadProgActiveSet Self-contained dense QP solver for small contact/limit problems
+//    min 1/2 x' H x + f' x  s.t.  A x <= b, Aeq x = beq, lb <= x <= ub
+//    H must be symmetric positive definite. The constraints are eliminated with
+//    the Schur complement of H, and a primal-dual active-set iteration is
+//    warm-started from the active set and multipliers of the previous solve.
+//    If the active set cycles, projected Gauss-Seidel on the dual finishes the job.
+//    The buffers only grow, and work on their leading rows, so that once
+//    reserve() has sized them for the largest problem a solve does not allocate.
+
+#ifndef REDUCEDCOORD_SRC_QUADPROGACTIVESET_H_
+#define REDUCEDCOORD_SRC_QUADPROGACTIVESET_H_
+#include <vector>
+#include <utility>
+#define EIGEN_DONT_ALIGN_STATICALLY
+
+#include <Eigen/Dense>
+#include "QuadProg.h"
+
+struct QuadProgStats {
+	int solves;			// Calls to solve()
+	int iterations;		// Active-set iterations over all solves
+	int warmStarts;		// Solves that started from a previous active set
+	int fallbacks;		// Solves finished by projected Gauss-Seidel
+
+	QuadProgStats() : solves(0), iterations(0), warmStarts(0), fallbacks(0) {}
+};
+
+class QuadProgActiveSet : public QuadProg
+{
+public:
+	QuadProgActiveSet();
+	virtual ~QuadProgActiveSet() {}
+
+	// Sizes the buffers for up to numIneq inequalities and numEq equalities
+	// over numVars variables, without variable bounds
+	void reserve(int numVars, int numIneq, int numEq);
+
+	virtual void setNumberOfVariables(int numVars);
+	virtual void setNumberOfInequalities(int numIneq);
+	virtual void setNumberOfEqualities(int numEq);
+
+	virtual void setObjectiveMatrix(const Eigen::SparseMatrix<double> & mat);
+	virtual void setObjectiveVector(const Eigen::Ref<const Eigen::VectorXd> & vector);
+	virtual void setObjectiveConstant(double constant);
+
+	virtual void setLowerVariableBound(const Eigen::Ref<const Eigen::VectorXd> & bounds);
+	virtual void setUpperVariableBound(const Eigen::Ref<const Eigen::VectorXd> & bounds);
+
+	virtual void setInequalityMatrix(const Eigen::SparseMatrix<double> & mat);
+	virtual void setInequalityVector(const Eigen::Ref<const Eigen::VectorXd> & vector);
+
+	virtual void setEqualityMatrix(const Eigen::SparseMatrix<double> & mat);
+	virtual void setEqualityVector(const Eigen::Ref<const Eigen::VectorXd> & vector);
+
+	// Dense variants, to skip the sparseView() round trip. They take blocks, so
+	// the caller can pass the leading rows of a matrix kept at its largest size.
+	void setObjectiveMatrix(const Eigen::Ref<const Eigen::MatrixXd> & mat) { m_H = mat; }
+	void setInequalityMatrix(const Eigen::Ref<const Eigen::MatrixXd> & mat) { m_A.topLeftCorner(m_nineqs, m_nvars) = mat; }
+	void setEqualityMatrix(const Eigen::Ref<const Eigen::MatrixXd> & mat) { m_Aeq.topLeftCorner(m_neqs, m_nvars) = mat; }
+
+	// Identifies the inequality rows across solves, so that the warm start
+	// survives rows being added or removed. Defaults to the row index.
+	void setInequalityKeys(const std::vector<int> &keys) { m_keys = keys; }
+	void clearWarmStart() { m_prevDual.clear(); }
+
+	virtual bool solve();
+
+	virtual Eigen::VectorXd getPrimalSolution() { return m_x; }
+	virtual Eigen::VectorXd getDualInequality() { return m_dualIneq.head(m_nineqs); }
+	virtual Eigen::VectorXd getDualEquality() { return m_dualEq.head(m_neqs); }
+	virtual Eigen::VectorXd getDualLower() { return m_dualLower; }
+	virtual Eigen::VectorXd getDualUpper() { return m_dualUpper; }
+	// Copies the solution into x, without allocating if x already has its size
+	void getPrimalSolution(Eigen::VectorXd &x) const { x = m_x; }
+
+	void setMaxIterations(int maxIters) { m_maxIters = maxIters; }
+	void setTolerance(double tol) { m_tol = tol; }
+	const QuadProgStats &getStats() const { return m_stats; }
+	void resetStats() { m_stats = QuadProgStats(); }
+
+private:
+	void growRows(int m, int n);
+	void stackConstraints();
+	bool solveActiveSet();
+	void solveGaussSeidel();
+
+	int m_nvars;
+	int m_nineqs;
+	int m_neqs;
+	int m_nrows;					// Rows of B in use
+	int m_maxIters;
+	double m_tol;
+
+	Eigen::MatrixXd m_H;
+	Eigen::VectorXd m_f;
+	Eigen::MatrixXd m_A;
+	Eigen::VectorXd m_b;
+	Eigen::MatrixXd m_Aeq;
+	Eigen::VectorXd m_beq;
+	Eigen::VectorXd m_lb;
+	Eigen::VectorXd m_ub;
+
+	// All constraints stacked as B x <= d, equalities first
+	Eigen::MatrixXd m_B;
+	Eigen::VectorXd m_d;
+	std::vector<int> m_rowKeys;		// Warm-start key of each inequality row of B
+	std::vector<int> m_lowerRows;	// Variable with a finite lower bound, per bound row
+	std::vector<int> m_upperRows;
+
+	Eigen::LDLT<Eigen::MatrixXd> m_ldltH;
+	Eigen::LDLT<Eigen::MatrixXd> m_ldltS;
+	Eigen::MatrixXd m_Y;			// inv(H) * B'
+	Eigen::MatrixXd m_S;			// B * inv(H) * B'
+	Eigen::VectorXd m_xu;			// Unconstrained minimizer
+	Eigen::VectorXd m_r;			// B * xu - d
+	Eigen::VectorXd m_nu;			// Multipliers of the stacked rows
+	Eigen::VectorXd m_nuGS;			// Multipliers from Gauss-Seidel, kept if polishing fails
+	Eigen::MatrixXd m_Saa;			// S on the working set, factored in place
+	Eigen::VectorXd m_ra;			// r on the working set, then its multipliers
+	Eigen::VectorXd m_viol;			// B x - d
+	std::vector<bool> m_active;
+	std::vector<int> m_rows;		// Working set
+
+	std::vector<int> m_keys;
+	std::vector<std::pair<int, double> > m_prevDual;	// Key and multiplier of each row, sorted by key
+
+	Eigen::VectorXd m_x;
+	Eigen::VectorXd m_dualIneq;
+	Eigen::VectorXd m_dualEq;
+	Eigen::VectorXd m_dualLower;
+	Eigen::VectorXd m_dualUpper;
+
+	QuadProgStats m_stats;
+};
+
+#endif // REDUCEDCOORD_SRC_QUADPROGACTIVESET_H_
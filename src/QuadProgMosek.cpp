@@ -1,5 +1,7 @@
 #include "QuadProgMosek.h"
 
+#include <mutex>
+
 #ifdef _MEX_
 #include "mex.h"
 #endif
@@ -208,7 +210,10 @@ static MSKenv_t __getMosekEnv() {
 }
 
 /// Sets up the environment, if needed, and returns if it was successful.
+static std::mutex __mosek_env_mutex;
 static MSKrescodee __setupMosekEnvIfNeeded() {
+	// The environment is shared by all tasks; tasks on several threads may race here
+	std::lock_guard<std::mutex> lock(__mosek_env_mutex);
 	MSKrescodee result = MSK_RES_OK;
 	if (__mosek_env == NULL) {
 		result = MSK_makeenv(&__mosek_env, NULL);
@@ -220,14 +225,6 @@ static MSKrescodee __setupMosekEnvIfNeeded() {
 	return result;
 }
 
-static MSKtask_t __mosek_task = NULL;
-static MSKtask_t __getMosekTask() {
-	return __mosek_task;
-}
-static void __setMosekTask(const MSKtask_t &task) {
-	__mosek_task = task;
-}
-
 /// Used as logging output for our quadratic program
 static void MSKAPI __mosekLog(void *handle, MSKCONST char str[]) {
 #ifdef _MEX_
@@ -249,23 +246,36 @@ QuadProgMosek::QuadProgMosek() : QuadProg() {
 	numCons = 0;
 	numIneqs = 0;
 	numEqs = 0;
+	mosekTask = NULL;
+	structureHint = STRUCTURE_AUTO;
+	isParamsChanged = true;
+	isLogging = false;
+	taskObjectiveConstant = 0.0;
 }
 
-QuadProgMosek::~QuadProgMosek() {}
+QuadProgMosek::~QuadProgMosek() {
+	if (mosekTask != NULL) {
+		MSK_deletetask(&mosekTask);
+	}
+}
 
 ///
 ///
 ///
 void QuadProgMosek::setNumberOfVariables(int numVars) {
+	if (numVars != this->numVars) {
+		lowerVariableBound = nullptr;
+		upperVariableBound = nullptr;
+	}
 	this->numVars = numVars;
 }
 
-void QuadProgMosek::setLowerVariableBound(const Eigen::VectorXd & bounds) {
+void QuadProgMosek::setLowerVariableBound(const Eigen::Ref<const Eigen::VectorXd> & bounds) {
 	lowerVariableBound = std::shared_ptr<Eigen::VectorXd>(new Eigen::VectorXd(bounds.rows()));
 	*lowerVariableBound = bounds;
 }
 
-void QuadProgMosek::setUpperVariableBound(const Eigen::VectorXd & bounds) {
+void QuadProgMosek::setUpperVariableBound(const Eigen::Ref<const Eigen::VectorXd> & bounds) {
 	upperVariableBound = std::shared_ptr<Eigen::VectorXd>(new Eigen::VectorXd(bounds.rows()));
 	*upperVariableBound = bounds;
 }
@@ -278,7 +288,7 @@ void QuadProgMosek::setObjectiveMatrix(const Eigen::SparseMatrix<double> & mat)
 	objectiveMat = MosekObjectiveMatrix::fromSparseMatrix(mat);
 }
 
-void QuadProgMosek::setObjectiveVector(const Eigen::VectorXd & vector) {
+void QuadProgMosek::setObjectiveVector(const Eigen::Ref<const Eigen::VectorXd> & vector) {
 	objectiveVec = MosekObjectiveVector::fromVector(vector);
 }
 
@@ -292,6 +302,11 @@ void QuadProgMosek::setObjectiveConstant(double constant) {
 ///
 
 void QuadProgMosek::setNumberOfInequalities(int numIneqs) {
+	// Rows from a previous solve with a different count are stale
+	if (numIneqs != this->numIneqs) {
+		inequalityMat = nullptr;
+		inequalityVec = nullptr;
+	}
 	this->numIneqs = numIneqs;
 	numCons = numIneqs + numEqs;
 }
@@ -301,7 +316,7 @@ void QuadProgMosek::setInequalityMatrix(const Eigen::SparseMatrix<double> & mat)
 	inequalityMat = MosekConstraintMatrix::fromSparseMatrix(mat);
 }
 
-void QuadProgMosek::setInequalityVector(const Eigen::VectorXd & vector) {
+void QuadProgMosek::setInequalityVector(const Eigen::Ref<const Eigen::VectorXd> & vector) {
 	assert(vector.rows() == numIneqs);
 	inequalityVec = MosekConstraintVector::fromVector(vector);
 }
@@ -312,6 +327,10 @@ void QuadProgMosek::setInequalityVector(const Eigen::VectorXd & vector) {
 ///
 
 void QuadProgMosek::setNumberOfEqualities(int numEqs) {
+	if (numEqs != this->numEqs) {
+		equalityMat = nullptr;
+		equalityVec = nullptr;
+	}
 	this->numEqs = numEqs;
 	numCons = numIneqs + numEqs;
 }
@@ -321,7 +340,7 @@ void QuadProgMosek::setEqualityMatrix(const Eigen::SparseMatrix<double> & mat) {
 	equalityMat = MosekConstraintMatrix::fromSparseMatrix(mat);
 }
 
-void QuadProgMosek::setEqualityVector(const Eigen::VectorXd & vector) {
+void QuadProgMosek::setEqualityVector(const Eigen::Ref<const Eigen::VectorXd> & vector) {
 	assert(vector.rows() == numEqs);
 	equalityVec = MosekConstraintVector::fromVector(vector);
 }
@@ -355,189 +374,251 @@ struct DoNextTask {
 	}
 };
 
-bool QuadProgMosek::solve() {
+static void collectConstraintTriplets(const std::shared_ptr<MosekConstraintMatrix> &mat, MSKint32t rowOffset,
+	std::vector<MSKint32t> &subi, std::vector<MSKint32t> &subj, std::vector<double> &val) {
+	// Flattens a column-wise constraint matrix into triplets, shifting the rows
+	if (!mat) {
+		return;
+	}
+	for (auto itr = mat->columns.begin(); itr != mat->columns.end(); itr++) {
+		auto col = itr->second->getData(itr->first);
+		for (MSKint32t k = 0; k < col.numNonZerosInCol; ++k) {
+			subi.push_back(col.rowIndexPtr[k] + rowOffset);
+			subj.push_back(col.columnNum);
+			val.push_back(col.valuePtr[k]);
+		}
+	}
+}
 
-	const MSKint32t kNumVars = static_cast<MSKint32t>(numVars);
-	const MSKint32t kNumCons = static_cast<MSKint32t>(numCons);
+void QuadProgMosek::gatherProblem(MosekProblem &p) {
+	// Flattens the current problem into the form that is compared against the task
+	p.numVars = numVars;
+	p.numIneqs = numIneqs;
+	p.numCons = numCons;
 
-	MSKrescodee   r = __setupMosekEnvIfNeeded();
-	MSKenv_t      env = __getMosekEnv();
-	MSKtask_t     task = __getMosekTask();
+	if (objectiveMat) {
+		p.qsubi = objectiveMat->rowIndices;
+		p.qsubj = objectiveMat->colIndices;
+		p.qval = objectiveMat->values;
+	}
+	p.c.assign(numVars, 0.0);
+	if (objectiveVec) {
+		for (int j = 0; j < numVars && j < objectiveVec->c.size(); ++j) {
+			p.c[j] = objectiveVec->c[j];
+		}
+	}
 
-	DoNextTask(true).doNext([&]() {
-		MSKrescodee result = MSK_RES_OK;
-		if (task != NULL) {
-			result = MSK_deletetask(&task);
+	collectConstraintTriplets(inequalityMat, 0, p.asubi, p.asubj, p.aval);
+	collectConstraintTriplets(equalityMat, numIneqs, p.asubi, p.asubj, p.aval);
+
+	// Inequalities are bounded above, equalities are fixed
+	p.bkc.assign(numCons, MSK_BK_FR);
+	p.blc.assign(numCons, -MSK_INFINITY);
+	p.buc.assign(numCons, MSK_INFINITY);
+	if (inequalityVec) {
+		for (size_t i = 0; i < inequalityVec->values.size(); ++i) {
+			MSKint32t row = inequalityVec->rowIndices[i];
+			p.bkc[row] = MSK_BK_UP;
+			p.buc[row] = inequalityVec->values[i];
 		}
-		return result;
-	}).doNext([&]() {
-		MSKrescodee result = MSK_maketask(env, kNumCons, kNumVars, &task);
-		__setMosekTask(task);
-		return result;
-	}).doNext([&]() {
-		// Log to stdout, file, or none
-		//return MSK_linkfunctotaskstream(task, MSK_STREAM_LOG, NULL, __mosekLog);
-		return MSK_linkfiletotaskstream(task, MSK_STREAM_LOG, "mosek.log", 0);
-		//return true;
-	}).doNext([&]() {
-		// Set parameters
-		MSKrescodee result = MSK_RES_OK;
-		for (auto it = paramsInt.begin(); it != paramsInt.end() && result == MSK_RES_OK; ++it) {
-			result = MSK_putintparam(task, it->first, it->second);
+	}
+	if (equalityVec) {
+		for (size_t i = 0; i < equalityVec->values.size(); ++i) {
+			MSKint32t row = equalityVec->rowIndices[i] + numIneqs;
+			p.bkc[row] = MSK_BK_FX;
+			p.blc[row] = equalityVec->values[i];
+			p.buc[row] = equalityVec->values[i];
 		}
-		for (auto it = paramsDouble.begin(); it != paramsDouble.end() && result == MSK_RES_OK; ++it) {
-			result = MSK_putdouparam(task, it->first, it->second);
+	}
+
+	// Variables are free unless both bounds are given
+	p.bkx.assign(numVars, MSK_BK_FR);
+	p.blx.assign(numVars, -MSK_INFINITY);
+	p.bux.assign(numVars, MSK_INFINITY);
+	if (lowerVariableBound && upperVariableBound) {
+		const double infinity = std::numeric_limits<double>::infinity();
+		// [ (l, u), (-inf, u), (l, inf), (-inf, inf) ]
+		const MSKboundkeye keys[4] = { MSK_BK_RA, MSK_BK_UP, MSK_BK_LO, MSK_BK_FR };
+		for (int j = 0; j < numVars; ++j) {
+			double lb = (*lowerVariableBound)(j);
+			double ub = (*upperVariableBound)(j);
+			bool lb_is_inf = lb == -infinity;
+			bool ub_is_inf = ub == infinity;
+			p.bkx[j] = keys[2 * (ub_is_inf ? 1 : 0) + (lb_is_inf ? 1 : 0)];
+			p.blx[j] = lb_is_inf ? -MSK_INFINITY : lb;
+			p.bux[j] = ub_is_inf ? MSK_INFINITY : ub;
 		}
-		return result;
-	}).doNext([&]() {
+	}
+}
 
-		/* Append 'NUMCON' empty constraints.
-		The constraints will initially have no bounds. */
-		return MSK_appendcons(task, kNumCons);
-	}).doNext([&]() {
+bool QuadProgMosek::isSameStructure(const MosekProblem &p) const {
+	// Sizes and sparsity patterns match the live task
+	return mosekTask != NULL &&
+		p.numVars == taskProblem.numVars &&
+		p.numIneqs == taskProblem.numIneqs &&
+		p.numCons == taskProblem.numCons &&
+		p.qsubi == taskProblem.qsubi &&
+		p.qsubj == taskProblem.qsubj &&
+		p.asubi == taskProblem.asubi &&
+		p.asubj == taskProblem.asubj;
+}
 
-		/* Append 'NUMVAR' variables.
-		The variables will initially be fixed at zero (x=0). */
-		return MSK_appendvars(task, kNumVars);
-	}).doNext([&]() {
+MSKrescodee QuadProgMosek::buildTask(const MosekProblem &p) {
+	// Creates the task from scratch
+	MSKenv_t env = __getMosekEnv();
+	const MSKint32t kNumVars = static_cast<MSKint32t>(p.numVars);
+	const MSKint32t kNumCons = static_cast<MSKint32t>(p.numCons);
+	const MSKint32t kNumA = static_cast<MSKint32t>(p.aval.size());
+	const MSKint32t kNumQ = static_cast<MSKint32t>(p.qval.size());
+	MSKrescodee result = MSK_RES_OK;
 
-		/* Optionally add a constant term to the objective. */
-		return MSK_putcfix(task, this->objectiveConstant);
-	}).doNext([&]() {
-		MSKrescodee result = MSK_RES_OK;
+	if (mosekTask != NULL) {
+		result = MSK_deletetask(&mosekTask);
+		mosekTask = NULL;
+	}
+	if (result == MSK_RES_OK) {
+		result = MSK_maketask(env, kNumCons, kNumVars, &mosekTask);
+	}
+	if (result == MSK_RES_OK && isLogging) {
+		// Logging is off unless MSK_IPAR_LOG is set through setParamInt
+		result = MSK_linkfunctotaskstream(mosekTask, MSK_STREAM_LOG, NULL, __mosekLog);
+	}
+	if (result == MSK_RES_OK) {
+		/* Append 'NUMCON' empty constraints and 'NUMVAR' variables. */
+		result = MSK_appendcons(mosekTask, kNumCons);
+	}
+	if (result == MSK_RES_OK) {
+		result = MSK_appendvars(mosekTask, kNumVars);
+	}
+	if (result == MSK_RES_OK) {
+		result = MSK_putcfix(mosekTask, this->objectiveConstant);
+	}
+	if (result == MSK_RES_OK && kNumVars > 0) {
+		result = MSK_putcslice(mosekTask, 0, kNumVars, &p.c[0]);
+	}
+	if (result == MSK_RES_OK && kNumVars > 0) {
+		result = MSK_putvarboundslice(mosekTask, 0, kNumVars, &p.bkx[0], &p.blx[0], &p.bux[0]);
+	}
+	if (result == MSK_RES_OK && kNumCons > 0) {
+		result = MSK_putconboundslice(mosekTask, 0, kNumCons, &p.bkc[0], &p.blc[0], &p.buc[0]);
+	}
+	if (result == MSK_RES_OK && kNumA > 0) {
+		result = MSK_putaijlist(mosekTask, kNumA, &p.asubi[0], &p.asubj[0], &p.aval[0]);
+	}
+	if (result == MSK_RES_OK && kNumQ > 0) {
+		/* Input the Q for the objective. */
+		result = MSK_putqobj(mosekTask, kNumQ, &p.qsubi[0], &p.qsubj[0], &p.qval[0]);
+	}
 
-		if (objectiveVec) {
-			auto cData = objectiveVec->getData();
-			for (MSKint32t j = 0; j < cData.c.size() && result == MSK_RES_OK; ++j) {
-				/* Set the linear term c_j in the objective.*/
-				result = MSK_putcj(task, j, cData.c[j]);
-			}
+	stats.rebuilds++;
+	return result;
+}
+
+MSKrescodee QuadProgMosek::updateTask(const MosekProblem &p) {
+	// Pushes only the coefficients that differ from the live task
+	MSKrescodee result = MSK_RES_OK;
+	int numChanged = 0;
+
+	if (objectiveConstant != taskObjectiveConstant && result == MSK_RES_OK) {
+		result = MSK_putcfix(mosekTask, objectiveConstant);
+	}
+	for (MSKint32t j = 0; j < p.numVars && result == MSK_RES_OK; ++j) {
+		if (p.c[j] != taskProblem.c[j]) {
+			result = MSK_putcj(mosekTask, j, p.c[j]);
+			numChanged++;
 		}
-		return result;
-	}).doNext([&]() {
-		// First, set all variables to be FREE. Lower and upper bounds will be added next.
-		MSKrescodee result = MSK_RES_OK;
-		for (MSKint32t j = 0; j < kNumVars && result == MSK_RES_OK; ++j) {
-			result = MSK_putvarbound(task, j, MSK_BK_FR, -MSK_INFINITY, MSK_INFINITY);
+		if (result == MSK_RES_OK && (p.bkx[j] != taskProblem.bkx[j] ||
+			p.blx[j] != taskProblem.blx[j] || p.bux[j] != taskProblem.bux[j])) {
+			result = MSK_putvarbound(mosekTask, j, p.bkx[j], p.blx[j], p.bux[j]);
+			numChanged++;
 		}
-		return result;
-	}).doNext([&]() {
-		// Set lower/upper bound
-		MSKrescodee result = MSK_RES_OK;
-		const double infinity = std::numeric_limits<double>::infinity();
-		//                           [ (l, u),   (-inf, u),  (l, inf), (-inf, inf) ]
-		const MSKboundkeye keys[4] = { MSK_BK_FX, MSK_BK_UP, MSK_BK_LO, MSK_BK_FR };
-
-		if ((lowerVariableBound == 0) != (upperVariableBound == 0)) {
-			printf("Both lower and upper bounds must be set.\n");
-			return MSK_RES_ERR_UNKNOWN;
+	}
+	for (MSKint32t i = 0; i < p.numCons && result == MSK_RES_OK; ++i) {
+		if (p.bkc[i] != taskProblem.bkc[i] || p.blc[i] != taskProblem.blc[i] || p.buc[i] != taskProblem.buc[i]) {
+			result = MSK_putconbound(mosekTask, i, p.bkc[i], p.blc[i], p.buc[i]);
+			numChanged++;
 		}
-
-		if (lowerVariableBound && upperVariableBound) {
-			assert(lowerVariableBound->size() == upperVariableBound->size());
-			for (MSKint32t j = 0; j < kNumVars && result == MSK_RES_OK; ++j) {
-				MSKboundkeye key;
-				double lb = (*lowerVariableBound)(j);
-				double ub = (*upperVariableBound)(j);
-				const double infinity = std::numeric_limits<double>::infinity();
-				// [ (l, u), (-inf, u), (l, inf), (-inf, inf) ]
-				const MSKboundkeye keys[4] = { MSK_BK_FX,MSK_BK_UP,MSK_BK_LO,MSK_BK_FR };
-				bool lb_is_inf = false, ub_is_inf = false;
-
-				if (lb == -infinity) {
-					lb = -MSK_INFINITY;
-					lb_is_inf = true;
-				}
-
-				if (ub == infinity) {
-					ub = +MSK_INFINITY;
-					ub_is_inf = true;
-				}
-
-				key = keys[2 * (ub_is_inf ? 1 : 0) + (lb_is_inf ? 1 : 0)];
-				result = MSK_putvarbound(task, j, key, lb, ub);
-			}
+	}
+	for (size_t k = 0; k < p.aval.size() && result == MSK_RES_OK; ++k) {
+		if (p.aval[k] != taskProblem.aval[k]) {
+			result = MSK_putaij(mosekTask, p.asubi[k], p.asubj[k], p.aval[k]);
+			numChanged++;
 		}
-
-		return result;
-	}).doNext([&]() {
-		// Inequality constraint
-		MSKrescodee result = MSK_RES_OK;
-
-		if (inequalityMat) {
-			auto aData = inequalityMat->getData();
-			for (auto itr = aData.columns.begin(); itr != aData.columns.end() && result == MSK_RES_OK; itr++) {
-				auto col = itr->second->getData(itr->first);
-				result = MSK_putacol(
-					task,
-					col.columnNum,
-					col.numNonZerosInCol,
-					col.rowIndexPtr,
-					col.valuePtr);
-			}
+	}
+	for (size_t k = 0; k < p.qval.size() && result == MSK_RES_OK; ++k) {
+		if (p.qval[k] != taskProblem.qval[k]) {
+			result = MSK_putqobjij(mosekTask, p.qsubi[k], p.qsubj[k], p.qval[k]);
+			numChanged++;
 		}
+	}
 
-		if (inequalityVec) {
-			auto bData = inequalityVec->getData(0);
-			for (MSKint32t i = 0; i < bData.numNonZerosInCol && result == MSK_RES_OK; ++i) {
-				result = MSK_putconbound(
-					task,
-					bData.rowIndexPtr[i],  /* Index of constraint.*/
-					MSK_BK_UP,             /* Bound key.*/
-					-MSK_INFINITY,         /* Numerical value of lower bound.*/
-					bData.valuePtr[i]);    /* Numerical value of upper bound.*/
-			}
-		}
+	stats.updates++;
+	stats.coefficientUpdates += numChanged;
+	return result;
+}
 
-		return result;
-	}).doNext([&]() {
-		// Equality constraint
-		MSKrescodee result = MSK_RES_OK;
+bool QuadProgMosek::solve() {
+	// Keeps the task alive between calls. With the same structure only the
+	// changed coefficients are pushed, otherwise the task is rebuilt.
+	MSKrescodee result = __setupMosekEnvIfNeeded();
+	if (result != MSK_RES_OK) {
+		return false;
+	}
 
-		if (equalityMat) {
-			auto aData = equalityMat->getData();
-			for (auto itr = aData.columns.begin(); itr != aData.columns.end() && result == MSK_RES_OK; itr++) {
-				auto col = itr->second->getData(itr->first);
-				// Equalities come after inequalities, so add numIneq to the row indices
-				for (int k = 0; k < col.numNonZerosInCol && result == MSK_RES_OK; ++k) {
-					result = MSK_putaij(
-						task,
-						col.rowIndexPtr[k] + numIneqs,
-						col.columnNum,
-						col.valuePtr[k]);
-				}
-			}
-		}
+	MosekProblem p;
+	gatherProblem(p);
+	bool isSame;
+	if (structureHint == STRUCTURE_SAME) {
+		isSame = mosekTask != NULL && p.numVars == taskProblem.numVars && p.numCons == taskProblem.numCons &&
+			p.qval.size() == taskProblem.qval.size() && p.aval.size() == taskProblem.aval.size();
+	}
+	else if (structureHint == STRUCTURE_NEW) {
+		isSame = false;
+	}
+	else {
+		isSame = isSameStructure(p);
+	}
+	structureHint = STRUCTURE_AUTO;
 
-		if (equalityVec) {
-			auto bData = equalityVec->getData(0);
-			for (MSKint32t i = 0; i < bData.numNonZerosInCol && result == MSK_RES_OK; ++i) {
-				// Equalities come after inequalities, so add numIneq to the row indices
-				result = MSK_putconbound(
-					task,
-					bData.rowIndexPtr[i] + numIneqs,  /* Index of constraint.*/
-					MSK_BK_FX,                        /* Bound key.*/
-					bData.valuePtr[i],                /* Numerical value of lower bound.*/
-					bData.valuePtr[i]);               /* Numerical value of upper bound.*/
-			}
+	if (isSame) {
+		result = updateTask(p);
+	}
+	else {
+		result = buildTask(p);
+		isParamsChanged = true;
+	}
+	if (result == MSK_RES_OK && isParamsChanged) {
+		for (auto it = paramsInt.begin(); it != paramsInt.end() && result == MSK_RES_OK; ++it) {
+			result = MSK_putintparam(mosekTask, it->first, it->second);
 		}
+		for (auto it = paramsDouble.begin(); it != paramsDouble.end() && result == MSK_RES_OK; ++it) {
+			result = MSK_putdouparam(mosekTask, it->first, it->second);
+		}
+		isParamsChanged = false;
+	}
+	taskProblem = p;
+	taskObjectiveConstant = objectiveConstant;
+	if (result != MSK_RES_OK) {
+		char symname[MSK_MAX_STR_LEN];
+		char desc[MSK_MAX_STR_LEN];
+		MSK_getcodedesc(result, symname, desc);
+		printf("Error %s - \"%s\"\n", symname, desc);
+		// Start over on the next call
+		structureHint = STRUCTURE_NEW;
+		return false;
+	}
 
-		return result;
-	}).doNext([&]() {
-		/* Input the Q for the objective. */
-
-		auto Qdata = this->objectiveMat->getData();
-		return MSK_putqobj(task, Qdata.numValues, Qdata.qsubi, Qdata.qsubj, Qdata.qval);
-	}).doNext([&]() {
-		MSKrescodee trmcode;
-		/* Run optimizer */
-
-		return MSK_optimizetrm(task, &trmcode);
+	/* Run optimizer */
+	MSKrescodee trmcode;
+	DoNextTask(true).doNext([&]() {
+		return MSK_optimizetrm(mosekTask, &trmcode);
 	});
 
 	MSKsolstae solsta;
-	MSK_getsolsta(task, MSK_SOL_ITR, &solsta);
-	MSK_solutionsummary(task, MSK_STREAM_MSG);
+	MSK_getsolsta(mosekTask, MSK_SOL_ITR, &solsta);
+	if (isLogging) {
+		MSK_solutionsummary(mosekTask, MSK_STREAM_MSG);
+	}
 	return solsta == MSK_SOL_STA_OPTIMAL || solsta == MSK_SOL_STA_NEAR_OPTIMAL;
 }
 
@@ -545,7 +626,7 @@ Eigen::VectorXd QuadProgMosek::getPrimalSolution() {
 
 	Eigen::VectorXd x(numVars);
 
-	MSKtask_t task = __getMosekTask();
+	MSKtask_t task = mosekTask;
 	if (task == NULL) {
 		return x;
 	}
@@ -561,7 +642,7 @@ Eigen::VectorXd QuadProgMosek::getDualInequality() {
 
 	Eigen::VectorXd y(numIneqs);
 
-	MSKtask_t task = __getMosekTask();
+	MSKtask_t task = mosekTask;
 	if (task == NULL) {
 		return y;
 	}
@@ -588,7 +669,7 @@ Eigen::VectorXd QuadProgMosek::getDualEquality() {
 
 	Eigen::VectorXd y(numEqs);
 
-	MSKtask_t task = __getMosekTask();
+	MSKtask_t task = mosekTask;
 	if (task == NULL) {
 		return y;
 	}
@@ -615,7 +696,7 @@ Eigen::VectorXd QuadProgMosek::getDualLower() {
 
 	Eigen::VectorXd y(numVars);
 
-	MSKtask_t task = __getMosekTask();
+	MSKtask_t task = mosekTask;
 	if (task == NULL) {
 		return y;
 	}
@@ -640,7 +721,7 @@ Eigen::VectorXd QuadProgMosek::getDualUpper() {
 
 	Eigen::VectorXd y(numVars);
 
-	MSKtask_t task = __getMosekTask();
+	MSKtask_t task = mosekTask;
 	if (task == NULL) {
 		return y;
 	}
@@ -662,11 +743,26 @@ Eigen::VectorXd QuadProgMosek::getDualUpper() {
 }
 
 bool QuadProgMosek::setParamInt(int name, int value) {
-	paramsInt.insert(std::pair<MSKiparame, MSKint32t>((MSKiparame)name, (MSKint32t)value));
+	auto it = paramsInt.find((MSKiparame)name);
+	if (it == paramsInt.end() || it->second != (MSKint32t)value) {
+		paramsInt[(MSKiparame)name] = (MSKint32t)value;
+		isParamsChanged = true;
+	}
+	if (name == MSK_IPAR_LOG) {
+		// The log stream is attached when the task is built
+		if (isLogging != (value > 0)) {
+			structureHint = STRUCTURE_NEW;
+		}
+		isLogging = value > 0;
+	}
 	return true;
 }
 
 bool QuadProgMosek::setParamDouble(int name, double value) {
-	paramsDouble.insert(std::pair<MSKdparame, MSKrealt>((MSKdparame)name, (MSKrealt)value));
+	auto it = paramsDouble.find((MSKdparame)name);
+	if (it == paramsDouble.end() || it->second != (MSKrealt)value) {
+		paramsDouble[(MSKdparame)name] = (MSKrealt)value;
+		isParamsChanged = true;
+	}
 	return true;
 }
@@ -5,6 +5,7 @@
 
 #include <memory>
 #include <map>
+#include <vector>
 #include <mosek.h>
 
 //#define kMosekLicensePath "/Users/sueda/mosek/mosek.lic"
@@ -16,6 +17,28 @@ struct MosekObjectiveVector;
 struct MosekConstraintMatrix;
 struct MosekConstraintVector;
 
+// The problem as last pushed to the task: triplets, bounds and sizes
+struct MosekProblem {
+	int numVars, numIneqs, numCons;
+	std::vector<MSKint32t> qsubi, qsubj;
+	std::vector<double> qval;
+	std::vector<MSKint32t> asubi, asubj;
+	std::vector<double> aval;
+	std::vector<double> c;
+	std::vector<MSKboundkeye> bkc, bkx;
+	std::vector<double> blc, buc, blx, bux;
+
+	MosekProblem() : numVars(0), numIneqs(0), numCons(0) {}
+};
+
+struct QuadProgMosekStats {
+	int rebuilds;				// Tasks built from scratch
+	int updates;				// Solves that reused the task
+	int coefficientUpdates;		// Coefficients pushed by those solves
+
+	QuadProgMosekStats() : rebuilds(0), updates(0), coefficientUpdates(0) {}
+};
+
 class QuadProgMosek : public QuadProg {
 private:
 
@@ -38,6 +61,21 @@ private:
 	std::map<MSKiparame, MSKint32t> paramsInt;
 	std::map<MSKdparame, MSKrealt> paramsDouble;
 
+	// The task lives across solves
+	enum StructureHint { STRUCTURE_AUTO, STRUCTURE_SAME, STRUCTURE_NEW };
+	MSKtask_t mosekTask;
+	StructureHint structureHint;
+	bool isParamsChanged;
+	bool isLogging;
+	MosekProblem taskProblem;
+	double taskObjectiveConstant;
+	QuadProgMosekStats stats;
+
+	void gatherProblem(MosekProblem &p);
+	bool isSameStructure(const MosekProblem &p) const;
+	MSKrescodee buildTask(const MosekProblem &p);
+	MSKrescodee updateTask(const MosekProblem &p);
+
 public:
 
 	QuadProgMosek();
@@ -48,17 +86,17 @@ public:
 	virtual void setNumberOfEqualities(int numEq);
 
 	virtual void setObjectiveMatrix(const Eigen::SparseMatrix<double> & mat);
-	virtual void setObjectiveVector(const Eigen::VectorXd & vector);
+	virtual void setObjectiveVector(const Eigen::Ref<const Eigen::VectorXd> & vector);
 	virtual void setObjectiveConstant(double constant);
 
-	virtual void setLowerVariableBound(const Eigen::VectorXd & bounds);
-	virtual void setUpperVariableBound(const Eigen::VectorXd & bounds);
+	virtual void setLowerVariableBound(const Eigen::Ref<const Eigen::VectorXd> & bounds);
+	virtual void setUpperVariableBound(const Eigen::Ref<const Eigen::VectorXd> & bounds);
 
 	virtual void setInequalityMatrix(const Eigen::SparseMatrix<double> & mat);
-	virtual void setInequalityVector(const Eigen::VectorXd & vector);
+	virtual void setInequalityVector(const Eigen::Ref<const Eigen::VectorXd> & vector);
 
 	virtual void setEqualityMatrix(const Eigen::SparseMatrix<double> & mat);
-	virtual void setEqualityVector(const Eigen::VectorXd & vector);
+	virtual void setEqualityVector(const Eigen::Ref<const Eigen::VectorXd> & vector);
 
 	virtual bool solve();
 
@@ -70,6 +108,13 @@ public:
 
 	bool setParamInt(int name, int value);
 	bool setParamDouble(int name, double value);
+
+	// By default solve() compares the sparsity patterns with the live task.
+	// Callers that know better can skip the comparison (same structure, new
+	// values) or force a rebuild (new structure). Both apply to the next solve.
+	void setSameStructure() { structureHint = STRUCTURE_SAME; }
+	void setNewStructure() { structureHint = STRUCTURE_NEW; }
+	const QuadProgMosekStats &getStats() const { return stats; }
 };
 
 #endif // RIGIDBODYJOINTS_SRC_QUADPROGMOSEK_H_
\ No newline at end of file
@@ -0,0 +1,174 @@
+#pragma once
+// RigidTransform Compact rigid transform E = [R p; 0 1]
+//    Stores the rotation and translation separately, so that composing and
+//    inverting never touch the bottom row of a Matrix4d. Adjoint applies
+//    Ad(E) = [R 0; [p]R R] to twists, and its transpose to wrenches, in about
+//    30 flops, without forming the 6x6 matrix. These are the innermost kernels
+//    of the rigid-body code; SE3 keeps the Matrix4d/Matrix6d versions.
+
+#ifndef REDUCEDCOORD_SRC_RIGIDTRANSFORM_H_
+#define REDUCEDCOORD_SRC_RIGIDTRANSFORM_H_
+#define EIGEN_DONT_ALIGN_STATICALLY
+
+#include <Eigen/Dense>
+#include "MLCommon.h"
+
+class Adjoint;
+
+class RigidTransform
+{
+public:
+	Eigen::Matrix3d R;
+	Eigen::Vector3d p;
+
+	RigidTransform() : R(Eigen::Matrix3d::Identity()), p(Eigen::Vector3d::Zero()) {}
+	RigidTransform(const Eigen::Matrix3d &R, const Eigen::Vector3d &p) : R(R), p(p) {}
+	explicit RigidTransform(const Matrix4d &E) : R(E.block<3, 3>(0, 0)), p(E.block<3, 1>(0, 3)) {}
+
+	Matrix4d toMatrix() const {
+		Matrix4d E = Matrix4d::Identity();
+		E.block<3, 3>(0, 0) = R;
+		E.block<3, 1>(0, 3) = p;
+		return E;
+	}
+
+	RigidTransform inverse() const {
+		Eigen::Matrix3d Rt = R.transpose();
+		return RigidTransform(Rt, -(Rt * p));
+	}
+
+	RigidTransform operator*(const RigidTransform &B) const {
+		return RigidTransform(R * B.R, R * B.p + p);
+	}
+
+	// inverse() * B, without forming the inverse
+	RigidTransform inverseTimes(const RigidTransform &B) const {
+		return RigidTransform(R.transpose() * B.R, R.transpose() * (B.p - p));
+	}
+
+	Eigen::Vector3d transformPoint(const Eigen::Vector3d &x) const { return R * x + p; }
+
+	inline Adjoint adjoint() const;
+};
+
+class Adjoint
+{
+public:
+	explicit Adjoint(const RigidTransform &E) : R(E.R), p(E.p) {}
+
+	// Ad * phi
+	Vector6d apply(const Vector6d &phi) const {
+		Vector6d y;
+		y.segment<3>(0).noalias() = R * phi.segment<3>(0);
+		y.segment<3>(3).noalias() = R * phi.segment<3>(3);
+		y.segment<3>(3) += p.cross(y.segment<3>(0));
+		return y;
+	}
+
+	// Ad' * f, for wrenches
+	Vector6d applyTranspose(const Vector6d &f) const {
+		Vector6d y;
+		y.segment<3>(0).noalias() = R.transpose() * (f.segment<3>(0) - p.cross(f.segment<3>(3)));
+		y.segment<3>(3).noalias() = R.transpose() * f.segment<3>(3);
+		return y;
+	}
+
+	// inv(Ad) * phi, which is the adjoint of the inverse transform
+	Vector6d applyInverse(const Vector6d &phi) const {
+		Vector6d y;
+		y.segment<3>(0).noalias() = R.transpose() * phi.segment<3>(0);
+		y.segment<3>(3).noalias() = R.transpose() * (phi.segment<3>(3) - p.cross(phi.segment<3>(0)));
+		return y;
+	}
+
+	// Y = Ad * X for a 6 x n block of twists; Y must not alias X
+	template <typename DerivedX, typename DerivedY>
+	void apply(const Eigen::MatrixBase<DerivedX> &X, Eigen::MatrixBase<DerivedY> const &Y_) const {
+		Eigen::MatrixBase<DerivedY> &Y = const_cast<Eigen::MatrixBase<DerivedY> &>(Y_);
+		Eigen::Matrix3d pR;
+		for (int j = 0; j < 3; j++) {
+			pR.col(j) = p.cross(R.col(j));
+		}
+		Y.template topRows<3>().noalias() = R * X.template topRows<3>();
+		Y.template bottomRows<3>().noalias() = R * X.template bottomRows<3>();
+		Y.template bottomRows<3>().noalias() += pR * X.template topRows<3>();
+	}
+
+	Matrix6d toMatrix() const {
+		Matrix6d Ad = Matrix6d::Zero();
+		Ad.block<3, 3>(0, 0) = R;
+		Ad.block<3, 3>(3, 3) = R;
+		for (int j = 0; j < 3; j++) {
+			Ad.block<3, 1>(3, j) = p.cross(R.col(j));
+		}
+		return Ad;
+	}
+
+	// ad(phi) * x, the Lie bracket of two twists, without forming ad(phi)
+	static Vector6d ad(const Vector6d &phi, const Vector6d &x) {
+		Vector6d y;
+		y.segment<3>(0) = phi.segment<3>(0).cross(x.segment<3>(0));
+		y.segment<3>(3) = phi.segment<3>(0).cross(x.segment<3>(3)) + phi.segment<3>(3).cross(x.segment<3>(0));
+		return y;
+	}
+
+	// ad(phi)' * f, for wrenches
+	static Vector6d adTranspose(const Vector6d &phi, const Vector6d &f) {
+		Vector6d y;
+		y.segment<3>(0) = f.segment<3>(0).cross(phi.segment<3>(0)) + f.segment<3>(3).cross(phi.segment<3>(3));
+		y.segment<3>(3) = f.segment<3>(3).cross(phi.segment<3>(0));
+		return y;
+	}
+
+private:
+	Eigen::Matrix3d R;
+	Eigen::Vector3d p;
+};
+
+inline Adjoint RigidTransform::adjoint() const {
+	return Adjoint(*this);
+}
+
+// exp(t * xi) for a fixed twist xi and a varying t, as in SE3::exp(t * xi).
+// The axis is normalized once, so an evaluation is one Rodrigues rotation.
+class TwistExp
+{
+public:
+	TwistExp() : w(Eigen::Vector3d::Zero()), v(Eigen::Vector3d::Zero()), wxv(Eigen::Vector3d::Zero()), wlen(0.0), wv(0.0) {}
+	explicit TwistExp(const Vector6d &xi) : w(xi.segment<3>(0)), v(xi.segment<3>(3)), wxv(Eigen::Vector3d::Zero()), wlen(w.norm()), wv(0.0) {
+		if (wlen > 0.0) {
+			w /= wlen;
+			Eigen::Vector3d vw = v / wlen;
+			wxv = w.cross(vw);
+			wv = w.dot(vw);
+		}
+	}
+
+	RigidTransform operator()(double t) const {
+		double angle = t * wlen;
+		if (std::abs(angle) <= 1e-9) {
+			return RigidTransform(Eigen::Matrix3d::Identity(), t * v);
+		}
+		double c = cos(angle);
+		double s = sin(angle);
+		Eigen::Matrix3d R = (1.0 - c) * w * w.transpose();
+		R.diagonal().array() += c;
+		R(0, 1) -= s * w(2);
+		R(0, 2) += s * w(1);
+		R(1, 0) += s * w(2);
+		R(1, 2) -= s * w(0);
+		R(2, 0) -= s * w(1);
+		R(2, 1) += s * w(0);
+		Eigen::Vector3d p = (wv * angle) * w + wxv - R * wxv;
+		return RigidTransform(R, p);
+	}
+
+private:
+	Eigen::Vector3d w;		// Unit rotation axis
+	Eigen::Vector3d v;		// Translational part of xi
+	Eigen::Vector3d wxv;	// w x v / |w|
+	double wlen;			// |w| before normalizing
+	double wv;				// w . v / |w|
+};
+
+#endif // REDUCEDCOORD_SRC_RIGIDTRANSFORM_H_
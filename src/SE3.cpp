@@ -40,7 +40,7 @@ Matrix6d SE3::adjoint(const Matrix4d &E)
 	return Ad;
 }
 
-Matrix6d SE3::dAddt(const Matrix4d &E, const VectorXd &phi) 
+Matrix6d SE3::dAddt(const Matrix4d &E, const Vector6d &phi)
 {
 	// Gets the time derivative of the adjoint
 	Matrix6d dA;
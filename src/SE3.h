@@ -23,7 +23,7 @@ public:
 	static Eigen::Vector3d unbracket3(const Eigen::Matrix3d &A);
 	static Vector6d unbracket6(const Eigen::Matrix4d &A);
 	static Eigen::Matrix4d integrate(const Eigen::Matrix4d &E0, const Eigen::VectorXd &phi, double h);
-	static Matrix6d dAddt(const Eigen::Matrix4d &E, const Eigen::VectorXd &phi);
+	static Matrix6d dAddt(const Eigen::Matrix4d &E, const Vector6d &phi);
 	static Vector6d inertiaCuboid(Eigen::Vector3d whd, double density);
 	static Eigen::Matrix3d aaToMat(Eigen::Vector3d axis, double angle);
 	static Eigen::Matrix4d RpToE(Eigen::Matrix3d R, Eigen::Vector3d p);
@@ -9,6 +9,8 @@
 
 using namespace std;
 
+bool Shape::s_isGPUEnabled = true;
+
 Shape::Shape() :
 	posBufID(0),
 	norBufID(0),
@@ -68,6 +70,10 @@ void Shape::loadMesh(const string &meshName)
 
 void Shape::init()
 {
+	if (!s_isGPUEnabled) {
+		return;
+	}
+
 	// Send the position array to the GPU
 	glGenBuffers(1, &posBufID);
 	glBindBuffer(GL_ARRAY_BUFFER, posBufID);
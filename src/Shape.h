@@ -23,6 +23,11 @@ public:
 	void loadMesh(const std::string &meshName);
 	void init();
 	void draw(const std::shared_ptr<Program> prog) const;
+
+	// With GPU uploads off, init() is a no-op so that worlds can be built
+	// without a GL context (e.g. by BatchRunner). Set before spawning threads.
+	static void setGPUEnabled(bool isEnabled) { s_isGPUEnabled = isEnabled; }
+	static bool isGPUEnabled() { return s_isGPUEnabled; }
 	
 private:
 	std::vector<float> posBuf;
@@ -31,6 +36,7 @@ private:
 	unsigned posBufID;
 	unsigned norBufID;
 	unsigned texBufID;
+	static bool s_isGPUEnabled;
 };
 
 #endif
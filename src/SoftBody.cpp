@@ -6,6 +6,7 @@
 #include <iostream>
 #include <fstream>
 #include <cmath>        // std::abs
+#include <algorithm>
 
 #include <json.hpp>
 
@@ -15,25 +16,30 @@
 #include "GLSL.h"
 #include "MatrixStack.h"
 #include "Program.h"
+#include "Shape.h"
 
 #include "Node.h"
 #include "FaceTriangle.h"
 #include "Tetrahedron.h"
 #include "Body.h"
 #include "Vector.h"
+#include "TaskPool.h"
+#include "TetStore.h"
 
 using namespace std;
 using namespace Eigen;
 using json = nlohmann::json;
 
-SoftBody::SoftBody(): m_isInvertible(true), m_isGravity(false), m_isElasticForce(true){
+SoftBody::SoftBody(): m_isInvertible(true), m_isGravity(false), m_isElasticForce(true),
+	m_pool(nullptr), m_assembly(FEM_COLORED), m_isDeterministic(true), m_isBatched(false) {
 	m_color << 1.0f, 1.0f, 0.0f;
 	m_isInvert = false;
 }
 
 SoftBody::SoftBody(double density, double young, double poisson, Material material) :
 	m_density(density), m_young(young), m_poisson(poisson), m_material(material), 
-	m_isInvertible(true), m_isGravity(false), m_isElasticForce(true)
+	m_isInvertible(true), m_isGravity(false), m_isElasticForce(true),
+	m_pool(nullptr), m_assembly(FEM_COLORED), m_isDeterministic(true), m_isBatched(false)
 {
 	m_color << 1.0f, 1.0f, 0.0f;
 	m_isInvert= false;
@@ -91,6 +97,9 @@ void SoftBody::load(const string &RESOURCE_DIR, const string &MESH_NAME) {
 		tet->setInvertiblity(m_isInvertible);
 		m_tets.push_back(tet);
 	}
+	colorTets();
+	m_store = make_shared<TetStore>();
+	m_store->init(m_tets);
 
 	// Fix the normal of top and bottom surface
 	for (int i = 0; i < (int)m_trifaces.size(); i++) {
@@ -138,6 +147,10 @@ void SoftBody::init() {
 		eleBuf[3 * i + 2] = 3 * i + 2;
 	}
 
+	if (!Shape::isGPUEnabled()) {
+		return;
+	}
+
 	glGenBuffers(1, &posBufID);
 	glBindBuffer(GL_ARRAY_BUFFER, posBufID);
 	glBufferData(GL_ARRAY_BUFFER, posBuf.size() * sizeof(float), &posBuf[0], GL_DYNAMIC_DRAW);
@@ -608,8 +621,22 @@ void SoftBody::computeMass(Vector3d grav, MatrixXd &M) {
 	}
 }
 
-void SoftBody::computeForce(Vector3d grav, VectorXd &f) {
-	// Computes force vector
+void SoftBody::computeMass(Vector3d grav, vector<Tripletd> &M) {
+	// Computes maximal mass matrix as triplets
+	for (int i = 0; i < (int)m_nodes.size(); i++) {
+		int idxM = m_nodes[i]->idxM;
+		double m = m_nodes[i]->m;
+		for (int k = 0; k < 3; k++) {
+			M.push_back(Tripletd(idxM + k, idxM + k, m));
+		}
+	}
+	if (next != nullptr) {
+		next->computeMass(grav, M);
+	}
+}
+
+void SoftBody::computeForce(Vector3d grav, VectorXd &f, EnergySample *sample) {
+	// Computes force vector, and adds the energies and momentum to sample if given
 
 	if (m_isGravity) {
 		for (int i = 0; i < (int)m_nodes.size(); i++) {
@@ -619,40 +646,74 @@ void SoftBody::computeForce(Vector3d grav, VectorXd &f) {
 		}
 	}
 
+	if (sample != nullptr) {
+		for (int i = 0; i < (int)m_nodes.size(); i++) {
+			Vector3d x = m_nodes[i]->x;
+			Vector3d mv = m_nodes[i]->m * m_nodes[i]->v;
+			sample->energy.K += 0.5 * mv.dot(m_nodes[i]->v);
+			sample->energy.V -= m_nodes[i]->m * grav.dot(x);
+			sample->momentum.segment<3>(0) += x.cross(mv);
+			sample->momentum.segment<3>(3) += mv;
+		}
+	}
+
 	// Elastic Forces
 	if (m_isElasticForce) {
-		for (int i = 0; i < (int)m_tets.size(); i++) {
-			auto tet = m_tets[i];
-			f = tet->computeElasticForces(f);
+		if (m_isBatched && m_store != nullptr) {
+			m_xs.resize(3 * m_nodes.size());
+			for (int i = 0; i < (int)m_nodes.size(); i++) {
+				m_xs.segment<3>(3 * i) = m_nodes[i]->x;
+			}
+			parallelFor_(m_store->getNumBlocks(), [&](int b) { m_store->computeForces(b, m_xs); });
+			assembleForces([&](int i) -> const Vector12d & { return m_store->getForces(i); }, f);
+			if (sample != nullptr) {
+				for (int i = 0; i < (int)m_tets.size(); i++) {
+					sample->energy.V += m_store->getEnergy(i);
+				}
+			}
+		}
+		else {
+			assembleForces([&](int i) -> const Vector12d & { return m_tets[i]->computeElasticForces(); }, f);
+			if (sample != nullptr) {
+				for (int i = 0; i < (int)m_tets.size(); i++) {
+					sample->energy.V += m_tets[i]->getEnergy();
+				}
+			}
 		}
 	}
 
 
 	if (next != nullptr) {
-		next->computeForce(grav, f);
+		next->computeForce(grav, f, sample);
 	}
 }
 
 void SoftBody::computeStiffness(MatrixXd &K) {
-	VectorXd df(3 * m_nodes.size());
-	VectorXd Dx = df;
-
-	for (int i = 0; i < (int)m_tets.size(); i++) {
+	// Computes stiffness matrix from the element stiffnesses. The scatter is
+	// parallel per color; dense per-range buffers would cost too much memory,
+	// so FEM_BUFFERED scatters serially.
+	computeElementStiffnesses();
+	auto scatter = [&](int i) {
 		auto tet = m_tets[i];
-		for (int ii = 0; ii < 4; ii++) {
-			auto node = tet->m_nodes[ii];
-			int id = node->i;
-			int col = node->idxM;
-
-			for (int iii = 0; iii < 3; iii++) {
-				df.setZero();
-				Dx.setZero();
-				Dx(3 * id + iii) = 1.0;
-				tet->computeForceDifferentials(Dx, df);
-				//K.col(col + iii) += df;
-				K.block(col - 3 * id, col + iii, 3 * m_nodes.size(), 1) += df;
+		const Matrix12d &Ke = tet->getStiffness();
+		for (int a = 0; a < 4; a++) {
+			int col = tet->m_nodes[a]->idxM;
+			for (int b = 0; b < 4; b++) {
+				int row = tet->m_nodes[b]->idxM;
+				K.block<3, 3>(row, col) += Ke.block<3, 3>(3 * b, 3 * a);
 			}
 		}
+	};
+	if (m_pool != nullptr && m_assembly == FEM_COLORED) {
+		for (int c = 0; c < (int)m_colors.size(); c++) {
+			const vector<int> &tets = m_colors[c];
+			parallelFor_((int)tets.size(), [&](int k) { scatter(tets[k]); });
+		}
+	}
+	else {
+		for (int i = 0; i < (int)m_tets.size(); i++) {
+			scatter(i);
+		}
 	}
 
 	if (next != nullptr) {
@@ -661,6 +722,35 @@ void SoftBody::computeStiffness(MatrixXd &K) {
 
 }
 
+void SoftBody::computeStiffness(vector<Tripletd> &K) {
+	// Computes stiffness matrix as triplets from the element stiffnesses.
+	// Every tet owns 144 consecutive slots, so the writes never conflict and
+	// the order is the same as in the serial loop.
+	computeElementStiffnesses();
+	int offset = (int)K.size();
+	K.resize(offset + 144 * m_tets.size());
+	parallelFor_((int)m_tets.size(), [&](int i) {
+		auto tet = m_tets[i];
+		const Matrix12d &Ke = tet->getStiffness();
+		int slot = offset + 144 * i;
+		for (int a = 0; a < 4; a++) {
+			int col = tet->m_nodes[a]->idxM;
+			for (int b = 0; b < 4; b++) {
+				int row = tet->m_nodes[b]->idxM;
+				for (int c = 0; c < 3; c++) {
+					for (int r = 0; r < 3; r++) {
+						K[slot++] = Tripletd(row + r, col + c, Ke(3 * b + r, 3 * a + c));
+					}
+				}
+			}
+		}
+	});
+
+	if (next != nullptr) {
+		next->computeStiffness(K);
+	}
+}
+
 void SoftBody::computeJacobian(MatrixXd &J) {
 	for (int i = 0; i < (int)m_nodes.size(); i++) {
 		J.block<3, 3>(m_nodes[i]->idxM, m_nodes[i]->idxR) = Matrix3d::Identity();
@@ -672,6 +762,40 @@ void SoftBody::computeJacobian(MatrixXd &J) {
 
 }
 
+void SoftBody::computeJacobian(vector<Tripletd> &J) {
+	// Computes the identity pass-through Jacobian as triplets
+	for (int i = 0; i < (int)m_nodes.size(); i++) {
+		for (int k = 0; k < 3; k++) {
+			J.push_back(Tripletd(m_nodes[i]->idxM + k, m_nodes[i]->idxR + k, 1.0));
+		}
+	}
+
+	if (next != nullptr) {
+		next->computeJacobian(J);
+	}
+}
+
+void SoftBody::computeJacProd(const VectorXd &x, VectorXd &y) {
+	// The node rows of J are identity blocks
+	for (int i = 0; i < (int)m_nodes.size(); i++) {
+		y.segment<3>(m_nodes[i]->idxM) = x.segment<3>(m_nodes[i]->idxR);
+	}
+
+	if (next != nullptr) {
+		next->computeJacProd(x, y);
+	}
+}
+
+void SoftBody::computeJacTransProd(const VectorXd &y, VectorXd &x) {
+	for (int i = 0; i < (int)m_nodes.size(); i++) {
+		x.segment<3>(m_nodes[i]->idxR) = y.segment<3>(m_nodes[i]->idxM);
+	}
+
+	if (next != nullptr) {
+		next->computeJacTransProd(y, x);
+	}
+}
+
 Energy SoftBody::computeEnergies(Eigen::Vector3d grav, Energy ener) {
 	int n_nodes = (int)m_nodes.size();
 
@@ -683,9 +807,11 @@ Energy SoftBody::computeEnergies(Eigen::Vector3d grav, Energy ener) {
 		ener.V = ener.V - m * grav.dot(x);
 	}
 
+	// The tet energies are computed in parallel and summed in tet order
+	vector<double> vs(m_tets.size());
+	parallelFor_((int)m_tets.size(), [&](int i) { vs[i] = m_tets[i]->computeEnergy(); });
 	for (int i = 0; i < (int)m_tets.size(); i++) {
-		double vi = m_tets[i]->computeEnergy();
-		ener.V = ener.V + vi;
+		ener.V = ener.V + vs[i];
 	}
 
 	if (next != nullptr) {
@@ -695,6 +821,97 @@ Energy SoftBody::computeEnergies(Eigen::Vector3d grav, Energy ener) {
 	return ener;
 }
 
+void SoftBody::colorTets() {
+	// Greedy coloring: each tet takes the smallest color not used by an
+	// earlier tet that shares one of its nodes
+	vector<vector<int> > nodeColors(m_nodes.size());
+	m_colors.clear();
+	for (int i = 0; i < (int)m_tets.size(); i++) {
+		auto tet = m_tets[i];
+		int color = 0;
+		bool isUsed = true;
+		while (isUsed) {
+			isUsed = false;
+			for (int a = 0; a < 4 && !isUsed; a++) {
+				const vector<int> &colors = nodeColors[tet->m_nodes[a]->i];
+				isUsed = find(colors.begin(), colors.end(), color) != colors.end();
+			}
+			if (isUsed) {
+				color++;
+			}
+		}
+		if (color == (int)m_colors.size()) {
+			m_colors.push_back(vector<int>());
+		}
+		m_colors[color].push_back(i);
+		for (int a = 0; a < 4; a++) {
+			nodeColors[tet->m_nodes[a]->i].push_back(color);
+		}
+	}
+}
+
+void SoftBody::parallelFor_(int n, const function<void(int)> &task) const {
+	// Runs task(i) for every i on the pool, or serially without one
+	if (m_pool != nullptr) {
+		m_pool->parallelFor(n, task);
+	}
+	else {
+		for (int i = 0; i < n; i++) {
+			task(i);
+		}
+	}
+}
+
+void SoftBody::assembleForces(const function<const Vector12d &(int)> &elementForces, VectorXd &f) {
+	// Computes every tet's nodal forces with elementForces and adds them to f
+	int ntets = (int)m_tets.size();
+	auto add = [&](int i, VectorXd &fi, bool isGlobal) {
+		auto tet = m_tets[i];
+		const Vector12d &fe = elementForces(i);
+		for (int a = 0; a < 4; a++) {
+			int row = isGlobal ? tet->m_nodes[a]->idxM : 3 * tet->m_nodes[a]->i;
+			fi.segment<3>(row) += fe.segment<3>(3 * a);
+		}
+	};
+
+	if (m_pool == nullptr) {
+		for (int i = 0; i < ntets; i++) {
+			add(i, f, true);
+		}
+	}
+	else if (m_assembly == FEM_COLORED) {
+		for (int c = 0; c < (int)m_colors.size(); c++) {
+			const vector<int> &tets = m_colors[c];
+			m_pool->parallelFor((int)tets.size(), [&](int k) { add(tets[k], f, true); });
+		}
+	}
+	else {
+		int nranges = m_isDeterministic ? 64 : 4 * m_pool->getNumThreads();
+		nranges = max(1, min(nranges, ntets));
+		m_buffers.resize(nranges);
+		m_pool->parallelFor(nranges, [&](int r) {
+			m_buffers[r].setZero(3 * m_nodes.size());
+			int begin = (int)((long long)ntets * r / nranges);
+			int end = (int)((long long)ntets * (r + 1) / nranges);
+			for (int i = begin; i < end; i++) {
+				add(i, m_buffers[r], false);
+			}
+		});
+		// Each node sums the ranges in order
+		m_pool->parallelFor((int)m_nodes.size(), [&](int k) {
+			int row = m_nodes[k]->idxM;
+			for (int r = 0; r < nranges; r++) {
+				f.segment<3>(row) += m_buffers[r].segment<3>(3 * k);
+			}
+		});
+	}
+}
+
+void SoftBody::computeElementStiffnesses() {
+	// Computes the 12x12 stiffness of every tet, kept in the tets
+	parallelFor_((int)m_tets.size(), [&](int i) { m_tets[i]->computeStiffness(); });
+}
+
 SoftBody:: ~SoftBody() {
 
 
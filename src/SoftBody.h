@@ -4,6 +4,7 @@
 
 #include <vector>
 #include <memory>
+#include <functional>
 
 #define EIGEN_DONT_ALIGN_STATICALLY
 #include <Eigen/Dense>
@@ -16,6 +17,8 @@ class Body;
 class FaceTriangle;
 class Tetrahedron;
 class Vector;
+class TaskPool;
+class TetStore;
 
 class SoftBody {
 
@@ -33,8 +36,13 @@ public:
 	virtual void computeJacobian(Eigen::MatrixXd &J);
 	virtual void computeMass(Eigen::Vector3d grav, Eigen::MatrixXd &M);
 	virtual Energy computeEnergies(Eigen::Vector3d grav, Energy ener);
-	virtual void computeForce(Eigen::Vector3d grav, Eigen::VectorXd &f);
+	virtual void computeForce(Eigen::Vector3d grav, Eigen::VectorXd &f, EnergySample *sample = nullptr);
 	virtual void computeStiffness(Eigen::MatrixXd &K);
+	virtual void computeJacobian(std::vector<Tripletd> &J);
+	virtual void computeJacProd(const Eigen::VectorXd &x, Eigen::VectorXd &y);
+	virtual void computeJacTransProd(const Eigen::VectorXd &y, Eigen::VectorXd &x);
+	virtual void computeMass(Eigen::Vector3d grav, std::vector<Tripletd> &M);
+	virtual void computeStiffness(std::vector<Tripletd> &K);
 	virtual Eigen::VectorXd gatherDofs(Eigen::VectorXd y, int nr);
 	virtual Eigen::VectorXd gatherDDofs(Eigen::VectorXd ydot, int nr);
 	virtual void scatterDofs(Eigen::VectorXd &y, int nr);
@@ -58,6 +66,25 @@ public:
 	void setInvertiblity(bool isInvertible) { m_isInvertible = isInvertible; }
 	bool getInvertiblity() { return m_isInvertible; }
 
+	// Not owned. With a pool the tet loops of the force, stiffness and energy
+	// computations run in parallel; without one they run serially in tet order.
+	void setTaskPool(TaskPool *pool) { m_pool = pool; }
+
+	// FEM_COLORED processes the tets one color at a time, where tets of one
+	// color share no nodes, and writes to the shared nodes directly. The sums
+	// at each node are then in color order, whatever the number of threads.
+	// FEM_BUFFERED adds the forces of contiguous tet ranges into separate
+	// buffers and sums the buffers in range order. Its ranges follow the
+	// number of threads unless isDeterministic, in which case a fixed number
+	// is used so that the results do not depend on the machine.
+	void setAssembly(FEMAssembly assembly, bool isDeterministic = true) { m_assembly = assembly; m_isDeterministic = isDeterministic; }
+	int getNumColors() const { return (int)m_colors.size(); }
+
+	// Computes the elastic forces with the packed, lane-batched kernels of
+	// TetStore instead of the per-tet path, which is kept as the reference.
+	// Only SoftBody::computeForce uses it; the invertible FEM does not.
+	void setBatched(bool isBatched) { m_isBatched = isBatched; }
+
 	void transform(Eigen::Vector3d dx);
 	
 	// attached 
@@ -79,6 +106,11 @@ public:
 	bool m_isInvert;
 
 protected:
+	void colorTets();
+	void parallelFor_(int n, const std::function<void(int)> &task) const;
+	void assembleForces(const std::function<const Vector12d &(int)> &elementForces, Eigen::VectorXd &f);
+	void computeElementStiffnesses();
+
 	bool m_isInvertible;
 	bool m_isGravity;
 	bool m_isElasticForce;
@@ -89,6 +121,18 @@ protected:
 	std::vector<std::shared_ptr<Node> > m_nodes;	
 	std::vector<std::shared_ptr<Tetrahedron> > m_tets;
 
+	// Parallel assembly
+	TaskPool *m_pool;
+	FEMAssembly m_assembly;
+	bool m_isDeterministic;
+	std::vector<std::vector<int> > m_colors;	// Tet indices of each color
+	std::vector<Eigen::VectorXd> m_buffers;		// Per-range forces for FEM_BUFFERED, indexed by node->i
+
+	// Batched elastic forces
+	bool m_isBatched;
+	std::shared_ptr<TetStore> m_store;
+	Eigen::VectorXd m_xs;						// Node positions, indexed by node->i
+
 	std::vector<unsigned int> eleBuf;
 	std::vector<float> posBuf;
 	std::vector<float> norBuf;
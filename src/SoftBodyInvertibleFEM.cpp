@@ -23,8 +23,8 @@ SoftBody(density, young, poisson, material)
 	m_isGravity = true;
 }
 
-void SoftBodyInvertibleFEM::computeForce(Vector3d grav, VectorXd &f) {
-	// Computes force vector
+void SoftBodyInvertibleFEM::computeForce(Vector3d grav, VectorXd &f, EnergySample *sample) {
+	// Computes force vector, and adds the energies and momentum to sample if given
 
 	if (m_isGravity) {
 		for (int i = 0; i < (int)m_nodes.size(); i++) {
@@ -33,52 +33,30 @@ void SoftBodyInvertibleFEM::computeForce(Vector3d grav, VectorXd &f) {
 			f.segment<3>(idxM) += m * grav;
 		}
 	}
+
+	if (sample != nullptr) {
+		for (int i = 0; i < (int)m_nodes.size(); i++) {
+			Vector3d x = m_nodes[i]->x;
+			Vector3d mv = m_nodes[i]->m * m_nodes[i]->v;
+			sample->energy.K += 0.5 * mv.dot(m_nodes[i]->v);
+			sample->energy.V -= m_nodes[i]->m * grav.dot(x);
+			sample->momentum.segment<3>(0) += x.cross(mv);
+			sample->momentum.segment<3>(3) += mv;
+		}
+	}
 	//m_isInvert = false;
 	// Elastic Forces
 	if (m_isElasticForce) {
-		for (int i = 0; i < (int)m_tets.size(); i++) {
-			auto tet = m_tets[i];
-			f = tet->computeInvertibleElasticForces(f);
-			if (tet->isInvert) {
-				//m_isInvert = true;
+		assembleForces([&](int i) -> const Vector12d & { return m_tets[i]->computeInvertibleElasticForces(); }, f);
+		if (sample != nullptr) {
+			for (int i = 0; i < (int)m_tets.size(); i++) {
+				sample->energy.V += m_tets[i]->getEnergy();
 			}
 		}
 	}
 
 
 	if (next != nullptr) {
-		next->computeForce(grav, f);
+		next->computeForce(grav, f, sample);
 	}
 }
-
-
-void SoftBodyInvertibleFEM::computeStiffness(MatrixXd &K) {
-	VectorXd df(3 * m_nodes.size());
-	VectorXd Dx = df;
-
-	for (int i = 0; i < (int)m_tets.size(); i++) {
-		auto tet = m_tets[i];
-		for (int ii = 0; ii < 4; ii++) {
-			auto node = tet->m_nodes[ii];
-			int id = node->i;
-			int col = node->idxM;
-
-			for (int iii = 0; iii < 3; iii++) {
-				df.setZero();
-				Dx.setZero();
-				Dx(3 * id + iii) = 1.0;
-				tet->computeForceDifferentials(Dx, df);
-				//tet->computeInvertibleForceDifferentials(Dx, df);
-				//K.col(col + iii) += df;
-				K.block(col - 3 * id, col + iii, 3 * m_nodes.size(), 1) += df;
-			}
-		}
-	}
-	//K.setZero();
-
-	if (next != nullptr) {
-		next->computeStiffness(K);
-	}
-
-}
-
@@ -10,8 +10,7 @@ public:
 	SoftBodyInvertibleFEM();
 	SoftBodyInvertibleFEM(double density, double young, double poisson, Material material);
 	virtual ~SoftBodyInvertibleFEM() {};
-	void computeStiffness(Eigen::MatrixXd &K);
-	void computeForce(Eigen::Vector3d grav, Eigen::VectorXd &f);
+	void computeForce(Eigen::Vector3d grav, Eigen::VectorXd &f, EnergySample *sample = nullptr);
 	
 protected:
 
@@ -10,6 +10,8 @@
 #include "ConstraintLoop.h"
 #include "ConstraintAttachSpring.h"
 #include "QuadProgMosek.h"
+#include "QuadProgActiveSet.h"
+#include "LinearSolver.h"
 
 #include <iostream>
 #include <fstream>
@@ -17,442 +19,476 @@
 
 using namespace std;
 using namespace Eigen;
-
-
-Solver::Solver()
+using json = nlohmann::json;
+
+
+Solver::Solver() :
+	m_eqSolver(EQ_AUTO),
+	m_eqSolverUsed(EQ_KKT),
+	m_nullSpaceRatio(0.5),
+	m_qpSolver(QP_ACTIVE_SET),
+	m_isMallocCheck(false),
+	m_isMallocAllowed(true),
+	m_nsteps(0),
+	m_energyInterval(0),
+	m_energySteps(0),
+	m_isSparse(false),
+	m_isMatrixFree(false),
+	m_cgTol(1e-10),
+	m_cgMaxIters(200),
+	m_cgIters(0),
+	m_rtol(1e-6),
+	m_atol(1e-8),
+	m_hODE(1e-3)
 {
 	m_solutions = make_shared<Solution>();
+	m_linearSolver = make_shared<LinearSolver>(true);
+	m_linearSolverKKT = make_shared<LinearSolver>(false);
+	m_qp = make_shared<QuadProgActiveSet>();
 }
 
 Solver::Solver(shared_ptr<World> world, Integrator integrator) :
 	m_world(world),
-	m_integrator(integrator)
+	m_integrator(integrator),
+	m_eqSolver(EQ_AUTO),
+	m_eqSolverUsed(EQ_KKT),
+	m_nullSpaceRatio(0.5),
+	m_qpSolver(QP_ACTIVE_SET),
+	m_isMallocCheck(false),
+	m_isMallocAllowed(true),
+	m_nsteps(0),
+	m_energyInterval(0),
+	m_energySteps(0),
+	m_isSparse(false),
+	m_isMatrixFree(false),
+	m_cgTol(1e-10),
+	m_cgMaxIters(200),
+	m_cgIters(0),
+	m_rtol(1e-6),
+	m_atol(1e-8),
+	m_hODE(1e-3)
 {
 	m_solutions = make_shared<Solution>();
+	m_linearSolver = make_shared<LinearSolver>(true);
+	m_linearSolverKKT = make_shared<LinearSolver>(false);
+	m_qp = make_shared<QuadProgActiveSet>();
 }
 
 void Solver::init() {
+	// Sizes the workspace once from the world counts
+	nr = m_world->nr;
+	nm = m_world->nm;
+	int nem = m_world->nem;
+	int ner = m_world->ner;
+	int ne = nem + ner;
+	int nim = m_world->nim;
+	int nir = m_world->nir;
+
+	M.setZero(nm, nm);
+	K.setZero(nm, nm);
+	f.setZero(nm);
+	J.setZero(nm, nr);
+	Jdot.setZero(nm, nr);
+	MK.setZero(nm, nm);
+	JtMK.setZero(nr, nm);
+	Jdotqdot.setZero(nm);
+	fm.setZero(nm);
+
+	q0.setZero(nr);
+	q1.setZero(nr);
+	qdot0.setZero(nr);
+	qdot1.setZero(nr);
+	qddot.setZero(nr);
+
+	Mtilde.setZero(nr, nr);
+	ftilde.setZero(nr);
+	fr.setZero(nr);
+	fsr.setZero(nr);
+	fdr.setZero(nr);
+	Ksr.setZero(nr, nr);
+	Ddr.setZero(nr, nr);
 
+	// constraints
+	Gm.setZero(nem, nm);
+	Gmdot.setZero(nem, nm);
+	gm.setZero(nem);
+	gmdot.setZero(nem);
+	gmddot.setZero(nem);
+
+	Gr.setZero(ner, nr);
+	Grdot.setZero(ner, nr);
+	gr.setZero(ner);
+	grdot.setZero(ner);
+	grddot.setZero(ner);
+
+	G.setZero(ne, nr);
+	g.setZero(ne);
+	gdot.setZero(ne);
+	rhsG.setZero(ne);
+	Gmt.setZero(nm, nem);
+	Grt.setZero(nr, ner);
+	lm.setZero(nem);
+	lr.setZero(ner);
+
+	LHS.setZero(nr + ne, nr + ne);
+	rhs.setZero(nr + ne);
+	sol.setZero(nr + ne);
+	m_ldlt = LDLT<MatrixXd>(nr);
+	m_ldltKKT = LDLT<MatrixXd>(nr + ne);
+
+	eqY.setZero(nr, ne);
+	eqS.setZero(ne, ne);
+	m_ldltS = LDLT<MatrixXd>(ne);
+	m_qrG = ColPivHouseholderQR<MatrixXd>(nr, ne);
+	eqQ.setZero(nr, nr);
+	eqQws.setZero(nr);
+	resizeNullSpace(nr - min(ne, nr));	// Assumes G has full row rank
+	eqx.setZero(nr);
+	eqr.setZero(nr);
+	eqw.setZero(ne);
+
+	Cm.setZero(nim, nm);
+	Cmdot.setZero(nim, nm);
+	cm.setZero(nim);
+	cmdot.setZero(nim);
+	cmddot.setZero(nim);
+
+	Cr.setZero(nir, nr);
+	Crdot.setZero(nir, nr);
+	cr.setZero(nir);
+	crdot.setZero(nir);
+	crddot.setZero(nir);
+
+	C.setZero(nim + nir, nr);
+	c.setZero(nim + nir);
+	cdot.setZero(nim + nir);
+	rhsC.setZero(nim + nir);
+	cvec.setZero(nim + nir);
+	qpf.setZero(nr);
+	rowsM.reserve(nim);
+	rowsR.reserve(nir);
+	qpKeys.reserve(nim + nir);
+
+	yk.setZero(2 * nr);
+	ydotk.setZero(2 * nr);
+	m_nsteps = 0;
+	m_energySteps = 0;
+	m_energySamples.clear();
+	m_hODE = m_world->getH();
+	m_odeStats = ODEStats();
+
+	// The topology may have changed
+	m_linearSolver->clear();
+	m_linearSolverKKT->clear();
+	m_qp->clearWarmStart();
+	m_qp->reserve(nr, nim + nir, ne);
+	m_mosek = nullptr;
 }
 
 void Solver::load(const string &RESOURCE_DIR) {
-
+	//read a JSON file
+	ifstream i(RESOURCE_DIR + "input.json");
+	json js;
+	i >> js;
+	i.close();
+
+	if (js.count("isSparse")) {
+		m_isSparse = js["isSparse"];
+	}
+	if (js.count("rtol")) {
+		m_rtol = js["rtol"];
+	}
+	if (js.count("atol")) {
+		m_atol = js["atol"];
+	}
+	if (js.count("isMatrixFree")) {
+		m_isMatrixFree = js["isMatrixFree"];
+	}
+	if (js.count("equalitySolver")) {
+		string eqSolver = js["equalitySolver"];
+		if (eqSolver == "KKT") {
+			m_eqSolver = EQ_KKT;
+		}
+		else if (eqSolver == "RANGE_SPACE") {
+			m_eqSolver = EQ_RANGE_SPACE;
+		}
+		else if (eqSolver == "NULL_SPACE") {
+			m_eqSolver = EQ_NULL_SPACE;
+		}
+		else {
+			m_eqSolver = EQ_AUTO;
+		}
+	}
+	if (js.count("qpSolver")) {
+		string qpSolver = js["qpSolver"];
+		m_qpSolver = (qpSolver == "MOSEK") ? QP_MOSEK : QP_ACTIVE_SET;
+	}
+	if (js.count("integrator")) {
+		string integrator = js["integrator"];
+		if (integrator == "REDUCED_EULER") {
+			m_integrator = REDUCED_EULER;
+		}
+		else if (integrator == "REDUCED_ODE45") {
+			m_integrator = REDUCED_ODE45;
+		}
+		else if (integrator == "REDMAX_ODE45") {
+			m_integrator = REDMAX_ODE45;
+		}
+		else if (integrator == "REDMAX_EULER") {
+			m_integrator = REDMAX_EULER;
+		}
+	}
 }
 
 void Solver::reset() {
-	int nr = m_world->nr;
-	int nm = m_world->nm;
-	// constraints
-	int nem = m_world->nem;
-	int ner = m_world->ner;
-	int ne = nem + ner;
+	// Re-zeros the workspace
+	init();
+}
+
+void Solver::setMallocAllowed(bool isAllowed) {
+	// Toggles Eigen's allocation check when the test hook is enabled
+	m_isMallocAllowed = isAllowed;
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+	if (m_isMallocCheck) {
+		Eigen::internal::set_is_malloc_allowed(isAllowed);
+	}
+#endif
+}
+
+void Solver::resizeNullSpace(int nz) {
+	// Sizes the reduced system on the null space of G for nz = nr - rank(G).
+	// Only called when the rank changes, so it may allocate mid-step.
+	bool isAllowed = m_isMallocAllowed;
+	setMallocAllowed(true);
+	eqMZ.setZero(nr, nz);
+	eqZMZ.setZero(nz, nz);
+	eqz.setZero(nz);
+	m_ldltZ = LDLT<MatrixXd>(nz);
+	setMallocAllowed(isAllowed);
+}
+
+EnergySample *Solver::getEnergySample(double t) {
+	// Returns the sample for the step starting at t to fill, or nullptr
+	// when the monitor is off or this step is not sampled
+	if (m_energyInterval <= 0 || m_energySteps % m_energyInterval != 0) {
+		return nullptr;
+	}
+	m_energySample = EnergySample();
+	m_energySample.t = t;
+	return &m_energySample;
+}
+
+void Solver::commitEnergySample(const EnergySample *sample) {
+	// Ends the step, keeping the sample if one was filled
+	if (m_energyInterval <= 0) {
+		return;
+	}
+	if (sample != nullptr) {
+		m_energySamples.push_back(*sample);
+	}
+	m_energySteps++;
+}
+
+void Solver::assemble(double h, Vector3d grav, EnergySample *sample) {
+	// Computes Mtilde, fr and ftilde in the workspace.
+	// M, J and Jdot are overwritten block by block with a pattern fixed by
+	// the topology, so only the accumulated terms are zeroed here.
+	// If sample is given, the energies and momentum are added to it by the
+	// same passes that compute the forces.
+	auto body0 = m_world->getBody0();
+	auto joint0 = m_world->getJoint0();
+	auto deformable0 = m_world->getDeformable0();
+	auto softbody0 = m_world->getSoftBody0();
 
-	M.resize(nm, nm);
-	M.setZero();
-	K.resize(nm, nm);
 	K.setZero();
-	f.resize(nm);
 	f.setZero();
-
-	Mtilde.resize(nr, nr);
-	Mtilde.setZero();
-	ftilde.resize(nr, 1);
-	ftilde.setZero();
-	fr.resize(nr, 1);
-	fr.setZero();
-	fdr.resize(nr, 1);
-	fsr.resize(nr, 1);
-	Ksr.resize(nr, nr);
+	fsr.setZero();
+	fdr.setZero();
 	Ksr.setZero();
-	Ddr.resize(nr, nr);
 	Ddr.setZero();
 
+	// sceneFcn()
+	body0->computeMassGrav(grav, M, f, sample);
+	deformable0->computeMass(grav, M, f, sample);
+
+	softbody0->computeMass(grav, M);
+	softbody0->computeForce(grav, f, sample);
+	softbody0->computeStiffness(K);
+
+	joint0->computeForceStiffness(fsr, Ksr, sample);
+	joint0->computeForceDamping(fdr, Ddr);
+
+	joint0->computeJacobian(J, Jdot, nm, nr);
+	// spring jacobian todo
+	deformable0->computeJacobian(J, Jdot);
+	softbody0->computeJacobian(J);
+
+	// Mtilde = J' * (M - h^2 K) * J, symmetrized in place
+	MK = M;
+	MK -= (h * h) * K;
+	JtMK.noalias() = J.transpose() * MK;
+	Mtilde.noalias() = JtMK * J;
+	for (int i = 0; i < nr; i++) {
+		for (int j = i + 1; j < nr; j++) {
+			double a = 0.5 * (Mtilde(i, j) + Mtilde(j, i));
+			Mtilde(i, j) = a;
+			Mtilde(j, i) = a;
+		}
+	}
 
-	J.resize(nm, nr);
-	Jdot.resize(nm, nr);
-	J.setZero();
-	Jdot.setZero();
-
-	Gm.resize(nem, nm);
-	Gm.setZero();
-	Gmdot.resize(nem, nm);
-	Gmdot.setZero();
-	gm.resize(nem);
-	gm.setZero();
-	gmdot.resize(nem);
-	gmdot.setZero();
-	gmddot.resize(nem);
-	gmddot.setZero();
-
-	Gr.resize(ner, nr);
-	Gr.setZero();
-	Grdot.resize(ner, nr);
-	Grdot.setZero();
-	gr.resize(ner);
-	gr.setZero();
-	grdot.resize(ner);
-	grdot.setZero();
-	grddot.resize(ner);
-	grddot.setZero();
-
-	G.resize(ne, nr);
-	g.resize(ne);
-	rhsG.resize(ne);
-	gdot.resize(ne);
-	G.setZero();
-	g.setZero();
-	gdot.setZero();
-	rhsG.setZero();
+	// fr = J' * (f - M * Jdot * qdot0) + fsr
+	Jdotqdot.noalias() = Jdot * qdot0;
+	fm = f;
+	fm.noalias() -= M * Jdotqdot;
+	fr.noalias() = J.transpose() * fm;
+	fr += fsr;
+
+	ftilde.noalias() = Mtilde * qdot0;
+	ftilde += h * fr;
+	Mtilde += h * Ddr;
+	Mtilde -= (h * h) * Ksr;
+}
 
+int Solver::assembleConstraints(double alpha) {
+	// Computes G, rhsG and the active rows of C, and returns the number of active inequalities.
+	// The active rows come first in C, c, cdot and rhsC, which are sized for all of them.
+	// alpha is the Baumgarte stabilization coefficient for the equality constraints.
+	auto constraint0 = m_world->getConstraint0();
+	int nem = m_world->nem;
+	int ner = m_world->ner;
+	int ne = nem + ner;
 	int nim = m_world->nim;
 	int nir = m_world->nir;
 	int ni = nim + nir;
 
-	Cm.resize(nim, nm);
-	Cm.setZero();
-	Cmdot.resize(nim, nm);
-	Cmdot.setZero();
-	cm.resize(nim);
-	cm.setZero();
-	cmdot.resize(nim);
-	cmdot.setZero();
-	cmddot.resize(nim);
-	cmddot.setZero();
-
-	Cr.resize(nir, nr);
-	Cr.setZero();
-	Crdot.resize(nir, nr);
-	Crdot.setZero();
-	cr.resize(nir);
-	cr.setZero();
-	crdot.resize(nir);
-	crdot.setZero();
-	crddot.resize(nir);
-	crddot.setZero();
-
-	M.setZero();
-	K.setZero();
-	f.setZero();
-	J.setZero();
-	Jdot.setZero();
-	g.setZero();
-	gdot.setZero();
-	gm.setZero();
-	gmdot.setZero();
-	gmddot.setZero();
-	gr.setZero();
-	grdot.setZero();
-	grddot.setZero();
-	Gr.setZero();
-	Grdot.setZero();
-	Gm.setZero();
-	Gmdot.setZero();
-	G.setZero();
-	rhsG.setZero();
-}
-
-
-Eigen::VectorXd Solver::dynamics(Eigen::VectorXd y)
-{
-	switch (m_integrator)
-	{
-	case REDMAX_EULER:
-	{
-		int nr = m_world->nr;
-		int nm = m_world->nm;
-
-		M.resize(nm, nm);
-		M.setZero();
-		Mtilde.resize(nr, nr);
-		Mtilde.setZero();
-		ftilde.resize(nr, 1);
-		ftilde.setZero();
-		fr.resize(nr, 1);
-		fr.setZero();
-		fdr.resize(nr, 1);
-		fsr.resize(nr, 1);
-		fdr.setZero();
-		fsr.setZero();
-		Ksr.resize(nr, nr);
-		Ksr.setZero();
-		Ddr.resize(nr, nr);
-		Ddr.setZero();
-
-		K.resize(nm, nm);
-		K.setZero();
-		f.resize(nm);
-		f.setZero();
-		J.resize(nm, nr);
-		Jdot.resize(nm, nr);
-		J.setZero();
-		Jdot.setZero();
-
-		// constraints
-		int nem = m_world->nem;
-		int ner = m_world->ner;
-		int ne = nem + ner;
-
-		Gm.resize(nem, nm);
+	if (ne > 0) {
 		Gm.setZero();
-		Gmdot.resize(nem, nm);
 		Gmdot.setZero();
-
-		gm.resize(nem);
 		gm.setZero();
-		gmdot.resize(nem);
 		gmdot.setZero();
-		gmddot.resize(nem);
 		gmddot.setZero();
-
-		Gr.resize(ner, nr);
 		Gr.setZero();
-		Grdot.resize(ner, nr);
 		Grdot.setZero();
-
-		
-		gr.resize(ner);
 		gr.setZero();
-		grdot.resize(ner);
 		grdot.setZero();
-		grddot.resize(ner);
 		grddot.setZero();
 
-		G.resize(ne, nr);
-		g.resize(ne);
-		rhsG.resize(ne);
-		gdot.resize(ne);
-		G.setZero();
-		g.setZero();
-		gdot.setZero();
-		rhsG.setZero();
-
-		auto body0 = m_world->getBody0();
-		auto joint0 = m_world->getJoint0();
-		auto deformable0 = m_world->getDeformable0();
-		auto softbody0 = m_world->getSoftBody0();
-		auto constraint0 = m_world->getConstraint0();
-
-		double t = m_world->getTspan()(0);
-		double h = m_world->getH();
-		Vector3d grav = m_world->getGrav();
-
-		VectorXd yk(2 * nr);
-		VectorXd ydotk(2 * nr);
-
-		int nim = m_world->nim;
-		int nir = m_world->nir;
-		int ni = nim + nir;
+		constraint0->computeJacEqM(Gm, Gmdot, gm, gmdot, gmddot);
+		constraint0->computeJacEqR(Gr, Grdot, gr, grdot, grddot);
+		G.topRows(nem).noalias() = Gm * J;
+		G.bottomRows(ner) = Gr;
+		g.head(nem) = gm;
+		g.tail(ner) = gr;
+		rhsG = -gdot - alpha * g;
+	}
 
-		Cm.resize(nim, nm);
+	if (ni > 0) {
+		// Check for active inequality constraint
 		Cm.setZero();
-		Cmdot.resize(nim, nm);
 		Cmdot.setZero();
-		cm.resize(nim);
 		cm.setZero();
-		cmdot.resize(nim);
 		cmdot.setZero();
-		cmddot.resize(nim);
 		cmddot.setZero();
-
-		Cr.resize(nir, nr);
 		Cr.setZero();
-		Crdot.resize(nir, nr);
 		Crdot.setZero();
-		cr.resize(nir);
 		cr.setZero();
-		crdot.resize(nir);
 		crdot.setZero();
-		crddot.resize(nir);
 		crddot.setZero();
 
-		M.setZero();
-		K.setZero();
-		f.setZero();
-		J.setZero();
-		Jdot.setZero();
-		g.setZero();
-		gdot.setZero();
-		gm.setZero();
-		gmdot.setZero();
-		gmddot.setZero();
-		gr.setZero();
-		grdot.setZero();
-		grddot.setZero();
-		Gr.setZero();
-		Grdot.setZero();
-		Gm.setZero();
-		Gmdot.setZero();
-		G.setZero();
-		rhsG.setZero();
-		
-
-		// sceneFcn()
-		body0->computeMassGrav(grav, M, f);
+		constraint0->computeJacIneqM(Cm, Cmdot, cm, cmdot, cmddot);
+		constraint0->computeJacIneqR(Cr, Crdot, cr, crdot, crddot);
+		rowsR.clear();
+		rowsM.clear();
 
-		deformable0->computeMass(grav, M, f);
-		deformable0->computeForceDamping(grav, tmp, Dm);
+		constraint0->getActiveList(rowsM, rowsR);
+		nim = (int)rowsM.size();
+		nir = (int)rowsR.size();
+		ni = nim + nir;
 
+		for (int k = 0; k < nim; k++) {
+			C.row(k).noalias() = Cm.row(rowsM[k]) * J;
+			c(k) = cm(rowsM[k]);
+			cdot(k) = cmdot(rowsM[k]);
+		}
+		for (int k = 0; k < nir; k++) {
+			C.row(nim + k) = Cr.row(rowsR[k]);
+			c(nim + k) = cr(rowsR[k]);
+			cdot(nim + k) = crdot(rowsR[k]);
+		}
+		rhsC.head(ni) = -cdot.head(ni) - 5.0 * c.head(ni);
+	}
+	return ni;
+}
 
-		softbody0->computeMass(grav, M);
-		softbody0->computeForce(grav, f);
+Eigen::VectorXd Solver::dynamics(const Eigen::VectorXd &y)
+{
+	switch (m_integrator)
+	{
+	case REDUCED_ODE45:
+	case REDMAX_ODE45:
+		if (m_world->nim + m_world->nir == 0) {
+			// On step size underflow the state reached is returned, see getODEStats()
+			double t = m_world->getTime();
+			VectorXd y1 = y;
+			integrateODE45(y1, t, t + m_world->getH(), nullptr);
+			return y1;
+		}
+		// Falls through - inequality constraints need the velocity-level step
+	case REDUCED_EULER:
+		if (isRecursive()) {
+			EnergySample *sample = getEnergySample(m_world->getTime());
+			VectorXd y1 = dynamicsRecursive(y, sample);
+			commitEnergySample(sample);
+			return y1;
+		}
+		// Falls through - soft bodies, deformables and constraints use the maximal path
+	case REDMAX_EULER:
+	{
+		if (m_isSparse) {
+			EnergySample *sample = getEnergySample(m_world->getTime());
+			VectorXd y1 = dynamicsSparse(y, 100.0, sample);
+			commitEnergySample(sample);
+			return y1;
+		}
+		int nem = m_world->nem;
+		int ner = m_world->ner;
+		int ne = nem + ner;
 
-		softbody0->computeStiffness(K);
+		auto joint0 = m_world->getJoint0();
+		auto deformable0 = m_world->getDeformable0();
+		auto softbody0 = m_world->getSoftBody0();
+		auto constraint0 = m_world->getConstraint0();
 
-		joint0->computeForceStiffness(fsr, Ksr);
-		joint0->computeForceDamping(fdr, Ddr);
-		
-		joint0->computeJacobian(J, Jdot, nm, nr);
+		double h = m_world->getH();
+		Vector3d grav = m_world->getGrav();
 
-		// spring jacobian todo
-		deformable0->computeJacobian(J, Jdot);
-		softbody0->computeJacobian(J);
+		// The first step may still size the workspace lazily
+		setMallocAllowed(m_nsteps == 0);
 
 		q0 = y.segment(0, nr);
 		qdot0 = y.segment(nr, nr);
 
-		Mtilde = J.transpose() * (M - h * h * K) * J;
-		Mtilde = 0.5 * (Mtilde + Mtilde.transpose());
-
-		fr = J.transpose() * (f - M * Jdot * qdot0) + fsr;
-
-		ftilde = Mtilde * qdot0 + h * fr;
-		Mtilde = Mtilde + h * Ddr - h * h * Ksr;
-		
-		if (ne > 0) {
-			
-			constraint0->computeJacEqM(Gm, Gmdot, gm, gmdot, gmddot);
-			constraint0->computeJacEqR(Gr, Grdot, gr, grdot, grddot);
-			G.block(0, 0, nem, nr) = Gm * J;
-			G.block(nem, 0, ner, nr) = Gr;
-			g.segment(0, nem) = gm;
-			g.segment(nem, ner) = gr;
-			rhsG = -gdot - 100.0 * g;// todo!!!!!
-
-		}
-
-		if (ni > 0) {
-			// Check for active inequality constraint
-			constraint0->computeJacIneqM(Cm, Cmdot, cm, cmdot, cmddot);
-			constraint0->computeJacIneqR(Cr, Crdot, cr, crdot, crddot);
-			rowsR.clear();
-			rowsM.clear();
-
-			constraint0->getActiveList(rowsM, rowsR);
-			nim = rowsM.size();
-			nir = rowsR.size();
-			ni = nim + nir;
-
-			if (ni > 0) {
-				Eigen::VectorXi m_rowsM = Eigen::Map<Eigen::VectorXi, Eigen::Unaligned>(rowsM.data(), rowsM.size());
-				Eigen::VectorXi m_rowsR = Eigen::Map<Eigen::VectorXi, Eigen::Unaligned>(rowsR.data(), rowsR.size());
-
-				MatrixXd m_Cm = Cm(m_rowsM, Eigen::placeholders::all);
-				MatrixXd m_Cr = Cr(m_rowsR, Eigen::placeholders::all);
-				MatrixXd CmJ = m_Cm * J;
-				C.resize(CmJ.rows() + m_Cr.rows(), m_Cr.cols());
-				C << CmJ, m_Cr;
-				rhsC.resize(C.rows());
-				VectorXd c(C.rows());
-				c << cm, cr;
-				VectorXd cdot(C.rows());
-				cdot << Cmdot, Crdot;
-				rhsC = -cdot - 5.0 * c;
-				
-
-			}
-		}
+		EnergySample *sample = getEnergySample(m_world->getTime());
+		assemble(h, grav, sample);
+		int ni = assembleConstraints(100.0);// todo!!!!!
 
 		if (ne == 0 && ni == 0) {	// No constraints	
-			qdot1 = Mtilde.ldlt().solve(ftilde);
+			m_ldlt.compute(Mtilde);
+			qdot1 = m_ldlt.solve(ftilde);
 		}
 		else if (ne > 0 && ni == 0) {  // Just equality
-			int rows = Mtilde.rows() + G.rows();
-			int cols = Mtilde.cols() + G.rows();
-			MatrixXd LHS(rows, cols);
-			VectorXd rhs(rows);
-			LHS.setZero();
-			rhs.setZero();
-			LHS.block(0, 0, Mtilde.rows(), Mtilde.cols()) = Mtilde;
-			LHS.block(0, Mtilde.cols(), Mtilde.rows(), G.rows()) = G.transpose();
-			LHS.block(Mtilde.rows(), 0, G.rows(), G.cols()) = G;
-			rhs.segment(0, ftilde.rows()) = ftilde;
-			//rhs.segment(ftilde.rows(), g.rows()) = g;
-			//cout << "g" << endl << g << endl;
-			rhs.segment(ftilde.rows(), g.rows()) = rhsG;
-
-			VectorXd sol = LHS.ldlt().solve(rhs);
-			//cout << LHS << endl;
-			//cout << rhs << endl;
-			qdot1 = sol.segment(0, nr);
-
-			VectorXd l = sol.segment(nr, sol.rows() - nr);
-
-			constraint0->scatterForceEqM(Gm.transpose(), l.segment(0, nem) / h);
-			constraint0->scatterForceEqR(Gr.transpose(), l.segment(nem, l.rows() - nem) / h);
-
-		}
-		else if (ne == 0 && ni > 0) {  // Just inequality
-			shared_ptr<QuadProgMosek> program_ = make_shared <QuadProgMosek>();
-			program_->setParamInt(MSK_IPAR_OPTIMIZER, MSK_OPTIMIZER_INTPNT);
-			program_->setParamInt(MSK_IPAR_LOG, 10);
-			program_->setParamInt(MSK_IPAR_LOG_FILE, 1);
-			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_DFEAS, 1e-8);
-			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_INFEAS, 1e-10);
-			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_MU_RED, 1e-8);
-			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_NEAR_REL, 1e3);
-			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_PFEAS, 1e-8);
-			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_REL_GAP, 1e-8);
-
-			program_->setNumberOfVariables(nr);
-			program_->setObjectiveMatrix(Mtilde.sparseView());
-			program_->setObjectiveVector(-ftilde);
-			program_->setNumberOfInequalities(ni);
-			program_->setInequalityMatrix(C.sparseView());
-
-			VectorXd cvec(ni);
-			cvec.setZero();
-
-			program_->setInequalityVector(cvec);
-
-			bool success = program_->solve();
-			VectorXd sol = program_->getPrimalSolution();
-			qdot1 = sol.segment(0, nr);
-			//cout << qdot1 << endl;
-
-		}
-		else {  // Both equality and inequality
-			shared_ptr<QuadProgMosek> program_ = make_shared <QuadProgMosek>();
-			program_->setParamInt(MSK_IPAR_OPTIMIZER, MSK_OPTIMIZER_INTPNT);
-			program_->setParamInt(MSK_IPAR_LOG, 10);
-			program_->setParamInt(MSK_IPAR_LOG_FILE, 1);
-			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_DFEAS, 1e-8);
-			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_INFEAS, 1e-10);
-			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_MU_RED, 1e-8);
-			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_NEAR_REL, 1e3);
-			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_PFEAS, 1e-8);
-			program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_REL_GAP, 1e-8);
-
-			program_->setNumberOfVariables(nr);
-
-			program_->setObjectiveMatrix(Mtilde.sparseView());
-			program_->setObjectiveVector(-ftilde);
-			program_->setNumberOfInequalities(ni);
-			program_->setInequalityMatrix(C.sparseView());
-			program_->setNumberOfEqualities(ne);
-			VectorXd cvec(ni);
-			cvec.setZero();
-
-			program_->setInequalityVector(cvec);
-			program_->setEqualityMatrix(G.sparseView());
-
-			VectorXd gvec(ne);
-			gvec.setZero();
-			program_->setEqualityVector(rhsG);
-
-			bool success = program_->solve();
-			VectorXd sol = program_->getPrimalSolution();
-			qdot1 = sol.segment(0, nr);
-
+			solveEquality(ftilde, rhsG);
+			qdot1 = sol.head(nr);
+
+			Gmt = Gm.transpose();
+			Grt = Gr.transpose();
+			lm = sol.segment(nr, nem) / h;
+			lr = sol.segment(nr + nem, ner) / h;
+			constraint0->scatterForceEqM(Gmt, lm);
+			constraint0->scatterForceEqR(Grt, lr);
+		}
+		else {  // Inequality, with or without equality
+			solveInequality(ftilde, rhsG, ne, ni, false);
 		}
 
 		qddot = (qdot1 - qdot0) / h;
@@ -471,95 +507,808 @@ Eigen::VectorXd Solver::dynamics(Eigen::VectorXd y)
 
 		softbody0->scatterDofs(yk, nr);
 		softbody0->scatterDDofs(ydotk, nr);
-
-		Energy ener = m_world->computeEnergy();
-
-		/*cout << "V" << ener.V << endl;
-		cout << "K" << ener.K << endl;
-		cout << " sum " << ener.V + ener.K << endl;*/
+		setMallocAllowed(true);
+		m_nsteps++;
+		commitEnergySample(sample);
 		return yk;
 	}
 	break;
 
-	case REDUCED_ODE45:
+	default:
 		break;
-	case REDMAX_ODE45:
+	}
+
+}
+
+void Solver::computeJacProd(const VectorXd &x, VectorXd &y) {
+	// Computes y = J*x with the tree recursions
+	y.setZero(nm);
+	m_world->getJoint0()->computeJacProd(x, y);
+	m_world->getDeformable0()->computeJacProd(x, y);
+	m_world->getSoftBody0()->computeJacProd(x, y);
+}
+
+void Solver::computeJacDotProd(const VectorXd &x, VectorXd &y, VectorXd &ydot) {
+	// Computes y = J*x and ydot = Jdot*x with the tree recursions.
+	// Only the rigid rows of Jdot are nonzero.
+	y.setZero(nm);
+	ydot.setZero(nm);
+	m_world->getJoint0()->computeJacDotProd(x, y, ydot);
+	m_world->getDeformable0()->computeJacProd(x, y);
+	m_world->getSoftBody0()->computeJacProd(x, y);
+}
+
+void Solver::computeJacTransProd(const VectorXd &y, VectorXd &x) {
+	// Computes x = J'*y with the tree recursions
+	x.setZero(nr);
+	m_world->getJointN()->computeJacTransProd(y, x);
+	m_world->getDeformable0()->computeJacTransProd(y, x);
+	m_world->getSoftBody0()->computeJacTransProd(y, x);
+}
+
+void Solver::computeMtildeProd(double h, const VectorXd &x, VectorXd &y, bool isImplicit) {
+	// Computes y = J' * (M - h^2 K) * J * x, plus (h Ddr - h^2 Ksr) * x if isImplicit
+	computeJacProd(x, Jx);
+	MKJx = MK_sp * Jx;
+	computeJacTransProd(MKJx, y);
+	if (isImplicit) {
+		y += h * (Ddr_sp * x) - (h * h) * (Ksr_sp * x);
+	}
+}
+
+int Solver::solveCG(double h, const VectorXd &b, VectorXd &x) {
+	// Solves Mtilde * x = b by conjugate gradients, never forming Mtilde.
+	// x holds the initial guess on entry. Returns the number of iterations.
+	computeMtildeProd(h, x, cgAp, true);
+	cgR = b - cgAp;
+	cgP = cgR;
+	double rr = cgR.squaredNorm();
+	double tol2 = m_cgTol * m_cgTol * max(b.squaredNorm(), 1e-30);
+	int maxIters = max(m_cgMaxIters, 2 * nr);
+	int k = 0;
+	while (k < maxIters && rr > tol2) {
+		computeMtildeProd(h, cgP, cgAp, true);
+		double alpha = rr / cgP.dot(cgAp);
+		x += alpha * cgP;
+		cgR -= alpha * cgAp;
+		double rrNew = cgR.squaredNorm();
+		cgP = cgR + (rrNew / rr) * cgP;
+		rr = rrNew;
+		k++;
+	}
+	return k;
+}
+
+void Solver::solveEquality(const VectorXd &b, const VectorXd &c) {
+	// Solves [Mtilde G'; G 0] * [x; l] = [b; c] into sol. With EQ_AUTO, few
+	// constraints go through the Schur complement of Mtilde (range space) and
+	// many through a reduced system on the null space of G.
+	int ne = (int)G.rows();
+	m_eqSolverUsed = m_eqSolver;
+	if (m_eqSolverUsed == EQ_AUTO) {
+		m_eqSolverUsed = (ne >= m_nullSpaceRatio * nr) ? EQ_NULL_SPACE : EQ_RANGE_SPACE;
+	}
+
+	switch (m_eqSolverUsed)
+	{
+	case EQ_RANGE_SPACE:
+		solveEqualityRangeSpace(b, c);
+		break;
+	case EQ_NULL_SPACE:
+		solveEqualityNullSpace(b, c);
 		break;
 	default:
+		LHS.topLeftCorner(nr, nr) = Mtilde;
+		LHS.topRightCorner(nr, ne) = G.transpose();
+		LHS.bottomLeftCorner(ne, nr) = G;
+		rhs.head(nr) = b;
+		rhs.tail(ne) = c;
+		m_ldltKKT.compute(LHS);
+		sol = m_ldltKKT.solve(rhs);
 		break;
 	}
+}
+
+void Solver::solveEqualityRangeSpace(const VectorXd &b, const VectorXd &c) {
+	// Eliminates x with the factorization of Mtilde:
+	// (G * inv(Mtilde) * G') * l = G * inv(Mtilde) * b - c
+	int ne = (int)G.rows();
+	m_ldlt.compute(Mtilde);
+	eqY = G.transpose();
+	m_ldlt.solveInPlace(eqY);
+	eqS.noalias() = G * eqY;
+	m_ldltS.compute(eqS);
+
+	eqx = b;
+	m_ldlt.solveInPlace(eqx);
+	eqw.noalias() = G * eqx;
+	eqw -= c;
+	m_ldltS.solveInPlace(eqw);
+
+	sol.head(nr) = eqx;
+	sol.head(nr).noalias() -= eqY * eqw;
+	sol.tail(ne) = eqw;
+}
+
+void Solver::solveEqualityNullSpace(const VectorXd &b, const VectorXd &c) {
+	// With G' * P = Q * R and Q = [Q1 Z], x = Q1 * u + Z * y where
+	// R11' * u = (P' * c)(1:r) and (Z' * Mtilde * Z) * y = Z' * (b - Mtilde * Q1 * u).
+	// Redundant rows of G get zero multipliers.
+	int ne = (int)G.rows();
+	m_qrG.compute(G.transpose());
+	int r = (int)m_qrG.rank();
+	int nz = nr - r;
+	if (nz != eqz.size()) {
+		resizeNullSpace(nz);
+	}
+	m_qrG.householderQ().evalTo(eqQ, eqQws);
+	auto R11 = m_qrG.matrixR().topLeftCorner(r, r).triangularView<Upper>();
+
+	// Particular solution
+	eqw = m_qrG.colsPermutation().transpose() * c;
+	m_qrG.matrixR().topLeftCorner(r, r).transpose().triangularView<Lower>().solveInPlace(eqw.head(r));
+	eqx.noalias() = eqQ.leftCols(r) * eqw.head(r);
+
+	// Reduced solve on the null space
+	if (nz > 0) {
+		eqr = b;
+		eqr.noalias() -= Mtilde * eqx;
+		eqMZ.noalias() = Mtilde * eqQ.rightCols(nz);
+		eqZMZ.noalias() = eqQ.rightCols(nz).transpose() * eqMZ;
+		m_ldltZ.compute(eqZMZ);
+		eqz.noalias() = eqQ.rightCols(nz).transpose() * eqr;
+		m_ldltZ.solveInPlace(eqz);
+		eqx.noalias() += eqQ.rightCols(nz) * eqz;
+	}
+	sol.head(nr) = eqx;
+
+	// Multipliers from R11 * (P' * l)(1:r) = Q1' * (b - Mtilde * x)
+	eqr = b;
+	eqr.noalias() -= Mtilde * eqx;
+	eqw.head(r).noalias() = eqQ.leftCols(r).transpose() * eqr;
+	R11.solveInPlace(eqw.head(r));
+	eqw.tail(ne - r).setZero();
+	sol.tail(ne) = m_qrG.colsPermutation() * eqw;
+}
+
+static void setFullPattern(SparseMatrixd &A_sp, const Ref<const MatrixXd> &A, vector<Tripletd> &triplets) {
+	// Stores every entry of A, zeros included, so that the pattern of A_sp
+	// only depends on the size of A
+	triplets.clear();
+	insertBlock(triplets, 0, 0, A);
+	A_sp.resize(A.rows(), A.cols());
+	A_sp.setFromTriplets(triplets.begin(), triplets.end());
+}
+
+static shared_ptr<QuadProgMosek> createQuadProgMosek() {
+	// Interior-point MOSEK program with the tolerances used by every step.
+	// Logging is off: the task persists and is solved every step.
+	shared_ptr<QuadProgMosek> program_ = make_shared <QuadProgMosek>();
+	program_->setParamInt(MSK_IPAR_OPTIMIZER, MSK_OPTIMIZER_INTPNT);
+	program_->setParamInt(MSK_IPAR_LOG, 0);
+	program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_DFEAS, 1e-8);
+	program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_INFEAS, 1e-10);
+	program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_MU_RED, 1e-8);
+	program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_NEAR_REL, 1e3);
+	program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_PFEAS, 1e-8);
+	program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_REL_GAP, 1e-8);
+	return program_;
+}
+
+void Solver::solveInequality(const VectorXd &b, const VectorXd &c, int ne, int ni, bool isSparse) {
+	// Solves min 1/2 x' Mtilde x - b' x  s.t.  C x <= 0, G x = c, into qdot1,
+	// with the ni active rows of C. isSparse selects Mtilde_sp, C_sp and G_sp
+	// over the dense workspace.
+	qpf = -b;
+
+	if (m_qpSolver == QP_MOSEK) {
+		// MOSEK copies the problem into its own task, so it is exempt from the
+		// allocation check
+		bool isAllowed = m_isMallocAllowed;
+		setMallocAllowed(true);
+		if (m_mosek == nullptr) {
+			m_mosek = createQuadProgMosek();
+		}
+		shared_ptr<QuadProgMosek> program_ = m_mosek;
+		program_->setNumberOfVariables(nr);
+		program_->setObjectiveVector(qpf);
+		program_->setNumberOfInequalities(ni);
+		program_->setInequalityVector(cvec.head(ni));
+		if (!isSparse) {
+			// sparseView() would drop the entries that happen to be zero, and
+			// with them the task structure, so the dense blocks go in whole
+			setFullPattern(Mtilde_sp, Mtilde, qpTriplets_);
+			setFullPattern(C_sp, C.topRows(ni), qpTriplets_);
+			if (ne > 0) {
+				setFullPattern(G_sp, G, qpTriplets_);
+			}
+		}
+		program_->setObjectiveMatrix(Mtilde_sp);
+		program_->setInequalityMatrix(C_sp);
+		program_->setNumberOfEqualities(ne);
+		if (ne > 0) {
+			program_->setEqualityMatrix(G_sp);
+			program_->setEqualityVector(c);
+		}
+		if (program_->solve()) {
+			qdot1 = program_->getPrimalSolution().segment(0, nr);
+		}
+		else {
+			solveWithoutInequalities(b, c, ne, isSparse);
+		}
+		setMallocAllowed(isAllowed);
+		return;
+	}
+
+	// Active rows keep their identity across steps for the warm start
+	int nim = m_world->nim;
+	qpKeys.clear();
+	for (int k = 0; k < (int)rowsM.size(); k++) {
+		qpKeys.push_back(rowsM[k]);
+	}
+	for (int k = 0; k < (int)rowsR.size(); k++) {
+		qpKeys.push_back(nim + rowsR[k]);
+	}
+
+	m_qp->setNumberOfVariables(nr);
+	m_qp->setObjectiveVector(qpf);
+	m_qp->setNumberOfInequalities(ni);
+	m_qp->setInequalityKeys(qpKeys);
+	m_qp->setInequalityVector(cvec.head(ni));
+	m_qp->setNumberOfEqualities(ne);
+	if (isSparse) {
+		m_qp->setObjectiveMatrix(Mtilde_sp);
+		m_qp->setInequalityMatrix(C_sp);
+		if (ne > 0) {
+			m_qp->setEqualityMatrix(G_sp);
+		}
+	}
+	else {
+		m_qp->setObjectiveMatrix(Mtilde);
+		m_qp->setInequalityMatrix(C.topRows(ni));
+		if (ne > 0) {
+			m_qp->setEqualityMatrix(G);
+		}
+	}
+	if (ne > 0) {
+		m_qp->setEqualityVector(c);
+	}
+	if (m_qp->solve()) {
+		m_qp->getPrimalSolution(qdot1);
+	}
+	else {
+		solveWithoutInequalities(b, c, ne, isSparse);
+	}
+}
+
+void Solver::solveWithoutInequalities(const VectorXd &b, const VectorXd &c, int ne, bool isSparse) {
+	// Fallback when the QP fails, e.g. because Mtilde is not positive definite:
+	// steps with the equalities only rather than reuse a stale QP solution
+	if (isSparse) {
+		Mtilde = Mtilde_sp;
+		if (ne > 0) {
+			G = G_sp;
+		}
+	}
+	if (ne > 0) {
+		solveEquality(b, c);
+		qdot1 = sol.head(nr);
+	}
+	else {
+		m_ldlt.compute(Mtilde);
+		qdot1 = m_ldlt.solve(b);
+	}
+}
+
+static void appendTriplets(vector<Tripletd> &triplets, const SparseMatrixd &A, int row0, int col0) {
+	// Appends the nonzeros of A, shifted by (row0, col0)
+	for (int k = 0; k < A.outerSize(); ++k) {
+		for (SparseMatrixd::InnerIterator it(A, k); it; ++it) {
+			triplets.push_back(Tripletd(row0 + (int)it.row(), col0 + (int)it.col(), it.value()));
+		}
+	}
+}
+
+Eigen::VectorXd Solver::dynamicsSparse(Eigen::VectorXd y, double alpha, EnergySample *sample)
+{
+	// Same step as the dense REDMAX_EULER path, but M, K, J, Jdot, Gm and Cm
+	// are assembled from triplets and Mtilde is kept sparse. alpha is the
+	// Baumgarte coefficient, as in assembleConstraints(). The sample, if
+	// given, is filled by the force passes.
+	int nem = m_world->nem;
+	int ner = m_world->ner;
+	int ne = nem + ner;
+	int nim = m_world->nim;
+	int nir = m_world->nir;
+	int ni = nim + nir;
+
+	auto body0 = m_world->getBody0();
+	auto joint0 = m_world->getJoint0();
+	auto deformable0 = m_world->getDeformable0();
+	auto softbody0 = m_world->getSoftBody0();
+	auto constraint0 = m_world->getConstraint0();
+
+	double h = m_world->getH();
+	Vector3d grav = m_world->getGrav();
+
+	M_.clear();
+	K_.clear();
+	J_.clear();
+	Jdot_.clear();
+	Ksr_.clear();
+	Ddr_.clear();
+
+	f.setZero(nm);
+	fsr.setZero(nr);
+	fdr.setZero(nr);
+
+	// sceneFcn()
+	body0->computeMassGrav(grav, M_, f, sample);
+	deformable0->computeMass(grav, M_, f, sample);
+
+	softbody0->computeMass(grav, M_);
+	softbody0->computeForce(grav, f, sample);
+	softbody0->computeStiffness(K_);
+
+	joint0->computeForceStiffness(fsr, Ksr_, sample);
+	joint0->computeForceDamping(fdr, Ddr_);
+
+	// Without constraints the step can run matrix-free: J is applied by tree
+	// recursions and Mtilde is only ever used through products
+	bool isMatrixFree = m_isMatrixFree && ne == 0 && ni == 0;
+	if (!isMatrixFree) {
+		joint0->computeJacobian(J_, Jdot_, nm, nr);
+		deformable0->computeJacobian(J_, Jdot_);
+		softbody0->computeJacobian(J_);
+		J_sp.resize(nm, nr);
+		J_sp.setFromTriplets(J_.begin(), J_.end());
+		Jdot_sp.resize(nm, nr);
+		Jdot_sp.setFromTriplets(Jdot_.begin(), Jdot_.end());
+	}
+
+	M_sp.resize(nm, nm);
+	M_sp.setFromTriplets(M_.begin(), M_.end());
+	K_sp.resize(nm, nm);
+	K_sp.setFromTriplets(K_.begin(), K_.end());
+	Ksr_sp.resize(nr, nr);
+	Ksr_sp.setFromTriplets(Ksr_.begin(), Ksr_.end());
+	Ddr_sp.resize(nr, nr);
+	Ddr_sp.setFromTriplets(Ddr_.begin(), Ddr_.end());
+
+	q0 = y.segment(0, nr);
+	qdot0 = y.segment(nr, nr);
+
+	MK_sp = M_sp - h * h * K_sp;
+	if (isMatrixFree) {
+		// fr = J' * (f - M * Jdot * qdot0) + fsr
+		computeJacDotProd(qdot0, Jx, Jdotqdot);
+		fm = f - M_sp * Jdotqdot;
+		computeJacTransProd(fm, fr);
+		fr += fsr;
+		computeMtildeProd(h, qdot0, ftilde, false);
+		ftilde += h * fr;
+	}
+	else {
+		Mtilde_sp = J_sp.transpose() * MK_sp * J_sp;
+		SparseMatrixd Mtilde_t = Mtilde_sp.transpose();
+		Mtilde_sp = 0.5 * (Mtilde_sp + Mtilde_t);
+
+		fr = J_sp.transpose() * (f - M_sp * (Jdot_sp * qdot0)) + fsr;
+		ftilde = Mtilde_sp * qdot0 + h * fr;
+		Mtilde_sp = Mtilde_sp + h * Ddr_sp - h * h * Ksr_sp;
+	}
+
+	if (ne > 0) {
+		Gm_.clear();
+		Gmdot_.clear();
+		gm.setZero(nem);
+		gmdot.setZero(nem);
+		gmddot.setZero(nem);
+		Gr.setZero(ner, nr);
+		Grdot.setZero(ner, nr);
+		gr.setZero(ner);
+		grdot.setZero(ner);
+		grddot.setZero(ner);
+
+		constraint0->computeJacEqM(Gm_, Gmdot_, gm, gmdot, gmddot);
+		constraint0->computeJacEqR(Gr, Grdot, gr, grdot, grddot);
+		Gm_sp.resize(nem, nm);
+		Gm_sp.setFromTriplets(Gm_.begin(), Gm_.end());
+
+		G_.clear();
+		appendTriplets(G_, Gm_sp * J_sp, 0, 0);
+		appendTriplets(G_, Gr.sparseView(), nem, 0);
+		G_sp.resize(ne, nr);
+		G_sp.setFromTriplets(G_.begin(), G_.end());
+
+		g.resize(ne);
+		g.segment(0, nem) = gm;
+		g.segment(nem, ner) = gr;
+		gdot.setZero(ne);
+		rhsG = -gdot - alpha * g;
+	}
+
+	if (ni > 0) {
+		// Check for active inequality constraint
+		Cm_.clear();
+		Cmdot_.clear();
+		cm.setZero(nim);
+		cmdot.setZero(nim);
+		cmddot.setZero(nim);
+		Cr.setZero(nir, nr);
+		Crdot.setZero(nir, nr);
+		cr.setZero(nir);
+		crdot.setZero(nir);
+		crddot.setZero(nir);
+
+		constraint0->computeJacIneqM(Cm_, Cmdot_, cm, cmdot, cmddot);
+		constraint0->computeJacIneqR(Cr, Crdot, cr, crdot, crddot);
+		Cm_sp.resize(nim, nm);
+		Cm_sp.setFromTriplets(Cm_.begin(), Cm_.end());
+
+		rowsR.clear();
+		rowsM.clear();
+		constraint0->getActiveList(rowsM, rowsR);
+		int nimActive = (int)rowsM.size();
+		int nirActive = (int)rowsR.size();
+		ni = nimActive + nirActive;
+
+		if (ni > 0) {
+			// Row selection of the active maximal constraints
+			S_.clear();
+			for (int k = 0; k < nimActive; k++) {
+				S_.push_back(Tripletd(k, rowsM[k], 1.0));
+			}
+			SparseMatrixd S_sp(nimActive, nim);
+			S_sp.setFromTriplets(S_.begin(), S_.end());
+
+			C_.clear();
+			appendTriplets(C_, S_sp * Cm_sp * J_sp, 0, 0);
+			for (int k = 0; k < nirActive; k++) {
+				appendTriplets(C_, Cr.row(rowsR[k]).sparseView(), nimActive + k, 0);
+			}
+			C_sp.resize(ni, nr);
+			C_sp.setFromTriplets(C_.begin(), C_.end());
+		}
+	}
+
+	if (isMatrixFree) {	// No constraints, Krylov solve
+		qdot1 = qdot0;
+		m_cgIters = solveCG(h, ftilde, qdot1);
+	}
+	else if (ne == 0 && ni == 0) {	// No constraints
+		if (m_linearSolver->compute(Mtilde_sp)) {
+			m_linearSolver->solve(ftilde, qdot1);
+		}
+		else {
+			// Not positive definite, e.g. with a large stiffness: dense LDLT
+			Mtilde = Mtilde_sp;
+			m_ldlt.compute(Mtilde);
+			qdot1 = m_ldlt.solve(ftilde);
+		}
+	}
+	else if (ne > 0 && ni == 0) {  // Just equality
+		LHS_.clear();
+		appendTriplets(LHS_, Mtilde_sp, 0, 0);
+		appendTriplets(LHS_, G_sp, nr, 0);
+		SparseMatrixd Gt = G_sp.transpose();
+		appendTriplets(LHS_, Gt, 0, nr);
+		LHS_sp.resize(nr + ne, nr + ne);
+		LHS_sp.setFromTriplets(LHS_.begin(), LHS_.end());
+
+		rhs.resize(nr + ne);
+		rhs.segment(0, nr) = ftilde;
+		rhs.segment(nr, ne) = rhsG;
+
+		// Equality constraints are never deactivated, so the topology key only
+		// records their number; the pattern of LHS_sp is hashed by compute()
+		if (m_linearSolverKKT->compute(LHS_sp, (size_t)ne)) {
+			m_linearSolverKKT->solve(rhs, sol);
+		}
+		else {
+			// Singular pivot in the sparse LU: dense LDLT of the same system
+			LHS = LHS_sp;
+			m_ldltKKT.compute(LHS);
+			sol = m_ldltKKT.solve(rhs);
+		}
+		qdot1 = sol.segment(0, nr);
+
+		VectorXd l = sol.segment(nr, ne);
+		SparseMatrixd Gmt = Gm_sp.transpose();
+		constraint0->scatterForceEqM(Gmt, l.segment(0, nem) / h);
+		constraint0->scatterForceEqR(Gr.transpose(), l.segment(nem, ner) / h);
+	}
+	else {  // Inequality, with or without equality
+		solveInequality(ftilde, rhsG, ne, ni, true);
+	}
+
+	qddot = (qdot1 - qdot0) / h;
+	q1 = q0 + h * qdot1;
+
+	yk.segment(0, nr) = q1;
+	yk.segment(nr, nr) = qdot1;
+	ydotk.segment(0, nr) = qdot1;
+	ydotk.segment(nr, nr) = qddot;
+
+	joint0->scatterDofs(yk, nr);
+	joint0->scatterDDofs(ydotk, nr);
+
+	deformable0->scatterDofs(yk, nr);
+	deformable0->scatterDDofs(ydotk, nr);
+
+	softbody0->scatterDofs(yk, nr);
+	softbody0->scatterDDofs(ydotk, nr);
+
+	return yk;
+}
+
+bool Solver::isRecursive() const {
+	// The recursive path handles rigid trees only
+	int ne = m_world->nem + m_world->ner;
+	int ni = m_world->nim + m_world->nir;
+	return m_world->nr > 0 && m_world->nm == 6 * m_world->m_nbodies && ne == 0 && ni == 0;
+}
+
+Eigen::VectorXd Solver::dynamicsRecursive(Eigen::VectorXd y, EnergySample *sample)
+{
+	// Same semi-implicit step as REDMAX_EULER for a rigid tree, computed in O(n)
+	// with the articulated-body algorithm. Neither J nor the maximal M is formed.
+	auto joint0 = m_world->getJoint0();
+	auto jointN = m_world->getJointN();
+
+	double h = m_world->getH();
+	Vector3d grav = m_world->getGrav();
+
+	q0 = y.segment(0, nr);
+	qdot0 = y.segment(nr, nr);
+
+	// There is no force assembly pass to fill the sample from
+	if (sample != nullptr) {
+		joint0->computeEnergies(grav, *sample);
+	}
+
+	joint0->computeArticulatedBias(grav);
+	jointN->computeArticulatedInertia(h);
+	joint0->computeArticulatedAcc(qddot);
+
+	qdot1 = qdot0 + h * qddot;
+	q1 = q0 + h * qdot1;
+	yk.segment(0, nr) = q1;
+	yk.segment(nr, nr) = qdot1;
+
+	ydotk.segment(0, nr) = qdot1;
+	ydotk.segment(nr, nr) = qddot;
+
+	joint0->scatterDofs(yk, nr);
+	joint0->scatterDDofs(ydotk, nr);
+
+	return yk;
+}
 
+VectorXd Solver::gatherState() {
+	// Gathers q and qdot of the whole world into a single state vector
+	VectorXd y(2 * nr);
+	y.setZero();
+	y = m_world->getJoint0()->gatherDofs(y, nr);
+	m_world->getDeformable0()->gatherDofs(y, nr);
+	y = m_world->getSoftBody0()->gatherDofs(y, nr);
+	return y;
+}
+
+void Solver::dynamicsODE(const VectorXd &y, VectorXd &ydot, EnergySample *sample) {
+	// Computes ydot = [qdot; qddot] at the state y with explicit forward dynamics,
+	// and the energies and momentum at y if sample is given
+	auto joint0 = m_world->getJoint0();
+	auto deformable0 = m_world->getDeformable0();
+	auto softbody0 = m_world->getSoftBody0();
+	Vector3d grav = m_world->getGrav();
+
+	yk = y;
+	joint0->scatterDofs(yk, nr);
+	deformable0->scatterDofs(yk, nr);
+	softbody0->scatterDofs(yk, nr);
+	qdot0 = y.segment(nr, nr);
+
+	if (m_integrator == REDUCED_ODE45 && isRecursive()) {
+		// Articulated-body forward dynamics, with no implicit terms (h = 0)
+		if (sample != nullptr) {
+			joint0->computeEnergies(grav, *sample);
+		}
+		joint0->computeArticulatedBias(grav);
+		m_world->getJointN()->computeArticulatedInertia(0.0);
+		joint0->computeArticulatedAcc(qddot);
+	}
+	else {
+		// Mr * qddot = fr, with joint damping applied explicitly
+		assemble(0.0, grav, sample);
+		fr += fdr;
+		int nem = m_world->nem;
+		int ner = m_world->ner;
+		int ne = nem + ner;
+		if (ne == 0) {
+			m_ldlt.compute(Mtilde);
+			qddot = m_ldlt.solve(fr);
+		}
+		else {
+			// Acceleration-level constraints with Baumgarte stabilization:
+			// G * qddot = -Gdot * qdot - 2 a G * qdot - a^2 g
+			double alpha = 5.0;
+			assembleConstraints(alpha);
+			Jx.noalias() = J * qdot0;
+			rhsG.head(nem).noalias() = -Gmdot * Jx;
+			rhsG.head(nem).noalias() -= Gm * Jdotqdot;
+			rhsG.tail(ner).noalias() = -Grdot * qdot0;
+			rhsG.noalias() -= (2.0 * alpha) * (G * qdot0);
+			rhsG -= (alpha * alpha) * g;
+			solveEquality(fr, rhsG);
+			qddot = sol.head(nr);
+		}
+	}
+	ydot.resize(2 * nr);
+	ydot.head(nr) = qdot0;
+	ydot.tail(nr) = qddot;
+	m_odeStats.evaluations++;
+}
+
+bool Solver::integrateODE45(VectorXd &y, double t0, double t1, shared_ptr<Solution> solution) {
+	// Integrates y from t0 to t1 with the Dormand-Prince 5(4) pair and local error
+	// control. If solution is given, its rows at the times solution->t in (t0, t1]
+	// are filled with the 4th order continuous extension.
+	// Returns false if the step size underflowed: y is then the state reached,
+	// and solution is truncated to the rows that were filled.
+	// The right-hand side does not depend on t, so the stage times are not needed.
+	static const double a21 = 1.0 / 5.0;
+	static const double a31 = 3.0 / 40.0, a32 = 9.0 / 40.0;
+	static const double a41 = 44.0 / 45.0, a42 = -56.0 / 15.0, a43 = 32.0 / 9.0;
+	static const double a51 = 19372.0 / 6561.0, a52 = -25360.0 / 2187.0, a53 = 64448.0 / 6561.0, a54 = -212.0 / 729.0;
+	static const double a61 = 9017.0 / 3168.0, a62 = -355.0 / 33.0, a63 = 46732.0 / 5247.0, a64 = 49.0 / 176.0, a65 = -5103.0 / 18656.0;
+	static const double a71 = 35.0 / 384.0, a73 = 500.0 / 1113.0, a74 = 125.0 / 192.0, a75 = -2187.0 / 6784.0, a76 = 11.0 / 84.0;
+	static const double e1 = 71.0 / 57600.0, e3 = -71.0 / 16695.0, e4 = 71.0 / 1920.0, e5 = -17253.0 / 339200.0, e6 = 22.0 / 525.0, e7 = -1.0 / 40.0;
+	static const double d1 = -12715105075.0 / 11282082432.0, d3 = 87487479700.0 / 32700410799.0, d4 = -10690763975.0 / 1880347072.0,
+		d5 = 701980252875.0 / 199316789632.0, d6 = -1453857185.0 / 822651844.0, d7 = 69997945.0 / 29380423.0;
+
+	int n = (int)y.size();
+	VectorXd k1(n), k2(n), k3(n), k4(n), k5(n), k6(n), k7(n), ys(n), ynew(n), err(n);
+	VectorXd r2(n), r3(n), r4(n), r5(n);
+
+	int kout = 0;
+	if (solution != nullptr) {
+		while (kout < solution->t.size() && solution->t(kout) <= t0) {
+			kout++;
+		}
+	}
+
+	// Only the first call samples its start state: every later call starts
+	// where the last stage of the previous one was sampled
+	double t = t0;
+	double h = min(m_hODE, t1 - t0);
+	bool isFailed = false;
+	EnergySample *sample = m_energySteps == 0 ? getEnergySample(t) : nullptr;
+	dynamicsODE(y, k1, sample);
+	if (sample != nullptr) {
+		commitEnergySample(sample);
+	}
+	while (t < t1) {
+		bool isLast = false;
+		if (t + 1.01 * h >= t1) {
+			h = t1 - t;
+			isLast = true;
+		}
+		ys = y + h * a21 * k1;
+		dynamicsODE(ys, k2);
+		ys = y + h * (a31 * k1 + a32 * k2);
+		dynamicsODE(ys, k3);
+		ys = y + h * (a41 * k1 + a42 * k2 + a43 * k3);
+		dynamicsODE(ys, k4);
+		ys = y + h * (a51 * k1 + a52 * k2 + a53 * k3 + a54 * k4);
+		dynamicsODE(ys, k5);
+		ys = y + h * (a61 * k1 + a62 * k2 + a63 * k3 + a64 * k4 + a65 * k5);
+		dynamicsODE(ys, k6);
+		ynew = y + h * (a71 * k1 + a73 * k3 + a74 * k4 + a75 * k5 + a76 * k6);
+		// The last stage is the first one of the next step, so it samples
+		// the monitor there; the sample is dropped if the step is rejected
+		sample = getEnergySample(t + h);
+		dynamicsODE(ynew, k7, sample);
+
+		// Scaled max norm of the embedded error estimate
+		err = h * (e1 * k1 + e3 * k3 + e4 * k4 + e5 * k5 + e6 * k6 + e7 * k7);
+		double errNorm = 0.0;
+		for (int i = 0; i < n; i++) {
+			double sc = m_atol + m_rtol * max(abs(y(i)), abs(ynew(i)));
+			errNorm = max(errNorm, abs(err(i)) / sc);
+		}
+		double fac = 0.9 * pow(max(errNorm, 1e-10), -0.2);
+		fac = min(5.0, max(0.2, fac));
+
+		if (errNorm <= 1.0) {
+			// Accepted: fill the output rows inside [t, t + h]
+			if (solution != nullptr) {
+				r2 = ynew - y;
+				r3 = h * k1 - r2;
+				r4 = r2 - h * k7 - r3;
+				r5 = h * (d1 * k1 + d3 * k3 + d4 * k4 + d5 * k5 + d6 * k6 + d7 * k7);
+				while (kout < solution->t.size() && solution->t(kout) <= t + h + 1e-12 * h) {
+					double s = (solution->t(kout) - t) / h;
+					double s1 = 1.0 - s;
+					solution->y.row(kout) = y + s * (r2 + s1 * (r3 + s * (r4 + s1 * r5)));
+					kout++;
+				}
+			}
+			m_odeStats.accepted++;
+			m_odeStats.hMin = m_odeStats.accepted == 1 ? h : min(m_odeStats.hMin, h);
+			m_odeStats.hMax = max(m_odeStats.hMax, h);
+			t += h;
+			y = ynew;
+			k1 = k7;
+			commitEnergySample(sample);
+			if (!isLast) {
+				m_hODE = h * fac;
+			}
+			if (isLast) {
+				break;
+			}
+			h = m_hODE;
+		}
+		else {
+			m_odeStats.rejected++;
+			h *= min(1.0, fac);
+			if (h < 1e-12 * max(1.0, abs(t))) {
+				isFailed = true;
+				break;
+			}
+		}
+	}
+
+	// Leave the world at the final state
+	yk = y;
+	ydotk = k1;
+	m_world->getJoint0()->scatterDofs(yk, nr);
+	m_world->getJoint0()->scatterDDofs(ydotk, nr);
+	m_world->getDeformable0()->scatterDofs(yk, nr);
+	m_world->getDeformable0()->scatterDDofs(ydotk, nr);
+	m_world->getSoftBody0()->scatterDofs(yk, nr);
+	m_world->getSoftBody0()->scatterDDofs(ydotk, nr);
+
+	if (isFailed) {
+		m_odeStats.failures++;
+		if (solution != nullptr) {
+			solution->t.conservativeResize(kout);
+			solution->y.conservativeResize(kout, NoChange);
+		}
+		return false;
+	}
+	return true;
 }
 
 shared_ptr<Solution> Solver::solve() {
 	switch (m_integrator)
 	{
+	case REDUCED_ODE45:
+	case REDMAX_ODE45:
+		if (m_world->nim + m_world->nir == 0) {
+			int nsteps = m_world->getNsteps();
+			double t0 = m_world->getTspan()(0);
+			m_solutions->t.resize(nsteps);
+			m_solutions->y.resize(nsteps, 2 * nr);
+			m_solutions->y.setZero();
+			// Output on the same grid as the fixed-step integrators
+			for (int k = 0; k < nsteps; k++) {
+				m_solutions->t(k) = t0 + k * m_world->getH();
+			}
+			m_solutions->y.row(0) = gatherState();
+			VectorXd y0 = m_solutions->y.row(0);
+			integrateODE45(y0, t0, m_solutions->t(nsteps - 1), m_solutions);
+			return m_solutions;
+		}
+		// Falls through - inequality constraints need the velocity-level step
+	case REDUCED_EULER:
 	case REDMAX_EULER:
 	{
-		int nr = m_world->nr;
-		int nm = m_world->nm;
-
-		M.resize(nm, nm);
-		M.setZero();
-		Mtilde.resize(nr, nr);
-		Mtilde.setZero();
-		ftilde.resize(nr, 1);
-		ftilde.setZero();
-		fr.resize(nr, 1);
-		fr.setZero();
-		fdr.resize(nr, 1);
-		fsr.resize(nr, 1);
-		fdr.setZero();
-		fsr.setZero();
-		Ksr.resize(nr, nr);
-		Ksr.setZero();
-		Ddr.resize(nr, nr);
-		Ddr.setZero();
-
-		K.resize(nm, nm);
-		K.setZero();
-		f.resize(nm);
-		f.setZero();
-		J.resize(nm, nr);
-		Jdot.resize(nm, nr);
-		J.setZero();
-		Jdot.setZero();
-
-		// constraints
+		bool isRecursive = m_integrator == REDUCED_EULER && this->isRecursive();
 		int nem = m_world->nem;
 		int ner = m_world->ner;
 		int ne = nem + ner;
 
-		Gm.resize(nem, nm);
-		Gm.setZero();
-		Gmdot.resize(nem, nm);
-		Gmdot.setZero();
-
-		gm.resize(nem);
-		gm.setZero();
-		gmdot.resize(nem);
-		gmdot.setZero();
-		gmddot.resize(nem);
-		gmddot.setZero();
-
-		Gr.resize(ner, nr);
-		Gr.setZero();
-		Grdot.resize(ner, nr);
-		Grdot.setZero();
-
-		gr.resize(ner);
-		gr.setZero();
-
-		G.resize(ne, nr);
-		g.resize(ne);
-		rhsG.resize(ne);
-		gdot.resize(ne);
-		G.setZero();
-		g.setZero();
-		gdot.setZero();
-		rhsG.setZero();
-
-		auto body0 = m_world->getBody0();
 		auto joint0 = m_world->getJoint0();
 		auto deformable0 = m_world->getDeformable0();
 		auto softbody0 = m_world->getSoftBody0();
@@ -572,222 +1321,64 @@ shared_ptr<Solution> Solver::solve() {
 
 		// initial state
 		m_solutions->t(0) = m_world->getTspan()(0);
-		m_solutions->y.row(0) = joint0->gatherDofs(m_solutions->y.row(0), nr);
-		VectorXd sol_y = m_solutions->y.row(0);
-		deformable0->gatherDofs(sol_y, nr);
-		m_solutions->y.row(0) = sol_y;
-		m_solutions->y.row(0) = softbody0->gatherDofs(m_solutions->y.row(0), nr);
+		m_solutions->y.row(0) = gatherState();
 
 		double t = m_world->getTspan()(0);
 		double h = m_world->getH();
 		Vector3d grav = m_world->getGrav();
 
-		VectorXd yk(2 * nr);
-		VectorXd ydotk(2 * nr);
-
 		for (int k = 1; k < nsteps; k++) {
-			int nim = m_world->nim;
-			int nir = m_world->nir;
-			int ni = nim + nir;
-
-			Cm.resize(nim, nm);
-			Cm.setZero();
-			Cmdot.resize(nim, nm);
-			Cmdot.setZero();
-			cm.resize(nim);
-			cm.setZero();
-
-			Cr.resize(nir, nr);
-			Cr.setZero();
-			Crdot.resize(nir, nr);
-			Crdot.setZero();
-			cr.resize(nir);
-			cr.setZero();
-
-			M.setZero();
-			K.setZero();
-			f.setZero();
-			J.setZero();
-			Jdot.setZero();
-			g.setZero();
-			gdot.setZero();
-			gm.setZero();
-			gmdot.setZero();
-			gmddot.setZero();
-			gr.setZero();
-			Gr.setZero();
-			Grdot.setZero();
-			Gm.setZero();
-			Gmdot.setZero();
-			G.setZero();
-			rhsG.setZero();
-			// sceneFcn()
-			body0->computeMassGrav(grav, M, f);
-			deformable0->computeMass(grav, M, f);
-
-			softbody0->computeMass(grav, M);
-			softbody0->computeForce(grav, f);
-
-			softbody0->computeStiffness(K);
-
-			joint0->computeForceStiffness(fsr, Ksr);
-			joint0->computeForceDamping(fdr, Ddr);
-
-			joint0->computeJacobian(J, Jdot, nm, nr);
-			//Jdot = joint0->computeJacobianDerivative(Jdot, J, nm, nr);
-			// spring jacobian todo
-			deformable0->computeJacobian(J, Jdot);
-
-			softbody0->computeJacobian(J);
+			EnergySample *sample = getEnergySample(t);
+			if (isRecursive) {
+				yk = dynamicsRecursive(m_solutions->y.row(k - 1), sample);
+				commitEnergySample(sample);
+				t += h;
+				m_solutions->y.row(k) = yk;
+				m_solutions->t(k) = t;
+				continue;
+			}
+			if (m_isSparse) {
+				yk = dynamicsSparse(m_solutions->y.row(k - 1), 5.0, sample);
+				commitEnergySample(sample);
+				t += h;
+				m_solutions->y.row(k) = yk;
+				m_solutions->t(k) = t;
+				continue;
+			}
+			setMallocAllowed(k == 1);
 
 			q0 = m_solutions->y.row(k - 1).segment(0, nr);
 			//cout << "q0"<<q0 << endl;
 			qdot0 = m_solutions->y.row(k - 1).segment(nr, nr);
 			//cout << "q0" << qdot0 << endl;
-			Mtilde = J.transpose() * (M - h * h * K) * J;
-			Mtilde = 0.5 * (Mtilde + Mtilde.transpose());
-			
-			fr = J.transpose() * (f - M * Jdot * qdot0) + fsr;
-			ftilde = Mtilde * qdot0 + h * fr;
-			Mtilde = Mtilde + h * Ddr - h * h * Ksr;
 
-			if (ne > 0) {
-				constraint0->computeJacEqM(Gm, Gmdot, gm, gmdot, gmddot);
-				constraint0->computeJacEqR(Gr, Grdot, gr, grdot, grddot);
-				G.block(0, 0, nem, nr) = Gm * J;
-				G.block(nem, 0, ner, nr) = Gr;
-				g.segment(0, nem) = gm;
-				g.segment(nem, ner) = gr;
-				rhsG = -gdot - 5.0 * g;// todo!!!!!
-
-			}
-
-			if (ni > 0) {
-				// Check for active inequality constraint
-				constraint0->computeJacIneqM(Cm, Cmdot, cm, cmdot, cmddot);
-				constraint0->computeJacIneqR(Cr, Crdot, cr, crdot, crddot);
-				rowsR.clear();
-				rowsM.clear();
-
-				constraint0->getActiveList(rowsM, rowsR);
-				nim = rowsM.size();
-				nir = rowsR.size();
-				ni = nim + nir;
-
-				if (ni > 0) {
-					Eigen::VectorXi m_rowsM = Eigen::Map<Eigen::VectorXi, Eigen::Unaligned>(rowsM.data(), rowsM.size());
-					Eigen::VectorXi m_rowsR = Eigen::Map<Eigen::VectorXi, Eigen::Unaligned>(rowsR.data(), rowsR.size());
-
-					MatrixXd m_Cm = Cm(m_rowsM, Eigen::placeholders::all);
-
-					MatrixXd m_Cr = Cr(m_rowsR, Eigen::placeholders::all);
-					MatrixXd CmJ = m_Cm * J;
-
-					C.resize(CmJ.rows() + m_Cr.rows(), m_Cr.cols());
-
-					C << CmJ, m_Cr;
-				}
-			}
+			assemble(h, grav, sample);
+			int ni = assembleConstraints(5.0);// todo!!!!!
 
 			if (ne == 0 && ni == 0) {	// No constraints	
-				qdot1 = Mtilde.ldlt().solve(ftilde);
+				m_ldlt.compute(Mtilde);
+				qdot1 = m_ldlt.solve(ftilde);
 
 				//cout << Mtilde << endl;
 				//cout << ftilde << endl;
 
 			}
 			else if (ne > 0 && ni == 0) {  // Just equality
-				int rows = Mtilde.rows() + G.rows();
-				int cols = Mtilde.cols() + G.rows();
-				MatrixXd LHS(rows, cols);
-				VectorXd rhs(rows);
-				LHS.setZero();
-				rhs.setZero();
-				LHS.block(0, 0, Mtilde.rows(), Mtilde.cols()) = Mtilde;
-				LHS.block(0, Mtilde.cols(), Mtilde.rows(), G.rows()) = G.transpose();
-				LHS.block(Mtilde.rows(), 0, G.rows(), G.cols()) = G;
-				rhs.segment(0, ftilde.rows()) = ftilde;
-				//rhs.segment(ftilde.rows(), g.rows()) = g;
-				//cout << "g" << endl << g << endl;
-				rhs.segment(ftilde.rows(), g.rows()) = rhsG;
-
-				VectorXd sol = LHS.ldlt().solve(rhs);
-				//cout << LHS << endl;
-				//cout << rhs << endl;
-				qdot1 = sol.segment(0, nr);
-
-				VectorXd l = sol.segment(nr, sol.rows() - nr);
-
-				constraint0->scatterForceEqM(Gm.transpose(), l.segment(0, nem) / h);
-				constraint0->scatterForceEqR(Gr.transpose(), l.segment(nem, l.rows() - nem) / h);
+				solveEquality(ftilde, rhsG);
+				qdot1 = sol.head(nr);
 
-			}
-			else if (ne == 0 && ni > 0) {  // Just inequality
-				shared_ptr<QuadProgMosek> program_ = make_shared <QuadProgMosek>();
-				program_->setParamInt(MSK_IPAR_OPTIMIZER, MSK_OPTIMIZER_INTPNT);
-				program_->setParamInt(MSK_IPAR_LOG, 10);
-				program_->setParamInt(MSK_IPAR_LOG_FILE, 1);
-				program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_DFEAS, 1e-8);
-				program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_INFEAS, 1e-10);
-				program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_MU_RED, 1e-8);
-				program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_NEAR_REL, 1e3);
-				program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_PFEAS, 1e-8);
-				program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_REL_GAP, 1e-8);
-
-				program_->setNumberOfVariables(nr);
-				program_->setObjectiveMatrix(Mtilde.sparseView());
-				program_->setObjectiveVector(-ftilde);
-				program_->setNumberOfInequalities(ni);
-				program_->setInequalityMatrix(C.sparseView());
-
-				VectorXd cvec(ni);
-				cvec.setZero();
-
-				program_->setInequalityVector(cvec);
-
-				bool success = program_->solve();
-				VectorXd sol = program_->getPrimalSolution();
-				qdot1 = sol.segment(0, nr);
-				//cout << qdot1 << endl;
+				Gmt = Gm.transpose();
+				Grt = Gr.transpose();
+				lm = sol.segment(nr, nem) / h;
+				lr = sol.segment(nr + nem, ner) / h;
+				constraint0->scatterForceEqM(Gmt, lm);
+				constraint0->scatterForceEqR(Grt, lr);
 
 			}
-			else {  // Both equality and inequality
-				shared_ptr<QuadProgMosek> program_ = make_shared <QuadProgMosek>();
-				program_->setParamInt(MSK_IPAR_OPTIMIZER, MSK_OPTIMIZER_INTPNT);
-				program_->setParamInt(MSK_IPAR_LOG, 10);
-				program_->setParamInt(MSK_IPAR_LOG_FILE, 1);
-				program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_DFEAS, 1e-8);
-				program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_INFEAS, 1e-10);
-				program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_MU_RED, 1e-8);
-				program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_NEAR_REL, 1e3);
-				program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_PFEAS, 1e-8);
-				program_->setParamDouble(MSK_DPAR_INTPNT_QO_TOL_REL_GAP, 1e-8);
-
-				program_->setNumberOfVariables(nr);
-
-				program_->setObjectiveMatrix(Mtilde.sparseView());
-				program_->setObjectiveVector(-ftilde);
-				program_->setNumberOfInequalities(ni);
-				program_->setInequalityMatrix(C.sparseView());
-
-				VectorXd cvec(ni);
-				cvec.setZero();
-
-				program_->setInequalityVector(cvec);
-				program_->setEqualityMatrix(G.sparseView());
-
-				VectorXd gvec(ne);
-				gvec.setZero();
-				program_->setEqualityVector(gvec);
-
-				bool success = program_->solve();
-				VectorXd sol = program_->getPrimalSolution();
-				qdot1 = sol.segment(0, nr);
-
+			else {  // Inequality, with or without equality
+				solveInequality(ftilde, rhsG, ne, ni, false);
 			}
 			qddot = (qdot1 - qdot0) / h;
-			cout << "ddot" << qddot << endl;
-			cout <<"qdot1"<< qdot1 << endl;
 			q1 = q0 + h * qdot1;
 			//cout << "q1" << q1 << endl;
 			yk.segment(0, nr) = q1;
@@ -804,6 +1395,9 @@ shared_ptr<Solution> Solver::solve() {
 
 			softbody0->scatterDofs(yk, nr);
 			softbody0->scatterDDofs(ydotk, nr);
+			setMallocAllowed(true);
+			m_nsteps++;
+			commitEnergySample(sample);
 
 			t += h;
 			m_solutions->y.row(k) = yk;
@@ -814,14 +1408,7 @@ shared_ptr<Solution> Solver::solve() {
 		break;
 	}
 
-	case REDUCED_ODE45:
-		break;
-	case REDMAX_ODE45:
-		break;
 	default:
 		break;
 	}
-}
-
-Solver::~Solver() {
 }
\ No newline at end of file
@@ -14,6 +14,9 @@
 #include "MLCommon.h"
 
 class World;
+class LinearSolver;
+class QuadProgActiveSet;
+class QuadProgMosek;
 
 struct Solution {
 	Eigen::VectorXd t;
@@ -59,6 +62,17 @@ struct Solution {
 
 };
 
+struct ODEStats {
+	int accepted;		// Accepted steps
+	int rejected;		// Rejected steps
+	int evaluations;	// Right-hand side evaluations
+	double hMin;		// Smallest accepted step
+	double hMax;		// Largest accepted step
+	int failures;		// Integrations stopped by a step size underflow
+
+	ODEStats() : accepted(0), rejected(0), evaluations(0), hMin(0.0), hMax(0.0), failures(0) {}
+};
+
 class Solver 
 {
 public:
@@ -66,13 +80,59 @@ public:
 	Solver(std::shared_ptr<World> world, Integrator integrator);
 	virtual ~Solver() {}
 	std::shared_ptr<Solution> solve();
-	Eigen::VectorXd dynamics(Eigen::VectorXd y);
+	Eigen::VectorXd dynamics(const Eigen::VectorXd &y);
 
 	void init();
 	void reset();
 	void load(const std::string &RESOURCE_DIR);
+	void setIntegrator(Integrator integrator) { m_integrator = integrator; }
+	void setSparse(bool isSparse) { m_isSparse = isSparse; }
+	void setMatrixFree(bool isMatrixFree) { m_isMatrixFree = isMatrixFree; }
+	void setCGTolerance(double tol, int maxIters) { m_cgTol = tol; m_cgMaxIters = maxIters; }
+	int getCGIterations() const { return m_cgIters; }
+	void setTolerances(double rtol, double atol) { m_rtol = rtol; m_atol = atol; }
+	void setEqualitySolver(EqualitySolver eqSolver) { m_eqSolver = eqSolver; }
+	void setNullSpaceRatio(double ratio) { m_nullSpaceRatio = ratio; }
+	EqualitySolver getEqualitySolverUsed() const { return m_eqSolverUsed; }
+	void setQPSolver(QPSolver qpSolver) { m_qpSolver = qpSolver; }
+	std::shared_ptr<QuadProgActiveSet> getQuadProg() const { return m_qp; }
+	const ODEStats &getODEStats() const { return m_odeStats; }
+	bool isSparse() const { return m_isSparse; }
+	void setMallocCheck(bool isMallocCheck) { m_isMallocCheck = isMallocCheck; }
+	std::shared_ptr<LinearSolver> getLinearSolver() const { return m_linearSolver; }
+	std::shared_ptr<LinearSolver> getLinearSolverKKT() const { return m_linearSolverKKT; }
+
+	// Records an EnergySample every interval steps, taken from the force passes
+	// of the step at its start state; 0 turns the monitor off
+	void setEnergyMonitor(int interval) { m_energyInterval = interval; m_energySteps = 0; m_energySamples.clear(); }
+	const std::vector<EnergySample> &getEnergySamples() const { return m_energySamples; }
 	
 private:
+	Eigen::VectorXd dynamicsSparse(Eigen::VectorXd y, double alpha, EnergySample *sample = nullptr);
+	Eigen::VectorXd dynamicsRecursive(Eigen::VectorXd y, EnergySample *sample = nullptr);
+	bool isRecursive() const;
+	Eigen::VectorXd gatherState();
+	void dynamicsODE(const Eigen::VectorXd &y, Eigen::VectorXd &ydot, EnergySample *sample = nullptr);
+	bool integrateODE45(Eigen::VectorXd &y, double t0, double t1, std::shared_ptr<Solution> solution);
+
+	// Matrix-free operators: J is applied by tree recursions and never formed
+	void computeJacProd(const Eigen::VectorXd &x, Eigen::VectorXd &y);
+	void computeJacDotProd(const Eigen::VectorXd &x, Eigen::VectorXd &y, Eigen::VectorXd &ydot);
+	void computeJacTransProd(const Eigen::VectorXd &y, Eigen::VectorXd &x);
+	void computeMtildeProd(double h, const Eigen::VectorXd &x, Eigen::VectorXd &y, bool isImplicit);
+	int solveCG(double h, const Eigen::VectorXd &b, Eigen::VectorXd &x);
+	void solveEquality(const Eigen::VectorXd &b, const Eigen::VectorXd &c);
+	void solveEqualityRangeSpace(const Eigen::VectorXd &b, const Eigen::VectorXd &c);
+	void solveEqualityNullSpace(const Eigen::VectorXd &b, const Eigen::VectorXd &c);
+	void solveInequality(const Eigen::VectorXd &b, const Eigen::VectorXd &c, int ne, int ni, bool isSparse);
+	void solveWithoutInequalities(const Eigen::VectorXd &b, const Eigen::VectorXd &c, int ne, bool isSparse);
+	void assemble(double h, Eigen::Vector3d grav, EnergySample *sample = nullptr);
+	int assembleConstraints(double alpha);
+	void setMallocAllowed(bool isAllowed);
+	void resizeNullSpace(int nz);
+	EnergySample *getEnergySample(double t);
+	void commitEnergySample(const EnergySample *sample);
+
 	int nr;
 	int nm;
 
@@ -80,6 +140,7 @@ private:
 	Integrator m_integrator;
 	std::shared_ptr<Solution> m_solutions;
 
+	// Workspace: sized once in init(), reused by every step
 	Eigen::MatrixXd M;
 	Eigen::MatrixXd K;
 	Eigen::VectorXd f;
@@ -98,6 +159,10 @@ private:
 	Eigen::VectorXd fr;
 	Eigen::VectorXd fsr;
 	Eigen::VectorXd fdr;
+	Eigen::MatrixXd MK;				// M - h^2 K
+	Eigen::MatrixXd JtMK;			// J' * (M - h^2 K)
+	Eigen::VectorXd Jdotqdot;		// Jdot * qdot0
+	Eigen::VectorXd fm;				// f - M * Jdot * qdot0
 
 	Eigen::MatrixXd Gm;
 	Eigen::MatrixXd Gmdot;
@@ -115,6 +180,43 @@ private:
 	Eigen::VectorXd g;
 	Eigen::VectorXd gdot;
 	Eigen::VectorXd rhsG;
+	Eigen::MatrixXd Gmt;
+	Eigen::MatrixXd Grt;
+	Eigen::VectorXd lm;
+	Eigen::VectorXd lr;
+
+	Eigen::MatrixXd LHS;			// KKT matrix, the lower right block stays zero
+	Eigen::VectorXd rhs;
+	Eigen::VectorXd sol;
+	Eigen::LDLT<Eigen::MatrixXd> m_ldlt;
+	Eigen::LDLT<Eigen::MatrixXd> m_ldltKKT;
+
+	// Equality-only step without the KKT matrix (dense path)
+	EqualitySolver m_eqSolver;
+	EqualitySolver m_eqSolverUsed;
+	double m_nullSpaceRatio;		// EQ_AUTO uses the null space when ne >= ratio * nr
+	Eigen::MatrixXd eqY;			// inv(Mtilde) * G'
+	Eigen::MatrixXd eqS;			// Schur complement G * inv(Mtilde) * G'
+	Eigen::LDLT<Eigen::MatrixXd> m_ldltS;
+	Eigen::ColPivHouseholderQR<Eigen::MatrixXd> m_qrG;	// G' * P = Q * R
+	Eigen::MatrixXd eqQ;
+	Eigen::VectorXd eqQws;			// Workspace for forming Q
+	Eigen::MatrixXd eqMZ;			// Mtilde * Z, sized by the rank of G
+	Eigen::MatrixXd eqZMZ;			// Z' * Mtilde * Z
+	Eigen::VectorXd eqz;			// Null space coordinates of x
+	Eigen::LDLT<Eigen::MatrixXd> m_ldltZ;
+	Eigen::VectorXd eqx;
+	Eigen::VectorXd eqr;
+	Eigen::VectorXd eqw;
+
+	// Inequality step: the built-in active-set QP keeps its warm start between steps
+	QPSolver m_qpSolver;
+	std::shared_ptr<QuadProgActiveSet> m_qp;
+	std::shared_ptr<QuadProgMosek> m_mosek;		// Created on first use, keeps its task alive
+	std::vector<int> qpKeys;
+	Eigen::VectorXd qpf;			// Linear term of the QP, -b
+	Eigen::VectorXd cvec;			// Right-hand side of C x <= 0, sized for all inequalities
+	std::vector<Tripletd> qpTriplets_;		// Dense blocks handed to MOSEK with a fixed pattern
 
 	Eigen::MatrixXd Cm;
 	Eigen::MatrixXd Cmdot;
@@ -130,12 +232,82 @@ private:
 
 	Eigen::VectorXd rhsC;
 
-	Eigen::MatrixXd C;
+	Eigen::MatrixXd C;				// Active rows first, sized for all inequalities
 	Eigen::VectorXd c;
+	Eigen::VectorXd cdot;
 
 	std::vector<int> rowsM;
 	std::vector<int> rowsR;
 
+	Eigen::VectorXd yk;
+	Eigen::VectorXd ydotk;
+
+	// Test hook: with EIGEN_RUNTIME_NO_MALLOC defined (cmake -DMALLOC_CHECK=ON),
+	// Eigen asserts on any heap allocation inside a dense step after the first one.
+	bool m_isMallocCheck;
+	bool m_isMallocAllowed;
+	int m_nsteps;
+
+	// Energy monitor, off by default
+	int m_energyInterval;
+	int m_energySteps;					// Steps seen since the monitor was set
+	EnergySample m_energySample;		// Filled by the step being sampled
+	std::vector<EnergySample> m_energySamples;
+
+	// Sparse assembly: the maximal matrices are never formed densely
+	bool m_isSparse;
+	std::vector<Tripletd> M_;
+	std::vector<Tripletd> K_;
+	std::vector<Tripletd> J_;
+	std::vector<Tripletd> Jdot_;
+	std::vector<Tripletd> Ksr_;
+	std::vector<Tripletd> Ddr_;
+	std::vector<Tripletd> Gm_;
+	std::vector<Tripletd> Gmdot_;
+	std::vector<Tripletd> Cm_;
+	std::vector<Tripletd> Cmdot_;
+	std::vector<Tripletd> G_;
+	std::vector<Tripletd> S_;			// Row selection of the active Cm rows
+	std::vector<Tripletd> C_;
+	std::vector<Tripletd> LHS_;
+
+	SparseMatrixd M_sp;
+	SparseMatrixd K_sp;
+	SparseMatrixd J_sp;
+	SparseMatrixd Jdot_sp;
+	SparseMatrixd Mtilde_sp;
+	SparseMatrixd Gm_sp;
+	SparseMatrixd Gmdot_sp;
+	SparseMatrixd Cm_sp;
+	SparseMatrixd Cmdot_sp;
+	SparseMatrixd G_sp;
+	SparseMatrixd C_sp;
+	SparseMatrixd LHS_sp;
+	SparseMatrixd MK_sp;
+	SparseMatrixd Ksr_sp;
+	SparseMatrixd Ddr_sp;
+
+	// Matrix-free step (sparse path without constraints)
+	bool m_isMatrixFree;
+	double m_cgTol;
+	int m_cgMaxIters;
+	int m_cgIters;
+	Eigen::VectorXd Jx;
+	Eigen::VectorXd MKJx;
+	Eigen::VectorXd cgR;
+	Eigen::VectorXd cgP;
+	Eigen::VectorXd cgAp;
+
+	// Adaptive Dormand-Prince integration (REDUCED_ODE45, REDMAX_ODE45)
+	double m_rtol;
+	double m_atol;
+	double m_hODE;						// Step size carried over between calls
+	ODEStats m_odeStats;
+
+	// Sparse factorizations with cached symbolic analysis, per topology
+	std::shared_ptr<LinearSolver> m_linearSolver;		// Mtilde
+	std::shared_ptr<LinearSolver> m_linearSolverKKT;	// Equality KKT matrix
+
 };
 
 #endif // MUSCLEMASS_SRC_SOLVER_H_
\ No newline at end of file
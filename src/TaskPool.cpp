@@ -0,0 +1,86 @@
+#include "TaskPool.h"
+
+using namespace std;
+
+thread_local bool TaskPool::s_isInTask = false;
+
+TaskPool::TaskPool(int nthreads) :
+	m_task(nullptr),
+	m_n(0),
+	m_next(0),
+	m_busy(0),
+	m_generation(0),
+	m_isStopping(false)
+{
+	if (nthreads <= 0) {
+		nthreads = max(1, (int)thread::hardware_concurrency());
+	}
+	for (int i = 0; i < nthreads - 1; i++) {
+		m_threads.push_back(thread([this]() { work(); }));
+	}
+}
+
+TaskPool::~TaskPool() {
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_isStopping = true;
+	}
+	m_start.notify_all();
+	for (int i = 0; i < (int)m_threads.size(); i++) {
+		m_threads[i].join();
+	}
+}
+
+void TaskPool::parallelFor(int n, const function<void(int)> &task) {
+	// Runs serially when there is nothing to share or when already in a task
+	if (m_threads.empty() || n < 2 || s_isInTask) {
+		for (int i = 0; i < n; i++) {
+			task(i);
+		}
+		return;
+	}
+
+	lock_guard<mutex> call(m_callMutex);
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_task = &task;
+		m_n = n;
+		m_next = 0;
+		m_busy = (int)m_threads.size();
+		m_generation++;
+	}
+	m_start.notify_all();
+	runTasks();
+
+	unique_lock<mutex> lock(m_mutex);
+	m_done.wait(lock, [this]() { return m_busy == 0; });
+	m_task = nullptr;
+}
+
+void TaskPool::work() {
+	// Waits for a loop, helps with it, and reports back
+	int generation = 0;
+	unique_lock<mutex> lock(m_mutex);
+	while (true) {
+		m_start.wait(lock, [&]() { return m_isStopping || m_generation != generation; });
+		if (m_isStopping) {
+			return;
+		}
+		generation = m_generation;
+		lock.unlock();
+		runTasks();
+		lock.lock();
+		if (--m_busy == 0) {
+			m_done.notify_one();
+		}
+	}
+}
+
+void TaskPool::runTasks() {
+	// Takes indices until there are none left
+	s_isInTask = true;
+	for (int i = m_next++; i < m_n; i = m_next++) {
+		(*m_task)(i);
+	}
+	s_isInTask = false;
+}
@@ -0,0 +1,47 @@
+#pragma once
+// TaskPool A fixed set of threads for data-parallel loops inside a step
+//    parallelFor hands out the indices of a loop one at a time to the workers
+//    and to the calling thread, and returns when all of them are done. The
+//    workers sleep between loops. A parallelFor issued from inside a task runs
+//    serially on that thread, so kernels can use the pool without knowing
+//    whether they are already running on it.
+
+#ifndef REDUCEDCOORD_SRC_TASKPOOL_H_
+#define REDUCEDCOORD_SRC_TASKPOOL_H_
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+class TaskPool
+{
+public:
+	TaskPool(int nthreads = 0);	// Counts the calling thread; 0 uses the hardware concurrency
+	virtual ~TaskPool();
+
+	int getNumThreads() const { return (int)m_threads.size() + 1; }
+
+	// Calls task(i) for every i in [0, n)
+	void parallelFor(int n, const std::function<void(int)> &task);
+
+private:
+	void work();
+	void runTasks();
+
+	std::vector<std::thread> m_threads;
+	std::mutex m_callMutex;						// One parallelFor at a time
+	std::mutex m_mutex;
+	std::condition_variable m_start;
+	std::condition_variable m_done;
+	const std::function<void(int)> *m_task;
+	int m_n;
+	std::atomic<int> m_next;
+	int m_busy;									// Workers still in the current loop
+	int m_generation;							// Incremented for every loop
+	bool m_isStopping;
+	static thread_local bool s_isInTask;
+};
+
+#endif // REDUCEDCOORD_SRC_TASKPOOL_H_
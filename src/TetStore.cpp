@@ -0,0 +1,255 @@
+#include "TetStore.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include "Tetrahedron.h"
+#include "Node.h"
+#include "svd3.h"
+
+using namespace std;
+using namespace Eigen;
+
+// Small row-major 3x3 kernels on one lane. They are inlined into the lane
+// loops below, which is what lets those loops vectorize.
+
+static inline double det3(const double *a) {
+	return a[0] * (a[4] * a[8] - a[5] * a[7]) - a[1] * (a[3] * a[8] - a[5] * a[6]) + a[2] * (a[3] * a[7] - a[4] * a[6]);
+}
+
+// Cofactor matrix, so that inv(a)' = cof(a) / det(a)
+static inline void cof3(const double *a, double *c) {
+	c[0] = a[4] * a[8] - a[5] * a[7];
+	c[1] = a[5] * a[6] - a[3] * a[8];
+	c[2] = a[3] * a[7] - a[4] * a[6];
+	c[3] = a[2] * a[7] - a[1] * a[8];
+	c[4] = a[0] * a[8] - a[2] * a[6];
+	c[5] = a[1] * a[6] - a[0] * a[7];
+	c[6] = a[1] * a[5] - a[2] * a[4];
+	c[7] = a[2] * a[3] - a[0] * a[5];
+	c[8] = a[0] * a[4] - a[1] * a[3];
+}
+
+static inline double normsq3(const double *a) {
+	double s = 0.0;
+	for (int i = 0; i < 9; i++) {
+		s += a[i] * a[i];
+	}
+	return s;
+}
+
+// c = a' * b
+static inline void mulAtB3(const double *a, const double *b, double *c) {
+	for (int r = 0; r < 3; r++) {
+		for (int col = 0; col < 3; col++) {
+			c[3 * r + col] = a[r] * b[col] + a[3 + r] * b[3 + col] + a[6 + r] * b[6 + col];
+		}
+	}
+}
+
+// c = a * b
+static inline void mul3(const double *a, const double *b, double *c) {
+	for (int r = 0; r < 3; r++) {
+		for (int col = 0; col < 3; col++) {
+			c[3 * r + col] = a[3 * r] * b[col] + a[3 * r + 1] * b[3 + col] + a[3 * r + 2] * b[6 + col];
+		}
+	}
+}
+
+void TetStore::init(const vector<shared_ptr<Tetrahedron> > &tets) {
+	// Packs the tets and pads the last block
+	m_ntets = (int)tets.size();
+	m_nblocks = (m_ntets + LANES - 1) / LANES;
+	int npadded = m_nblocks * LANES;
+	if (m_ntets > 0) {
+		m_material = tets[0]->getMaterial();
+	}
+
+	for (int i = 0; i < 9; i++) {
+		m_Bm[i].resize(npadded);
+	}
+	for (int a = 0; a < 4; a++) {
+		m_idx[a].resize(npadded);
+	}
+	m_W.resize(npadded);
+	m_mu.resize(npadded);
+	m_lambda.resize(npadded);
+	m_fe.resize(m_ntets);
+	m_energy.resize(m_ntets);
+
+	for (int k = 0; k < npadded; k++) {
+		auto tet = tets[min(k, m_ntets - 1)];
+		const Matrix3d &Bm = tet->getBm();
+		for (int r = 0; r < 3; r++) {
+			for (int c = 0; c < 3; c++) {
+				m_Bm[3 * r + c][k] = Bm(r, c);
+			}
+		}
+		for (int a = 0; a < 4; a++) {
+			m_idx[a][k] = tet->m_nodes[a]->i;
+		}
+		m_W[k] = k < m_ntets ? tet->getVolume() : 0.0;
+		m_mu[k] = tet->getMu();
+		m_lambda[k] = tet->getLambda();
+	}
+}
+
+void TetStore::computeForces(int b, const VectorXd &x) {
+	// Computes the same quantities as Tetrahedron::computeElasticForces
+	int base = b * LANES;
+	double F[9][LANES];
+	double P[9][LANES];
+	double psi[LANES];
+
+	// F = Ds * Bm
+	for (int l = 0; l < LANES; l++) {
+		int k = base + l;
+		double ds[9], bm[9], f[9];
+		int i3 = 3 * m_idx[3][k];
+		for (int a = 0; a < 3; a++) {
+			int ia = 3 * m_idx[a][k];
+			for (int r = 0; r < 3; r++) {
+				ds[3 * r + a] = x(ia + r) - x(i3 + r);
+			}
+		}
+		for (int i = 0; i < 9; i++) {
+			bm[i] = m_Bm[i][k];
+		}
+		mul3(ds, bm, f);
+		for (int i = 0; i < 9; i++) {
+			F[i][l] = f[i];
+		}
+	}
+
+	// Stress and energy density
+	switch (m_material) {
+	case LINEAR:
+	{
+		for (int l = 0; l < LANES; l++) {
+			double mu = m_mu[base + l];
+			double lambda = m_lambda[base + l];
+			double e[9];
+			for (int r = 0; r < 3; r++) {
+				for (int c = 0; c < 3; c++) {
+					e[3 * r + c] = 0.5 * (F[3 * r + c][l] + F[3 * c + r][l]) - (r == c ? 1.0 : 0.0);
+				}
+			}
+			double tr = e[0] + e[4] + e[8];
+			psi[l] = mu * normsq3(e) + 0.5 * lambda * tr * tr;
+			for (int i = 0; i < 9; i++) {
+				P[i][l] = 2.0 * mu * e[i];
+			}
+			P[0][l] += lambda * tr;
+			P[4][l] += lambda * tr;
+			P[8][l] += lambda * tr;
+		}
+		break;
+	}
+
+	case STVK:
+	{
+		for (int l = 0; l < LANES; l++) {
+			double mu = m_mu[base + l];
+			double lambda = m_lambda[base + l];
+			double f[9], e[9], s[9], p[9];
+			for (int i = 0; i < 9; i++) {
+				f[i] = F[i][l];
+			}
+			mulAtB3(f, f, e);
+			for (int i = 0; i < 9; i++) {
+				e[i] *= 0.5;
+			}
+			e[0] -= 0.5;
+			e[4] -= 0.5;
+			e[8] -= 0.5;
+			double tr = e[0] + e[4] + e[8];
+			psi[l] = mu * normsq3(e) + 0.5 * lambda * tr * tr;
+			for (int i = 0; i < 9; i++) {
+				s[i] = 2.0 * mu * e[i];
+			}
+			s[0] += lambda * tr;
+			s[4] += lambda * tr;
+			s[8] += lambda * tr;
+			mul3(f, s, p);
+			for (int i = 0; i < 9; i++) {
+				P[i][l] = p[i];
+			}
+		}
+		break;
+	}
+
+	case NEO_HOOKEAN:
+	{
+		for (int l = 0; l < LANES; l++) {
+			double mu = m_mu[base + l];
+			double lambda = m_lambda[base + l];
+			double f[9], c[9];
+			for (int i = 0; i < 9; i++) {
+				f[i] = F[i][l];
+			}
+			cof3(f, c);
+			double J = det3(f);
+			double logJ = log(abs(J));
+			psi[l] = 0.5 * mu * (normsq3(f) - 3.0) - mu * logJ + 0.5 * lambda * logJ * logJ;
+			for (int i = 0; i < 9; i++) {
+				double FIT = c[i] / J;
+				P[i][l] = mu * (f[i] - FIT) + lambda * logJ * FIT;
+			}
+		}
+		break;
+	}
+
+	case CO_ROTATED:
+	{
+		// R and S of all lanes at once, as in Tetrahedron::computePKStress
+		double R[9][LANES], S[9][LANES];
+		polarLanes<LANES>(F, R, S);
+		for (int l = 0; l < LANES; l++) {
+			double mu = m_mu[base + l];
+			double lambda = m_lambda[base + l];
+			double e[9];
+			for (int i = 0; i < 9; i++) {
+				e[i] = S[i][l];
+			}
+			e[0] -= 1.0;
+			e[4] -= 1.0;
+			e[8] -= 1.0;
+			double tr = e[0] + e[4] + e[8];
+			psi[l] = mu * normsq3(e) + 0.5 * lambda * tr * tr;
+			for (int i = 0; i < 9; i++) {
+				P[i][l] = 2.0 * mu * (F[i][l] - R[i][l]) + lambda * tr * R[i][l];
+			}
+		}
+		break;
+	}
+
+	default:
+	{
+		for (int l = 0; l < LANES; l++) {
+			psi[l] = 0.0;
+			for (int i = 0; i < 9; i++) {
+				P[i][l] = 0.0;
+			}
+		}
+		break;
+	}
+	}
+
+	// H = -W * P * Bm', whose columns are the forces on the first three nodes
+	int nlanes = min((int)LANES, m_ntets - base);
+	for (int l = 0; l < nlanes; l++) {
+		int k = base + l;
+		double W = m_W[k];
+		Vector12d &fe = m_fe[k];
+		for (int r = 0; r < 3; r++) {
+			double sum = 0.0;
+			for (int a = 0; a < 3; a++) {
+				double h = -W * (P[3 * r][l] * m_Bm[3 * a][k] + P[3 * r + 1][l] * m_Bm[3 * a + 1][k] + P[3 * r + 2][l] * m_Bm[3 * a + 2][k]);
+				fe(3 * a + r) = h;
+				sum += h;
+			}
+			fe(9 + r) = -sum;
+		}
+		m_energy[k] = W * psi[l];
+	}
+}
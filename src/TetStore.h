@@ -0,0 +1,60 @@
+#pragma once
+// TetStore Packed copy of a soft body's tets for batched force evaluation
+//    Keeps Bm, the rest volume W, the Lame parameters and the four node
+//    indices of every tet in structure-of-arrays form, padded to a multiple of
+//    LANES tets. A block of LANES tets is evaluated together: F = Ds * Bm, the
+//    stress P(F), the energy density and the nodal forces H = -W * P * Bm',
+//    with every lane doing the same branch-free arithmetic so that the
+//    compiler can keep a lane group in one AVX2/AVX-512 register. Tetrahedron
+//    keeps the per-object path, which is the reference for this one.
+
+#ifndef REDUCEDCOORD_SRC_TETSTORE_H_
+#define REDUCEDCOORD_SRC_TETSTORE_H_
+#include <vector>
+#include <memory>
+#define EIGEN_DONT_ALIGN_STATICALLY
+
+#include <Eigen/Dense>
+#include "MLCommon.h"
+
+class Tetrahedron;
+
+class TetStore
+{
+public:
+	enum { LANES = 8 };
+
+	TetStore() : m_ntets(0), m_nblocks(0), m_material(LINEAR) {}
+	virtual ~TetStore() {}
+
+	// Packs the tets. All of them must use the same material.
+	void init(const std::vector<std::shared_ptr<Tetrahedron> > &tets);
+
+	int getNumTets() const { return m_ntets; }
+	int getNumBlocks() const { return m_nblocks; }
+
+	// Computes the forces and energies of the tets in block b from the node
+	// positions x, stored at 3 * node->i. Blocks may run concurrently.
+	void computeForces(int b, const Eigen::VectorXd &x);
+
+	// Results of the last computeForces of the tet's block
+	const Vector12d &getForces(int k) const { return m_fe[k]; }		// Forces on nodes i, j, k, l
+	double getEnergy(int k) const { return m_energy[k]; }				// Strain energy
+
+private:
+	int m_ntets;
+	int m_nblocks;
+	Material m_material;
+
+	// Per tet, padded with zero-volume copies of the last tet
+	std::vector<double> m_Bm[9];		// Bm, row-major
+	std::vector<double> m_W;
+	std::vector<double> m_mu;
+	std::vector<double> m_lambda;
+	std::vector<int> m_idx[4];			// node->i of nodes i, j, k, l
+
+	std::vector<Vector12d> m_fe;
+	std::vector<double> m_energy;
+};
+
+#endif // REDUCEDCOORD_SRC_TETSTORE_H_
@@ -93,7 +93,7 @@ Matrix3x4d Tetrahedron::computeAreaWeightedVertexNormals() {
 	return this->Nm;
 }
 
-VectorXd Tetrahedron::computeElasticForces(VectorXd f) {
+const Vector12d &Tetrahedron::computeElasticForces() {
 	/*if (m_isInvertible) {
 		isInverted();
 	}
@@ -108,6 +108,7 @@ VectorXd Tetrahedron::computeElasticForces(VectorXd f) {
 	//}
 
 	this->P = computePKStress(F, m_mu, m_lambda);
+	this->m_energy = W * psi;
 	this->H = -W * P * (Bm.transpose());
 
 	/*if (isInvert && m_isInvertible) {
@@ -123,21 +124,26 @@ VectorXd Tetrahedron::computeElasticForces(VectorXd f) {
 	//
 
 	for (int i = 0; i < (int)m_nodes.size() - 1; i++) {
-		int rowi = m_nodes[i]->idxM;
-		f.segment<3>(rowi) += H.col(i);
-		int row3 = m_nodes[3]->idxM;
-		f.segment<3>(row3) -= H.col(i);
+		fe.segment<3>(3 * i) = H.col(i);
 
 		//m_nodes[i]->addForce(H.col(i));
 		//m_nodes[3]->addForce(-H.col(i));
 	}
+	fe.segment<3>(9) = -H.rowwise().sum();
 
-	return f;
+	return fe;
 }
 
+void Tetrahedron::computeElasticForces(VectorXd &f) {
+	computeElasticForces();
+	for (int i = 0; i < (int)m_nodes.size(); i++) {
+		f.segment<3>(m_nodes[i]->idxM) += fe.segment<3>(3 * i);
+	}
+}
 
 
-VectorXd Tetrahedron::computeInvertibleElasticForces(VectorXd f) {
+
+const Vector12d &Tetrahedron::computeInvertibleElasticForces() {
 
 	this->F = computeDeformationGradient();
 	// The deformation gradient is available in this->F
@@ -148,13 +154,10 @@ VectorXd Tetrahedron::computeInvertibleElasticForces(VectorXd f) {
 		isInvert = false;
 	}
 
-	// SVD on the deformation gradient
-	int modifiedSVD = 1;
+	// SVD on the deformation gradient. U and V are rotations, and the
+	// smallest singular value is negative when the tet is inverted.
 	Vector3d Fhat_vec;
-
-	if (!SVD(this->F, this->U, Fhat_vec, this->V, 1e-8, modifiedSVD)) {
-		//cout << "error in svd " << endl;
-	}
+	svd3(this->F, this->U, Fhat_vec, this->V);
 	this->Fhat = Fhat_vec.asDiagonal();
 
 	// SVD result is available in this->U, this->V, Fhat_vec, this->Fhat
@@ -177,6 +180,7 @@ VectorXd Tetrahedron::computeInvertibleElasticForces(VectorXd f) {
 
 	// Computes the diagonal P tensor
 	this->Phat = computeInvertiblePKStress(this->Fhat, m_mu, m_lambda);
+	this->m_energy = W * psi;
 	
 	// P = U * diag(Phat) * V'
 	this->P = this->U * this->Phat * this->V.transpose();
@@ -184,14 +188,20 @@ VectorXd Tetrahedron::computeInvertibleElasticForces(VectorXd f) {
 	// Computes the nodal forces by G=PBm=PNm
 
 	for (int i = 0; i < (int)m_nodes.size(); i++) {
-		int rowi = m_nodes[i]->idxM;
-		f.segment<3>(rowi) += this->P * this->Nm.col(i);
+		fe.segment<3>(3 * i) = this->P * this->Nm.col(i);
 	}
 
-	return f;
+	return fe;
+}
+
+void Tetrahedron::computeInvertibleElasticForces(VectorXd &f) {
+	computeInvertibleElasticForces();
+	for (int i = 0; i < (int)m_nodes.size(); i++) {
+		f.segment<3>(m_nodes[i]->idxM) += fe.segment<3>(3 * i);
+	}
 }
 
-void Tetrahedron::computeInvertibleForceDifferentials(VectorXd dx, VectorXd &df) {
+void Tetrahedron::computeInvertibleForceDifferentials(const VectorXd &dx, VectorXd &df) {
 	this->F = computeDeformationGradient();
 
 	/*if (isInvert && m_isInvertible) {
@@ -255,6 +265,9 @@ Matrix3d Tetrahedron::computeInvertiblePKStress(Matrix3d F, double mu, double la
 
 	invariants << IC, IIC, IIIC;
 
+	// Neo-Hookean in the invariants of the (clamped) diagonal F
+	psi = 0.5 * mu * (IC - 3.0) - 0.5 * mu * log(IIIC) + 0.125 * lambda * log(IIIC) * log(IIIC);
+
 	Vector3d dPsidIV;
 	dPsidIV << 0.5 * mu, 0.0, (-0.5 * mu + 0.25 * lambda * log(IIIC)) / IIIC;
 
@@ -317,11 +330,9 @@ Matrix3d Tetrahedron::computePKStress(Matrix3d F, double mu, double lambda) {
 
 	case CO_ROTATED:
 	{
-		// Polar decomposition
-		Matrix3d A = F.adjoint() * F;
-		SelfAdjointEigenSolver<Matrix3d> es(A);
-		Matrix3d S = es.operatorSqrt();
-		Matrix3d R = F * S.inverse();
+		// Polar decomposition, with R a rotation even for inverted tets
+		Matrix3d R, S;
+		polar3(F, R, S);
 
 		E = S - I;
 		psi = mu * E.norm() * E.norm() + 1.0 / 2.0 * lambda * E.trace() * E.trace();
@@ -350,10 +361,8 @@ Matrix3d Tetrahedron::computePKStressDerivative(Matrix3d F, Matrix3d dF, double
 	switch (m_material) {
 	case CO_ROTATED:
 	{
-		Matrix3d A = F.adjoint() * F;
-		SelfAdjointEigenSolver<Matrix3d> es(A);
-		Matrix3d S = es.operatorSqrt();
-		Matrix3d R = F * S.inverse();
+		Matrix3d R, S;
+		polar3(F, R, S);
 		E = S - I3;
 		P = 2.0 * mu *(F - R) + lambda * (R.transpose()*F - I3).trace() * R;
 		break;
@@ -430,7 +439,6 @@ Matrix3d Tetrahedron::computePKStressDerivative(Matrix3d F, Matrix3d dF, double
 
 bool Tetrahedron::isInverted() {
 
-	int modifiedSVD = 1;
 	Vector3d Fhat_vec;
 	for (int i = 0; i < (int)m_nodes.size() - 1; i++) {
 		this->Ds.col(i) = m_nodes[i]->x - m_nodes[3]->x;
@@ -438,7 +446,7 @@ bool Tetrahedron::isInverted() {
 
 	this->F = Ds * Bm;
 	if (this->F.determinant() < 0.0) { // some threshold todo
-		SVD(this->F, this->U, Fhat_vec, this->V, 1e-8, modifiedSVD);
+		svd3(this->F, this->U, Fhat_vec, this->V);
 		
 		// clamp if below the principal stretch threshold
 		int clamped = 0;
@@ -481,44 +489,13 @@ bool Tetrahedron::isInverted() {
 }
 
 void Tetrahedron::diagDeformationGradient(Eigen::Matrix3d F_) {
-	Eigen::Matrix3f F = F_.cast<float>();
-	float a11, a12, a13, a21, a22, a23, a31, a32, a33;
-
-	a11 = F(0, 0); a12 = F(0, 1); a13 = F(0, 2);
-	a21 = F(1, 0); a22 = F(1, 1); a23 = F(1, 2);
-	a31 = F(2, 0); a32 = F(2, 1); a33 = F(2, 2);
-
-	float u11, u12, u13,
-		u21, u22, u23,
-		u31, u32, u33;
-
-	float 	s11, s12, s13,
-		s21, s22, s23,
-		s31, s32, s33;
-
-	float 	v11, v12, v13,
-		v21, v22, v23,
-		v31, v32, v33;
-
-	svd(a11, a12, a13, a21, a22, a23, a31, a32, a33,
-		u11, u12, u13, u21, u22, u23, u31, u32, u33,
-		s11, s12, s13, s21, s22, s23, s31, s32, s33,
-		v11, v12, v13, v21, v22, v23, v31, v32, v33);
-
-	Eigen::Matrix3f U_, V_, S_;
-	U_ << u11, u12, u13,
-		u21, u22, u23,
-		u31, u32, u33;
-	V_ << v11, v12, v13, v21, v22, v23, v31, v32, v33;
-	S_ << s11, s12, s13, s21, s22, s23, s31, s32, s33;
-	this->U = U_.cast<double>();
-	this->V = V_.cast<double>();
-	this->Fhat = S_.cast<double>();
-
+	Vector3d Fhat_vec;
+	svd3(F_, this->U, Fhat_vec, this->V);
+	this->Fhat = Fhat_vec.asDiagonal();
 }
 
 
-void Tetrahedron::computeForceDifferentials(VectorXd dx, VectorXd& df) {
+void Tetrahedron::computeForceDifferentials(const VectorXd &dx, VectorXd& df) {
 	this->F = computeDeformationGradient();
 
 	/*if (isInvert && m_isInvertible) {
@@ -593,6 +570,34 @@ void Tetrahedron::computeForceDifferentials(VectorXd dx, VectorXd& df) {
 	}*/
 }
 
+const Matrix12d &Tetrahedron::computeStiffness() {
+	// Computes the 12x12 element stiffness one node coordinate at a time.
+	// Moving node a along axis r changes F by e_r * g_a, where g_a is row a
+	// of Bm for the first three nodes and minus the sum of the rows for the
+	// last, so each column only needs 3x3 work.
+	this->F = computeDeformationGradient();
+
+	Matrix3x4d g;
+	g.block<3, 3>(0, 0) = Bm.transpose();
+	g.col(3) = -g.block<3, 3>(0, 0).rowwise().sum();
+
+	for (int a = 0; a < 4; a++) {
+		for (int r = 0; r < 3; r++) {
+			this->dF.setZero();
+			this->dF.row(r) = g.col(a).transpose();
+			this->dP = computePKStressDerivative(F, dF, m_mu, m_lambda);
+			this->dH = -W * dP * (Bm.transpose());
+
+			int col = 3 * a + r;
+			for (int i = 0; i < 3; i++) {
+				K.block<3, 1>(3 * i, col) = this->dH.col(i);
+			}
+			K.block<3, 1>(9, col) = -this->dH.rowwise().sum();
+		}
+	}
+	return K;
+}
+
 double Tetrahedron::computeEnergy() {
 	//isInverted();
 
@@ -23,14 +23,17 @@ public:
 
 	Eigen::Matrix3d computePKStress(Eigen::Matrix3d F, double mu, double lambda);
 	Eigen::Matrix3d computePKStressDerivative(Eigen::Matrix3d F, Eigen::Matrix3d dF, double mu, double lambda);
-	void computeForceDifferentials(Eigen::VectorXd dx, Eigen::VectorXd &df);
-	// Vector12d computeForceDifferentials(Vector12d dx, Vector12d &df);
-	Eigen::VectorXd computeElasticForces(Eigen::VectorXd f);
+	void computeForceDifferentials(const Eigen::VectorXd &dx, Eigen::VectorXd &df);
+	const Matrix12d &computeStiffness();	// Element stiffness, d(forces)/d(x) of nodes i, j, k, l
+	const Matrix12d &getStiffness() const { return K; }	// As of the last computeStiffness
+	const Vector12d &computeElasticForces();		// Forces on nodes i, j, k, l
+	void computeElasticForces(Eigen::VectorXd &f);	// Adds the forces to f at the nodes' idxM
 
 	// Functions for Invertible FEM 
 	Matrix3x4d computeAreaWeightedVertexNormals();
-	Eigen::VectorXd computeInvertibleElasticForces(Eigen::VectorXd f);
-	void computeInvertibleForceDifferentials(Eigen::VectorXd dx, Eigen::VectorXd &df);
+	const Vector12d &computeInvertibleElasticForces();
+	void computeInvertibleElasticForces(Eigen::VectorXd &f);
+	void computeInvertibleForceDifferentials(const Eigen::VectorXd &dx, Eigen::VectorXd &df);
 	Eigen::Matrix3d computeInvertiblePKStress(Eigen::Matrix3d F, double mu, double lambda);
 	Eigen::Matrix3d computeInvertiblePKStressDerivative(Eigen::Matrix3d F, Eigen::Matrix3d dF, double mu, double lambda);
 	void compute_dPdF();
@@ -39,10 +42,17 @@ public:
 
 
 	double computeEnergy();
+	double getEnergy() const { return m_energy; }	// Strain energy at the last force evaluation
 	std::vector<std::shared_ptr<Node>> m_nodes;	// i, j, k, l
 	bool isInverted();
 	void diagDeformationGradient(Eigen::Matrix3d F);
 	void setInvertiblity(bool isInvertible) { m_isInvertible = isInvertible; }
+	Material getMaterial() const { return m_material; }
+	double getMu() const { return m_mu; }
+	double getLambda() const { return m_lambda; }
+	double getVolume() const { return W; }
+	const Eigen::Matrix3d &getBm() const { return Bm; }
+
 	bool isInvert;
 	int i;
 
@@ -73,6 +83,7 @@ private:
 	Eigen::Matrix3d F;		// deformation gradient
 	Eigen::Matrix3d P;		// Piola stress
 	Eigen::Matrix3d H;		// forces matrix
+	Vector12d fe;			// nodal forces of i, j, k, l
 
 	double psi;		// strain energy per unit undeformed volume
 	double m_energy;
@@ -10,6 +10,8 @@
 #include "JointRevolute.h"
 #include "JointSplineCurve.h"
 #include "JointSplineSurface.h"
+#include "JointTree.h"
+#include "TaskPool.h"
 
 #include "Node.h"
 #include "Body.h"
@@ -609,6 +611,7 @@ shared_ptr<Body> World::addBody(double density, Vector3d sides, Vector3d p, Matr
 	Matrix4d E = SE3::RpToE(R, p);
 	body->setTransform(E);
 	body->load(RESOURCE_DIR, file_name);
+	body->setColors(m_nbodies);
 	m_bodies.push_back(body);
 	m_nbodies++;
 	return body;
@@ -809,14 +812,21 @@ void World::init() {
 	m_joints[i]->init(nm, nr);
 	}*/
 
-	//joint ordering
-	// todo
-
 	for (int i = m_njoints - 1; i > -1; i--) {
 		m_joints[i]->init(nm, nr);
 	}
 
+	if (m_njoints == 0) {
+		addJointNull();
+	}
+
+	// Joint ordering: every traversal walks the flat tree, parents before children
+	m_jointTree = make_shared<JointTree>();
+	m_jointTree->build(m_joints);
+	m_jointTree->setTaskPool(m_taskPool.get());
 	for (int i = 0; i < m_njoints; i++) {
+		m_joints[i]->next = nullptr;
+		m_joints[i]->prev = nullptr;
 		if (i < m_njoints - 1) {
 			m_joints[i]->next = m_joints[i + 1];
 		}
@@ -839,10 +849,6 @@ void World::init() {
 		}
 	}
 
-	if (m_njoints == 0) {
-		addJointNull();
-	}
-
 	if (m_ncomps == 0) {
 		addCompNull();
 	}
@@ -970,6 +976,7 @@ void World::init() {
 	for (int i = 0; i < m_nsoftbodies; i++) {
 		m_softbodies[i]->countDofs(nm, nr);
 		m_softbodies[i]->init();
+		m_softbodies[i]->setTaskPool(m_taskPool.get());
 		// Create attachment constraints
 		auto constraint = make_shared<ConstraintAttachSoftBody>(m_softbodies[i]);
 		m_constraints.push_back(constraint);
@@ -1011,6 +1018,32 @@ void World::update() {
 	m_wraps[0]->update();
 }
 
+void World::setNumThreads(int nthreads) {
+	// Replaces the task pool. May be called before or after init(), but not during a step.
+	shared_ptr<TaskPool> pool;
+	if (nthreads > 1) {
+		pool = make_shared<TaskPool>(nthreads);
+	}
+	if (m_jointTree != nullptr) {
+		m_jointTree->setTaskPool(pool.get());
+	}
+	for (int i = 0; i < (int)m_softbodies.size(); i++) {
+		m_softbodies[i]->setTaskPool(pool.get());
+	}
+	m_taskPool = pool;
+}
+
+VectorXd World::computeInverseDynamics(const VectorXd &q, const VectorXd &qdot, const VectorXd &qddot) const {
+	// Computes the torques for one state
+	return m_jointTree->getInverseDynamics().compute(q, qdot, qddot, m_grav);
+}
+
+MatrixXd World::computeInverseDynamics(const MatrixXd &y, const MatrixXd &qddot, bool isParallel) const {
+	// Computes the torques for every row, on the task pool if asked and available
+	TaskPool *pool = isParallel ? m_taskPool.get() : nullptr;
+	return m_jointTree->getInverseDynamics().compute(y, qddot, m_grav, pool);
+}
+
 int World::getNsteps() {
 	// Computes the number of results
 	int nsteps = int((m_tspan(1) - m_tspan(0)) / m_h);
@@ -1018,15 +1051,11 @@ int World::getNsteps() {
 }
 
 void World::draw(shared_ptr<MatrixStack> MV, const shared_ptr<Program> prog, const shared_ptr<Program> progSimple, const shared_ptr<Program> progSoft, shared_ptr<MatrixStack> P) {
-	// Draw rigid bodies
-	for (int i = 0; i < m_nbodies; i++) {
-		m_bodies[i]->draw(MV, prog, P);
-	}
-
-	// Draw joints
-	for (int i = 0; i < m_njoints; i++) {
-		m_joints[i]->draw(MV, prog, progSimple, P);
+	// Draw rigid bodies and joints. Both walk their whole chain.
+	if (m_nbodies > 0) {
+		m_bodies[0]->draw(MV, prog, P);
 	}
+	m_joints[0]->draw(MV, prog, progSimple, P);
 
 	// Draw springs
 	for (int i = 0; i < m_ndeformables; i++) {
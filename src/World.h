@@ -13,6 +13,8 @@
 #include "MLCommon.h"
 
 class Joint;
+class JointTree;
+class TaskPool;
 class JointRevolute;
 class Body;
 class SoftBody;
@@ -190,6 +192,13 @@ public:
 
 	Energy computeEnergy();
 
+	// Joint torques that give the joint accelerations qddot at (q, qdot), by
+	// recursive Newton-Euler. The joints and bodies are not changed. The batch
+	// version takes one state per row, with y = [q qdot] as in Solution::y, and
+	// spreads the rows over the task pool if isParallel. Needs init().
+	Eigen::VectorXd computeInverseDynamics(const Eigen::VectorXd &q, const Eigen::VectorXd &qdot, const Eigen::VectorXd &qddot) const;
+	Eigen::MatrixXd computeInverseDynamics(const Eigen::MatrixXd &y, const Eigen::MatrixXd &qddot, bool isParallel = false) const;
+
 	void load(const std::string &RESOURCE_DIR);
 	void init();
 	void update();
@@ -204,11 +213,20 @@ public:
 	void setTime(double t) { m_t = t; }
 	double getTime() const { return m_t; }
 	double getH() const { return m_h; }
+	void setH(double h) { m_h = h; }
+	void setTspan(Eigen::Vector2d tspan) { m_tspan = tspan; }
 	void incrementTime() { m_t += m_h; }
 
 	void setGrav(Eigen::Vector3d grav) { m_grav = grav; }
 	Eigen::Vector3d getGrav() const { return m_grav; }
 
+	// Threads for the joint tree passes and the soft-body tet loops, counting
+	// the calling one. With more than one, independent subtrees (and the wide
+	// levels of a single tree) and the tets are processed in parallel; see
+	// SoftBody::setAssembly. Defaults to 1.
+	void setNumThreads(int nthreads);
+	std::shared_ptr<TaskPool> getTaskPool() const { return m_taskPool; }
+
 	std::shared_ptr<Body> getBody(int uid);
 	std::shared_ptr<Body> getBody(const std::string &name);
 	std::shared_ptr<Joint> getJoint(int uid);
@@ -217,6 +235,8 @@ public:
 
 	std::shared_ptr<Body> getBody0() const { return m_bodies[0]; }
 	std::shared_ptr<Joint> getJoint0() const { return m_joints[0]; }
+	std::shared_ptr<Joint> getJointN() const { return m_joints[m_njoints - 1]; }
+	std::shared_ptr<JointTree> getJointTree() const { return m_jointTree; }
 	std::shared_ptr<Deformable> getDeformable0() const { return m_deformables[0]; }
 	std::shared_ptr<SoftBody> getSoftBody0() const { return m_softbodies[0]; }
 	std::shared_ptr<Constraint> getConstraint0() const { return m_constraints[0]; }
@@ -260,7 +280,9 @@ private:
 	std::vector<std::shared_ptr<Comp>> m_comps;
 	std::vector<std::shared_ptr<WrapObst>> m_wraps;
 	std::vector <std::shared_ptr<SoftBody>> m_softbodies;
-	std::vector<std::shared_ptr<Joint>> m_joints;
+	std::vector<std::shared_ptr<Joint>> m_joints;		// Parent-before-child after init()
+	std::shared_ptr<JointTree> m_jointTree;
+	std::shared_ptr<TaskPool> m_taskPool;				// Null when serial
 	std::vector<std::shared_ptr<Deformable>> m_deformables;
 	std::vector<std::shared_ptr<Constraint>> m_constraints;
 
@@ -0,0 +1,258 @@
+#pragma once
+// svd3 Fixed-iteration 3x3 SVD and polar decomposition
+//    After [McAdams et al. 2011]: a fixed number of cyclic Jacobi sweeps
+//    diagonalizes A' * A, the columns of A * V are sorted by length, and a
+//    Givens QR of A * V gives U and Sigma. The Jacobi rotations are exact
+//    rather than the paper's approximate ones, which would need more sweeps
+//    in double precision. There are no data-dependent loops or early exits,
+//    only selects, so the same code runs on one matrix or on a group of
+//    lanes (polarLanes). U and V are always rotations; when
+//    det(A) < 0 the last (smallest) singular value is negative, as in
+//    SVD(..., modifiedSVD = 1). The polar decomposition A = R * S follows,
+//    with R = U * V' a rotation.
+
+#ifndef REDUCEDCOORD_SRC_SVD3_H_
+#define REDUCEDCOORD_SRC_SVD3_H_
+#include <cmath>
+#define EIGEN_DONT_ALIGN_STATICALLY
+
+#include <Eigen/Dense>
+
+// Cyclic Jacobi sweeps over the three off-diagonal pairs. Four take the
+// off-diagonal of A' * A to round-off in double precision.
+#define SVD3_SWEEPS 4
+
+namespace svd3_detail {
+
+// N values processed in lock step. The kernels below are written once for
+// a scalar T and for Lanes<N>; with the latter every operation is a loop
+// over the lanes, which the compiler turns into SIMD instructions.
+template <int N>
+struct Lanes {
+	double v[N];
+
+	Lanes() {}
+	Lanes(double x) { for (int l = 0; l < N; l++) v[l] = x; }
+};
+
+template <int N>
+struct LaneMask {
+	bool v[N];
+};
+
+#define SVD3_LANE_OP(op) \
+	template <int N> inline Lanes<N> operator op(const Lanes<N> &a, const Lanes<N> &b) { Lanes<N> r; for (int l = 0; l < N; l++) r.v[l] = a.v[l] op b.v[l]; return r; }
+SVD3_LANE_OP(+)
+SVD3_LANE_OP(-)
+SVD3_LANE_OP(*)
+SVD3_LANE_OP(/)
+#undef SVD3_LANE_OP
+
+#define SVD3_LANE_CMP(op) \
+	template <int N> inline LaneMask<N> operator op(const Lanes<N> &a, const Lanes<N> &b) { LaneMask<N> r; for (int l = 0; l < N; l++) r.v[l] = a.v[l] op b.v[l]; return r; }
+SVD3_LANE_CMP(<)
+SVD3_LANE_CMP(>)
+SVD3_LANE_CMP(!=)
+#undef SVD3_LANE_CMP
+
+template <int N> inline Lanes<N> operator-(const Lanes<N> &a) { Lanes<N> r; for (int l = 0; l < N; l++) r.v[l] = -a.v[l]; return r; }
+template <int N> inline Lanes<N> sqrt(const Lanes<N> &a) { Lanes<N> r; for (int l = 0; l < N; l++) r.v[l] = std::sqrt(a.v[l]); return r; }
+template <int N> inline Lanes<N> abs(const Lanes<N> &a) { Lanes<N> r; for (int l = 0; l < N; l++) r.v[l] = std::abs(a.v[l]); return r; }
+template <int N> inline Lanes<N> select(const LaneMask<N> &m, const Lanes<N> &a, const Lanes<N> &b) { Lanes<N> r; for (int l = 0; l < N; l++) r.v[l] = m.v[l] ? a.v[l] : b.v[l]; return r; }
+template <class T> inline T select(bool m, const T &a, const T &b) { return m ? a : b; }
+
+// Matrices are 3x3 row-major arrays of T
+
+// Rotates the symmetric S in the (p, q) plane so that S(p, q) becomes zero,
+// and accumulates the rotation into V. S is passed as its entries pp, qq,
+// pq and the entries pk, qk against the third index k. The rotation angle is
+// the smaller of the two that work, as in cyclic Jacobi.
+template <class T>
+inline void jacobi(T &spp, T &sqq, T &spq, T &spk, T &sqk, T *V, int p, int q) {
+	// tan(angle) = g / u is the root of t^2 * spq + t * (spp - sqq) - spq = 0
+	// with |t| <= 1, so c = |u| * w and s = sign(u) * g * w with
+	// w = 1 / sqrt(u^2 + g^2), where u^2 + g^2 = 2 * r * (r + |h|).
+	// c and s do not depend on the scale of h and g, so both are divided by
+	// the larger magnitude first: r would otherwise underflow to zero when
+	// spq is tiny (below about 1e-154) and h is zero.
+	using std::sqrt;
+	using std::abs;
+	T h = spp - sqq;
+	T g = T(2) * spq;
+	T ha = abs(h);
+	T ga = abs(g);
+	T m = select(ha < ga, ga, ha);
+	auto isRotated = spq != T(0);
+	m = select(isRotated, m, T(1));
+	h = h / m;
+	g = g / m;
+	ha = ha / m;
+	T r = sqrt(h * h + g * g);
+	T w = T(1) / sqrt(T(2) * r * (r + ha));
+	T c = select(isRotated, (r + ha) * w, T(1));
+	T s = select(isRotated, select(h < T(0), -g, g) * w, T(0));
+
+	// S = G' * S * G and V = V * G, with G = [c -s; s c] in (p, q)
+	T app = spp;
+	T aqq = sqq;
+	T cs2 = T(2) * c * s * spq;
+	spp = c * c * app + cs2 + s * s * aqq;
+	sqq = s * s * app - cs2 + c * c * aqq;
+	spq = T(0);
+	T apk = spk;
+	T aqk = sqk;
+	spk = c * apk + s * aqk;
+	sqk = -s * apk + c * aqk;
+	for (int k = 0; k < 3; k++) {
+		T vp = V[3 * k + p];
+		T vq = V[3 * k + q];
+		V[3 * k + p] = c * vp + s * vq;
+		V[3 * k + q] = -s * vp + c * vq;
+	}
+}
+
+// Moves the longer of columns p and q of B to p, with the same swap on V.
+// One swapped column is negated so that V stays a rotation.
+template <class T>
+inline void sortColumns(T *B, T *V, int p, int q) {
+	T rp = B[p] * B[p] + B[3 + p] * B[3 + p] + B[6 + p] * B[6 + p];
+	T rq = B[q] * B[q] + B[3 + q] * B[3 + q] + B[6 + q] * B[6 + q];
+	auto b = rp < rq;
+	for (int k = 0; k < 3; k++) {
+		T bp = B[3 * k + p];
+		T bq = B[3 * k + q];
+		B[3 * k + p] = select(b, bq, bp);
+		B[3 * k + q] = select(b, -bp, bq);
+		T vp = V[3 * k + p];
+		T vq = V[3 * k + q];
+		V[3 * k + p] = select(b, vq, vp);
+		V[3 * k + q] = select(b, -vp, vq);
+	}
+}
+
+// Zeros B(q, p) with a rotation of rows p and q, and accumulates it into U
+template <class T>
+inline void givensQR(T *B, T *U, int p, int q) {
+	using std::sqrt;
+	using std::abs;
+	const T eps = T(1e-30);
+	T a1 = B[3 * p + p];
+	T a2 = B[3 * q + p];
+	T rho = sqrt(a1 * a1 + a2 * a2);
+	auto isLarge = rho > eps;
+	T sh = select(isLarge, a2, T(0));
+	T ch = abs(a1) + select(isLarge, rho, eps);
+	auto b = a1 < T(0);
+	T tmp = ch;
+	ch = select(b, sh, ch);
+	sh = select(b, tmp, sh);
+	T w = T(1) / sqrt(ch * ch + sh * sh);
+	ch = ch * w;
+	sh = sh * w;
+	T c = ch * ch - sh * sh;
+	T s = T(2) * ch * sh;
+
+	// B = G' * B and U = U * G
+	for (int k = 0; k < 3; k++) {
+		T bp = B[3 * p + k];
+		T bq = B[3 * q + k];
+		B[3 * p + k] = c * bp + s * bq;
+		B[3 * q + k] = -s * bp + c * bq;
+	}
+	for (int k = 0; k < 3; k++) {
+		T up = U[3 * k + p];
+		T uq = U[3 * k + q];
+		U[3 * k + p] = c * up + s * uq;
+		U[3 * k + q] = -s * up + c * uq;
+	}
+}
+
+} // namespace svd3_detail
+
+// A = U * diag(sigma) * V', with sigma sorted by magnitude
+template <class T>
+inline void svd3x3(const T *A, T *U, T *sigma, T *V) {
+	using namespace svd3_detail;
+	// The upper triangle of A' * A
+	T s00 = A[0] * A[0] + A[3] * A[3] + A[6] * A[6];
+	T s11 = A[1] * A[1] + A[4] * A[4] + A[7] * A[7];
+	T s22 = A[2] * A[2] + A[5] * A[5] + A[8] * A[8];
+	T s01 = A[0] * A[1] + A[3] * A[4] + A[6] * A[7];
+	T s02 = A[0] * A[2] + A[3] * A[5] + A[6] * A[8];
+	T s12 = A[1] * A[2] + A[4] * A[5] + A[7] * A[8];
+	for (int i = 0; i < 9; i++) {
+		V[i] = (i % 4 == 0) ? T(1) : T(0);
+		U[i] = V[i];
+	}
+	for (int sweep = 0; sweep < SVD3_SWEEPS; sweep++) {
+		jacobi(s00, s11, s01, s02, s12, V, 0, 1);
+		jacobi(s11, s22, s12, s01, s02, V, 1, 2);
+		jacobi(s00, s22, s02, s01, s12, V, 0, 2);
+	}
+
+	// B = A * V
+	T B[9];
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 3; c++) {
+			B[3 * r + c] = A[3 * r] * V[c] + A[3 * r + 1] * V[3 + c] + A[3 * r + 2] * V[6 + c];
+		}
+	}
+	sortColumns(B, V, 0, 1);
+	sortColumns(B, V, 0, 2);
+	sortColumns(B, V, 1, 2);
+
+	givensQR(B, U, 0, 1);
+	givensQR(B, U, 0, 2);
+	givensQR(B, U, 1, 2);
+	sigma[0] = B[0];
+	sigma[1] = B[4];
+	sigma[2] = B[8];
+}
+
+// A = R * S, with R a rotation and S symmetric
+template <class T>
+inline void polar3x3(const T *A, T *R, T *S) {
+	T U[9], sigma[3], V[9];
+	svd3x3(A, U, sigma, V);
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 3; c++) {
+			R[3 * r + c] = U[3 * r] * V[3 * c] + U[3 * r + 1] * V[3 * c + 1] + U[3 * r + 2] * V[3 * c + 2];
+			S[3 * r + c] = sigma[0] * V[3 * r] * V[3 * c] + sigma[1] * V[3 * r + 1] * V[3 * c + 1] + sigma[2] * V[3 * r + 2] * V[3 * c + 2];
+		}
+	}
+}
+
+// Polar decompositions of N matrices stored lane-wise, A[i][l] being entry
+// i of matrix l, as in TetStore
+template <int N>
+inline void polarLanes(const double A[9][N], double R[9][N], double S[9][N]) {
+	svd3_detail::Lanes<N> a[9], r[9], s[9];
+	for (int i = 0; i < 9; i++) {
+		for (int l = 0; l < N; l++) {
+			a[i].v[l] = A[i][l];
+		}
+	}
+	polar3x3(a, r, s);
+	for (int i = 0; i < 9; i++) {
+		for (int l = 0; l < N; l++) {
+			R[i][l] = r[i].v[l];
+			S[i][l] = s[i].v[l];
+		}
+	}
+}
+
+inline void svd3(const Eigen::Matrix3d &A, Eigen::Matrix3d &U, Eigen::Vector3d &sigma, Eigen::Matrix3d &V) {
+	Eigen::Matrix<double, 3, 3, Eigen::RowMajor> a = A, u, v;
+	svd3x3(a.data(), u.data(), sigma.data(), v.data());
+	U = u;
+	V = v;
+}
+
+inline void polar3(const Eigen::Matrix3d &A, Eigen::Matrix3d &R, Eigen::Matrix3d &S) {
+	Eigen::Matrix<double, 3, 3, Eigen::RowMajor> a = A, r, s;
+	polar3x3(a.data(), r.data(), s.data());
+	R = r;
+	S = s;
+}
+
+#endif // REDUCEDCOORD_SRC_SVD3_H_